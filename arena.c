@@ -0,0 +1,74 @@
+/*
+ * Bump-pointer scratch arenas.
+ *
+ * Copyright (C) 2018 Andrei Warkentin <andrey.warkentin@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <lib.h>
+#include <arena.h>
+
+int
+arena_init(arena *a,
+	   size_t size,
+	   phys_addr_t max_addr,
+	   lmb_tag_t tag)
+{
+	a->used = 0;
+	a->high_water = 0;
+	a->base = VP(lmb_alloc_base(&lmb, size, PAGE_SIZE, max_addr,
+				    LMB_BOOT, tag));
+	if (a->base == NULL) {
+		a->size = 0;
+		return -1;
+	}
+
+	a->size = size;
+	return 0;
+}
+
+/*
+ * For use before LMB is up.
+ */
+void
+arena_init_buffer(arena *a,
+		  void *buffer,
+		  size_t size)
+{
+	a->base = buffer;
+	a->size = size;
+	a->used = 0;
+	a->high_water = 0;
+}
+
+void *
+arena_alloc(arena *a,
+	    size_t size,
+	    size_t align)
+{
+	size_t start;
+
+	BUG_ON(align == 0 || (align & (align - 1)) != 0);
+
+	start = A_UP(UN(a->base) + a->used, align) - UN(a->base);
+	if (start > a->size || size > a->size - start) {
+		return NULL;
+	}
+
+	a->used = start + size;
+	a->high_water = max(a->high_water, a->used);
+	return a->base + start;
+}
@@ -0,0 +1,72 @@
+/*
+ * Bump-pointer scratch arenas.
+ *
+ * Copyright (C) 2018 Andrei Warkentin <andrey.warkentin@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <lib.h>
+#include <lmb.h>
+
+/*
+ * Nothing is freed individually. Everything allocated after
+ * a mark goes away with arena_release, and everything at all
+ * with arena_reset.
+ */
+typedef struct arena {
+	uint8_t *base;
+	size_t size;
+	size_t used;
+	size_t high_water;
+} arena;
+
+typedef size_t arena_mark_t;
+
+int arena_init(arena *a,
+	       size_t size,
+	       phys_addr_t max_addr,
+	       lmb_tag_t tag);
+void arena_init_buffer(arena *a,
+		       void *buffer,
+		       size_t size);
+void *arena_alloc(arena *a,
+		  size_t size,
+		  size_t align);
+
+static inline arena_mark_t
+arena_mark(arena *a)
+{
+	return a->used;
+}
+
+static inline void
+arena_release(arena *a,
+	      arena_mark_t mark)
+{
+	BUG_ON(mark > a->used);
+	a->used = mark;
+}
+
+static inline void
+arena_reset(arena *a)
+{
+	a->used = 0;
+}
+
+#endif /* ARENA_H */
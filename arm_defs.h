@@ -29,6 +29,7 @@
 #define DSB_LD() asm volatile("dsb ld");
 #define DSB_ST() asm volatile("dsb st");
 #define DSB_ISH() asm volatile("dsb ish");
+#define IC_IALLU() asm volatile("ic iallu");
 
 #define SPSR_2_EL(spsr) (X((spsr), 2, 3))
 #define SPSR_2_BITNESS(spsr) (X((spsr), 4, 4) ? 32 : 64)
@@ -249,6 +249,24 @@ static int console_row = 0; /* cursor row */
 
 static uint32_t eorx, fgx, bgx;  /* color pats */
 
+/*
+ * The console text is kept as a ring of rows starting at
+ * console_origin, so scrolling is just a matter of moving
+ * the origin. The framebuffer is brought up to date by
+ * console_flush, which only draws the cells that differ
+ * from console_screen (what the framebuffer already shows),
+ * and never reads the framebuffer back.
+ */
+#define CONSOLE_ROWS_MAX	(VIDEO_ROWS / VIDEO_FONT_HEIGHT)
+
+static unsigned char console_text[CONSOLE_ROWS_MAX][CONSOLE_COLS];
+static unsigned char console_screen[CONSOLE_ROWS_MAX][CONSOLE_COLS];
+static int console_origin = 0;
+
+/* Columns [first, last) of each screen row that may be stale */
+static int console_dirty_first[CONSOLE_ROWS_MAX];
+static int console_dirty_last[CONSOLE_ROWS_MAX];
+
 static const int video_font_draw_table8[] = {
 	    0x00000000, 0x000000ff, 0x0000ff00, 0x0000ffff,
 	    0x00ff0000, 0x00ff00ff, 0x00ffff00, 0x00ffffff,
@@ -300,6 +318,50 @@ static const int video_font_draw_table32[16][4] = {
 
 /******************************************************************************/
 
+#if CONFIG_VIDEO_DATA_FORMAT == GDF_32BIT_X888RGB
+/*
+ * Every glyph rendered in the console colours, so that drawing
+ * a character is just copying VIDEO_FONT_HEIGHT pixel rows, two
+ * pixels at a time. The cursor is drawn in swapped colours,
+ * which video_drawchars still expands through
+ * video_font_draw_table32.
+ */
+#define VIDEO_GLYPH_ROW	(VIDEO_FONT_WIDTH / 2)
+
+static uint64_t video_glyphs[VIDEO_FONT_CHARS][VIDEO_FONT_HEIGHT][VIDEO_GLYPH_ROW];
+static uint32_t video_glyphs_fgx, video_glyphs_bgx;
+
+static void video_glyphs_render (void)
+{
+	uint8_t *cdat;
+	uint64_t *dest;
+	uint32_t pixel[2];
+	int c, rows, cols;
+
+	/* video_drawchars copies rows of six */
+	C_ASSERT (VIDEO_GLYPH_ROW == 6);
+
+	for (c = 0; c < VIDEO_FONT_CHARS; c++) {
+		cdat = video_fontdata + c * (VIDEO_FONT_HEIGHT * WIDTH_BYTES);
+		for (rows = 0; rows < VIDEO_FONT_HEIGHT; rows++) {
+			dest = video_glyphs[c][rows];
+			for (cols = 0; cols < VIDEO_FONT_WIDTH; cols++) {
+				uint32_t mask = (cdat[cols / 8] & (0x80 >> (cols % 8))) ?
+					0x00ffffff : 0;
+
+				pixel[cols % 2] = SWAP32 ((mask & eorx) ^ bgx);
+				if (cols % 2 != 0)
+					memcpy (&dest[cols / 2], pixel, sizeof (pixel));
+			}
+			cdat += WIDTH_BYTES;
+		}
+	}
+
+	video_glyphs_fgx = fgx;
+	video_glyphs_bgx = bgx;
+}
+#endif
+
 static void video_drawchars (int xx, int yy, unsigned char *s, int count)
 {
 	uint8_t *cdat, *dest, *dest0;
@@ -384,6 +446,29 @@ static void video_drawchars (int xx, int yy, unsigned char *s, int count)
 		break;
 
 	case GDF_32BIT_X888RGB:
+#if CONFIG_VIDEO_DATA_FORMAT == GDF_32BIT_X888RGB
+		if (fgx == video_glyphs_fgx && bgx == video_glyphs_bgx &&
+		    ((uintptr_t) dest0 & 7) == 0) {
+			while (count--) {
+				uint64_t *glyph = video_glyphs[*s][0];
+
+				for (rows = VIDEO_FONT_HEIGHT, dest = dest0;
+				     rows--;
+				     dest += VIDEO_LINE_LEN) {
+					((uint64_t *) dest)[0] = glyph[0];
+					((uint64_t *) dest)[1] = glyph[1];
+					((uint64_t *) dest)[2] = glyph[2];
+					((uint64_t *) dest)[3] = glyph[3];
+					((uint64_t *) dest)[4] = glyph[4];
+					((uint64_t *) dest)[5] = glyph[5];
+					glyph += VIDEO_GLYPH_ROW;
+				}
+				dest0 += VIDEO_FONT_WIDTH * CONFIG_VIDEO_PIXEL_SIZE;
+				s++;
+			}
+			break;
+		}
+#endif
 		while (count--) {
 			c = *s;
 			cdat = video_fontdata + c * (VIDEO_FONT_HEIGHT * WIDTH_BYTES);
@@ -399,10 +484,17 @@ static void video_drawchars (int xx, int yy, unsigned char *s, int count)
 					((uint32_t *) dest)[cols + 1] = SWAP32 ((video_font_draw_table32 [bits >> 4][1] & eorx) ^ bgx);
 					((uint32_t *) dest)[cols + 2] = SWAP32 ((video_font_draw_table32 [bits >> 4][2] & eorx) ^ bgx);
 					((uint32_t *) dest)[cols + 3] = SWAP32 ((video_font_draw_table32 [bits >> 4][3] & eorx) ^ bgx);
-					((uint32_t *) dest)[cols + 4] = SWAP32 ((video_font_draw_table32 [bits & 15][0] & eorx) ^ bgx);
-					((uint32_t *) dest)[cols + 5] = SWAP32 ((video_font_draw_table32 [bits & 15][1] & eorx) ^ bgx);
-					((uint32_t *) dest)[cols + 6] = SWAP32 ((video_font_draw_table32 [bits & 15][2] & eorx) ^ bgx);
-					((uint32_t *) dest)[cols + 7] = SWAP32 ((video_font_draw_table32 [bits & 15][3] & eorx) ^ bgx);
+					/*
+					 * Not past the glyph, as cells are redrawn
+					 * on their own and that would clip the
+					 * next one.
+					 */
+					if (tbits > 4) {
+						((uint32_t *) dest)[cols + 4] = SWAP32 ((video_font_draw_table32 [bits & 15][0] & eorx) ^ bgx);
+						((uint32_t *) dest)[cols + 5] = SWAP32 ((video_font_draw_table32 [bits & 15][1] & eorx) ^ bgx);
+						((uint32_t *) dest)[cols + 6] = SWAP32 ((video_font_draw_table32 [bits & 15][2] & eorx) ^ bgx);
+						((uint32_t *) dest)[cols + 7] = SWAP32 ((video_font_draw_table32 [bits & 15][3] & eorx) ^ bgx);
+					}
 					cols += 8;
 					tbits -= 8;
 				}
@@ -449,14 +541,14 @@ static inline void video_drawstring (int xx, int yy, unsigned char *s)
 }
 
 /*****************************************************************************/
-
+#if defined(CONFIG_CONSOLE_CURSOR) || defined(CONFIG_VIDEO_SW_CURSOR)
 static void video_putchar (int xx, int yy, unsigned char c)
 {
 	video_drawchars (xx, yy + video_logo_height, &c, 1);
 }
 
 /*****************************************************************************/
-#if defined(CONFIG_CONSOLE_CURSOR) || defined(CONFIG_VIDEO_SW_CURSOR)
+
 static void video_set_cursor (void)
 {
 	/* swap drawing colors */
@@ -529,36 +621,82 @@ static void memsetl (int *p, int c, int v)
 /*****************************************************************************/
 
 
+static void console_dirty (int row, int first, int last)
+{
+	if (first < console_dirty_first[row])
+		console_dirty_first[row] = first;
+	if (last > console_dirty_last[row])
+		console_dirty_last[row] = last;
+}
+
+/*****************************************************************************/
+
+static void console_setc (int col, int row, unsigned char c)
+{
+	console_text[(console_origin + row) % CONSOLE_ROWS][col] = c;
+	console_dirty (row, col, col + 1);
+}
+
+/*****************************************************************************/
+
+static void console_setchars (int col, int row, const char *s, int count)
+{
+	memcpy (console_text[(console_origin + row) % CONSOLE_ROWS] + col,
+		s, count);
+	console_dirty (row, col, col + count);
+}
+
+/*****************************************************************************/
+
+static void console_flush (void)
+{
+	int row, col, first, last;
+	unsigned char *text, *screen;
+
+	for (row = 0; row < CONSOLE_ROWS; row++) {
+		text = console_text[(console_origin + row) % CONSOLE_ROWS];
+		screen = console_screen[row];
+		col = console_dirty_first[row];
+		last = console_dirty_last[row];
+
+		while (col < last) {
+			if (text[col] == screen[col]) {
+				col++;
+				continue;
+			}
+
+			/* draw each run of changed cells in one go */
+			first = col;
+			while (col < last && text[col] != screen[col])
+				col++;
+
+			memcpy (screen + first, text + first, col - first);
+			video_drawchars (first * VIDEO_FONT_WIDTH,
+					 row * VIDEO_FONT_HEIGHT + video_logo_height,
+					 screen + first, col - first);
+		}
+
+		console_dirty_first[row] = CONSOLE_COLS;
+		console_dirty_last[row] = 0;
+	}
+}
+
+/*****************************************************************************/
+
 static void console_scrollup (void)
 {
-	/* copy up rows ignoring the first one */
-
-#ifdef VIDEO_HW_BITBLT
-	video_hw_bitblt (CONFIG_VIDEO_PIXEL_SIZE,	/* bytes per pixel */
-			 0,	/* source pos x */
-			 video_logo_height + VIDEO_FONT_HEIGHT, /* source pos y */
-			 0,	/* dest pos x */
-			 video_logo_height,	/* dest pos y */
-			 CONFIG_VIDEO_VISIBLE_COLS,	/* frame width */
-			 CONFIG_VIDEO_VISIBLE_ROWS - video_logo_height - VIDEO_FONT_HEIGHT	/* frame height */
-		);
-#else
-	memcpy(CONSOLE_ROW_FIRST, CONSOLE_ROW_SECOND,
-	       CONSOLE_SCROLL_SIZE);
-#endif
+	int row;
 
-	/* clear the last one */
-#ifdef VIDEO_HW_RECTFILL
-	video_hw_rectfill (CONFIG_VIDEO_PIXEL_SIZE,	/* bytes per pixel */
-			   0,	/* dest pos x */
-			   CONFIG_VIDEO_VISIBLE_ROWS - VIDEO_FONT_HEIGHT,	/* dest pos y */
-			   CONFIG_VIDEO_VISIBLE_COLS,	/* frame width */
-			   VIDEO_FONT_HEIGHT,	/* frame height */
-			   CONSOLE_BG_COL	/* fill color */
-		);
-#else
-	memsetl (CONSOLE_ROW_LAST, CONSOLE_ROW_SIZE >> 2, CONSOLE_BG_COL);
-#endif
+	/* the first row becomes the (cleared) last one */
+	memset (console_text[console_origin], ' ', CONSOLE_COLS);
+	console_origin = (console_origin + 1) % CONSOLE_ROWS;
+
+	/*
+	 * Every row now shows different text, but only the cells
+	 * that actually differ get drawn by console_flush.
+	 */
+	for (row = 0; row < CONSOLE_ROWS; row++)
+		console_dirty (row, 0, CONSOLE_COLS);
 }
 
 /*****************************************************************************/
@@ -574,9 +712,7 @@ static void console_back (void)
 		if (console_row < 0)
 			console_row = 0;
 	}
-	video_putchar (console_col * VIDEO_FONT_WIDTH,
-		       console_row * VIDEO_FONT_HEIGHT,
-		       ' ');
+	console_setc (console_col, console_row, ' ');
 }
 
 /*****************************************************************************/
@@ -611,19 +747,22 @@ static void console_cr (void)
 
 /*****************************************************************************/
 
+static int console_nl = 1;
+
+/*
+ * Only updates the text, see video_puts.
+ */
 void video_putc (const char c)
 {
-	static int nl = 1;
-
 	switch (c) {
 	case 13:		/* back to first column */
 		console_cr ();
 		break;
 
 	case '\n':		/* next line */
-		if (console_col || (!console_col && nl))
+		if (console_col || (!console_col && console_nl))
 			console_newline ();
-		nl = 1;
+		console_nl = 1;
 		break;
 
 	case 9:		/* tab 8 */
@@ -640,15 +779,13 @@ void video_putc (const char c)
 		break;
 
 	default:		/* draw the char */
-		video_putchar (console_col * VIDEO_FONT_WIDTH,
-			       console_row * VIDEO_FONT_HEIGHT,
-			       c);
+		console_setc (console_col, console_row, c);
 		console_col++;
 
 		/* check for newline */
 		if (console_col >= CONSOLE_COLS) {
 			console_newline ();
-			nl = 0;
+			console_nl = 0;
 		}
 	}
 	CURSOR_SET;
@@ -657,12 +794,56 @@ void video_putc (const char c)
 
 /*****************************************************************************/
 
-void video_puts (const char *s)
+/*
+ * Runs of characters up to the end of the line are copied in one
+ * go, and only the control characters go through video_putc. The
+ * screen is left alone until video_flush.
+ */
+void video_write (const char *s, size_t len)
 {
-	int count = strlen (s);
+	int count;
 
-	while (count--)
-		video_putc (*s++);
+	while (len != 0) {
+		for (count = 0; count < CONSOLE_COLS - console_col &&
+			     count < len; count++) {
+			if (s[count] == 13 || s[count] == '\n' ||
+			    s[count] == 9 || s[count] == 8)
+				break;
+		}
+
+		if (count == 0) {
+			video_putc (*s++);
+			len--;
+			continue;
+		}
+
+		console_setchars (console_col, console_row, s, count);
+		console_col += count;
+		s += count;
+		len -= count;
+
+		/* check for newline */
+		if (console_col >= CONSOLE_COLS) {
+			console_newline ();
+			console_nl = 0;
+		}
+		CURSOR_SET;
+	}
+}
+
+/*****************************************************************************/
+
+void video_flush (void)
+{
+	console_flush ();
+}
+
+/*****************************************************************************/
+
+void video_puts (const char *s)
+{
+	video_write (s, strlen (s));
+	video_flush ();
 }
 
 /*****************************************************************************/
@@ -1452,6 +1633,7 @@ static void *video_logo (void)
 
 int video_init (void *videobase)
 {
+	int i;
 	unsigned char color8;
 
 	video_fb_address = videobase;
@@ -1507,6 +1689,9 @@ int video_init (void *videobase)
 		break;
 	}
 	eorx = fgx ^ bgx;
+#if CONFIG_VIDEO_DATA_FORMAT == GDF_32BIT_X888RGB
+	video_glyphs_render ();
+#endif
 
 #ifdef CONFIG_VIDEO_LOGO
 	/* Plot the logo and get start point of console */
@@ -1519,6 +1704,13 @@ int video_init (void *videobase)
 	/* Initialize the console */
 	console_col = 0;
 	console_row = 0;
+	console_origin = 0;
+	memset (console_text, ' ', sizeof (console_text));
+	memset (console_screen, ' ', sizeof (console_screen));
+	for (i = 0; i < CONSOLE_ROWS_MAX; i++) {
+		console_dirty_first[i] = CONSOLE_COLS;
+		console_dirty_last[i] = 0;
+	}
 
 	memsetl(CONSOLE_ROW_FIRST, CONFIG_VIDEO_VISIBLE_COLS * CONFIG_VIDEO_VISIBLE_ROWS,
 		CONSOLE_BG_COL);
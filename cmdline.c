@@ -0,0 +1,362 @@
+/*
+ * Kernel command line parameters.
+ *
+ * Copyright (C) 2018 Andrei Warkentin <andrey.warkentin@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <cmdline.h>
+
+static uint64_t
+memparse(const char *ptr, char **retptr)
+{
+	/* local pointer to end of parsed string */
+	char *endptr;
+
+	uint64_t ret = simple_strtoull(ptr, &endptr, 0);
+
+	switch (*endptr) {
+	case 'G':
+	case 'g':
+		ret <<= 10;
+	case 'M':
+	case 'm':
+		ret <<= 10;
+	case 'K':
+	case 'k':
+		ret <<= 10;
+		endptr++;
+	default:
+		break;
+	}
+
+	if (retptr) {
+		*retptr = endptr;
+	}
+
+	return ret;
+}
+
+void
+cmdline_init(cmdline *c)
+{
+	c->nr_params = 0;
+	c->used = 0;
+}
+
+static char *
+cmdline_copy(char *to,
+	     size_t *used,
+	     const char *s)
+{
+	char *copy = to + *used;
+	size_t len = strlen(s) + 1;
+
+	memcpy(copy, s, len);
+	*used += len;
+	return copy;
+}
+
+/*
+ * Replaced and deleted parameters leave their strings
+ * behind, and only the ones still referenced are kept.
+ */
+static void
+cmdline_compact(cmdline *c)
+{
+	unsigned long i;
+	size_t used = 0;
+	cmdline_param *p;
+
+	for (i = 0; i < c->nr_params; i++) {
+		p = &c->params[i];
+		p->key = c->buf + (cmdline_copy(c->spare, &used, p->key) -
+				   c->spare);
+		if (p->val != NULL) {
+			p->val = c->buf + (cmdline_copy(c->spare, &used,
+							 p->val) - c->spare);
+		}
+	}
+
+	memcpy(c->buf, c->spare, used);
+	c->used = used;
+}
+
+/*
+ * A copy of the first len bytes of s, NUL-terminated.
+ */
+static char *
+cmdline_store(cmdline *c,
+	      const char *s,
+	      size_t len)
+{
+	char *copy;
+
+	if (c->used + len + 1 > sizeof(c->buf)) {
+		cmdline_compact(c);
+		if (c->used + len + 1 > sizeof(c->buf)) {
+			return NULL;
+		}
+	}
+
+	copy = c->buf + c->used;
+	memcpy(copy, s, len);
+	copy[len] = '\0';
+	c->used += len + 1;
+	return copy;
+}
+
+/*
+ * Splits like the kernel's next_arg: parameters are separated
+ * by whitespace outside double quotes, and the key ends at the
+ * first '='.
+ */
+int
+cmdline_append(cmdline *c,
+	       const char *s)
+{
+	size_t i;
+	size_t equals;
+	bool_t in_quote;
+	cmdline_param *p;
+
+	for (;;) {
+		while (isspace(*s)) {
+			s++;
+		}
+
+		if (*s == '\0') {
+			return 0;
+		}
+
+		equals = 0;
+		in_quote = false;
+		for (i = 0; s[i] != '\0'; i++) {
+			if (isspace(s[i]) && !in_quote) {
+				break;
+			}
+
+			if (s[i] == '"') {
+				in_quote = !in_quote;
+			} else if (s[i] == '=' && equals == 0) {
+				equals = i;
+			}
+		}
+
+		if (c->nr_params == CMDLINE_MAX_PARAMS) {
+			return -1;
+		}
+
+		/*
+		 * Counted before storing the value, so that
+		 * compacting buf doesn't lose the key.
+		 */
+		p = &c->params[c->nr_params];
+		p->val = NULL;
+		p->key = cmdline_store(c, s, equals == 0 ? i : equals);
+		if (p->key == NULL) {
+			return -1;
+		}
+		c->nr_params++;
+
+		if (equals != 0) {
+			p->val = cmdline_store(c, s + equals + 1,
+					       i - equals - 1);
+			if (p->val == NULL) {
+				c->nr_params--;
+				return -1;
+			}
+		}
+
+		s += i;
+	}
+}
+
+cmdline_param *
+cmdline_find(cmdline *c,
+	     const char *key)
+{
+	unsigned long i;
+
+	for (i = c->nr_params; i != 0; i--) {
+		if (!strcmp(c->params[i - 1].key, key)) {
+			return &c->params[i - 1];
+		}
+	}
+
+	return NULL;
+}
+
+bool_t
+cmdline_size(cmdline *c,
+	     const char *key,
+	     uint64_t *size)
+{
+	char *end;
+	cmdline_param *p = cmdline_find(c, key);
+
+	if (p == NULL || p->val == NULL) {
+		return false;
+	}
+
+	*size = memparse(p->val, &end);
+	return end != p->val;
+}
+
+bool_t
+cmdline_memloc(cmdline *c,
+	       const char *key,
+	       phys_addr_t *base,
+	       uint64_t *size)
+{
+	char *at;
+	uint64_t s;
+	cmdline_param *p = cmdline_find(c, key);
+
+	if (p == NULL || p->val == NULL) {
+		return false;
+	}
+
+	s = memparse(p->val, &at);
+	if (at == p->val) {
+		return false;
+	}
+
+	if (*at != '@') {
+		*base = s;
+		*size = PAGE_SIZE;
+	} else {
+		*base = memparse(at + 1, NULL);
+		*size = s;
+	}
+
+	return true;
+}
+
+int
+cmdline_set(cmdline *c,
+	    const char *key,
+	    const char *val)
+{
+	unsigned long i;
+	unsigned long kept;
+	char *val_copy = NULL;
+	cmdline_param *p = NULL;
+	bool_t added = false;
+
+	for (i = 0; i < c->nr_params; i++) {
+		if (!strcmp(c->params[i].key, key)) {
+			p = &c->params[i];
+			break;
+		}
+	}
+
+	if (p == NULL) {
+		if (c->nr_params == CMDLINE_MAX_PARAMS) {
+			return -1;
+		}
+
+		p = &c->params[c->nr_params];
+		p->val = NULL;
+		p->key = cmdline_store(c, key, strlen(key));
+		if (p->key == NULL) {
+			return -1;
+		}
+
+		c->nr_params++;
+		added = true;
+	}
+
+	/*
+	 * p is in the table by now, so compacting
+	 * buf here keeps its key.
+	 */
+	if (val != NULL) {
+		val_copy = cmdline_store(c, val, strlen(val));
+		if (val_copy == NULL) {
+			if (added) {
+				c->nr_params--;
+			}
+			return -1;
+		}
+	}
+
+	p->val = val_copy;
+	for (kept = ++i; i < c->nr_params; i++) {
+		if (strcmp(c->params[i].key, key)) {
+			c->params[kept++] = c->params[i];
+		}
+	}
+
+	c->nr_params = kept;
+	return 0;
+}
+
+int
+cmdline_delete(cmdline *c,
+	       const char *key)
+{
+	unsigned long i;
+	unsigned long kept = 0;
+
+	for (i = 0; i < c->nr_params; i++) {
+		if (strcmp(c->params[i].key, key)) {
+			c->params[kept++] = c->params[i];
+		}
+	}
+
+	if (kept == c->nr_params) {
+		return -1;
+	}
+
+	c->nr_params = kept;
+	return 0;
+}
+
+int
+cmdline_write(cmdline *c,
+	      char *buf,
+	      size_t size)
+{
+	unsigned long i;
+	size_t need;
+	size_t len = 0;
+	cmdline_param *p;
+
+	if (size == 0) {
+		return -1;
+	}
+
+	buf[0] = '\0';
+	for (i = 0; i < c->nr_params; i++) {
+		p = &c->params[i];
+		need = (i != 0) + strlen(p->key);
+		if (p->val != NULL) {
+			need += 1 + strlen(p->val);
+		}
+
+		if (len + need >= size) {
+			return -1;
+		}
+
+		len += scnprintf(buf + len, size - len, "%s%s%s%s",
+				 i == 0 ? "" : " ", p->key,
+				 p->val == NULL ? "" : "=",
+				 p->val == NULL ? "" : p->val);
+	}
+
+	return len;
+}
@@ -0,0 +1,101 @@
+/*
+ * Kernel command line parameters.
+ *
+ * Copyright (C) 2018 Andrei Warkentin <andrey.warkentin@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef CMDLINE_H
+#define CMDLINE_H
+
+#include <lib.h>
+
+#define CMDLINE_SIZE       PAGE_SIZE
+#define CMDLINE_MAX_PARAMS 256
+
+typedef struct cmdline_param {
+	char *key;
+	/*
+	 * NULL for a plain "key", as opposed to "key=".
+	 */
+	char *val;
+} cmdline_param;
+
+/*
+ * A command line split into parameters, in order and with
+ * duplicates kept. Keys and values are NUL-terminated copies
+ * in buf, with any quotes left in, so writing the table back
+ * gives the same command line modulo whitespace.
+ */
+typedef struct cmdline {
+	unsigned long nr_params;
+	size_t used;
+	cmdline_param params[CMDLINE_MAX_PARAMS];
+	char buf[CMDLINE_SIZE];
+	/*
+	 * Edits only ever add to buf, which is compacted
+	 * through here when it runs out.
+	 */
+	char spare[CMDLINE_SIZE];
+} cmdline;
+
+void cmdline_init(cmdline *c);
+
+/*
+ * Adds the parameters in s after the ones already there.
+ * Returns -1 if some didn't fit, with the ones before kept.
+ */
+int cmdline_append(cmdline *c,
+		   const char *s);
+
+/*
+ * The last one wins, as with most kernel parameters.
+ */
+cmdline_param *cmdline_find(cmdline *c,
+			    const char *key);
+bool_t cmdline_size(cmdline *c,
+		    const char *key,
+		    uint64_t *size);
+/*
+ * "size@base", or a page at "base".
+ */
+bool_t cmdline_memloc(cmdline *c,
+		      const char *key,
+		      phys_addr_t *base,
+		      uint64_t *size);
+
+/*
+ * Replaces the first "key" in place and drops any other, or adds
+ * one at the end. val is taken as is, so it needs quotes if it
+ * has spaces, and may be NULL.
+ */
+int cmdline_set(cmdline *c,
+		const char *key,
+		const char *val);
+/*
+ * Drops every "key". Returns -1 if there were none.
+ */
+int cmdline_delete(cmdline *c,
+		   const char *key);
+
+/*
+ * Returns the length written to buf, or -1 if it's too small.
+ */
+int cmdline_write(cmdline *c,
+		  char *buf,
+		  size_t size);
+
+#endif /* CMDLINE_H */
@@ -0,0 +1,65 @@
+/*
+ * CRC32C (Castagnoli).
+ *
+ * Copyright (C) 2018 Andrei Warkentin <andrey.warkentin@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <crc32c.h>
+
+/*
+ * Reflected Castagnoli polynomial.
+ */
+#define CRC32C_POLY 0x82f63b78
+
+static uint32_t crc32c_table[256];
+static bool_t crc32c_table_ready;
+
+static void
+crc32c_init_table(void)
+{
+	unsigned i;
+	unsigned j;
+
+	for (i = 0; i < ELES(crc32c_table); i++) {
+		uint32_t c = i;
+
+		for (j = 0; j < 8; j++) {
+			c = (c >> 1) ^ ((c & 1) ? CRC32C_POLY : 0);
+		}
+
+		crc32c_table[i] = c;
+	}
+
+	crc32c_table_ready = true;
+}
+
+uint32_t
+crc32c(uint32_t crc, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+
+	if (!crc32c_table_ready) {
+		crc32c_init_table();
+	}
+
+	crc = ~crc;
+	while (len--) {
+		crc = crc32c_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	}
+
+	return ~crc;
+}
@@ -0,0 +1,32 @@
+/*
+ * CRC32C (Castagnoli).
+ *
+ * Copyright (C) 2018 Andrei Warkentin <andrey.warkentin@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <defs.h>
+
+/*
+ * Pass 0 as the initial crc, and the previous result
+ * to continue a running checksum.
+ */
+uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+
+#endif /* CRC32C_H */
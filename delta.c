@@ -0,0 +1,137 @@
+/*
+ * Block-hash index and delta patching of staged images.
+ *
+ * Copyright (C) 2018 Andrei Warkentin <andrey.warkentin@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <lib.h>
+#include <crc32c.h>
+#include <delta.h>
+
+size_t
+delta_hashes_size(size_t image_size,
+		  size_t block_size)
+{
+	/*
+	 * block_size needn't be a power of two, so no A_UP.
+	 */
+	size_t count = (image_size + block_size - 1) / block_size;
+
+	return sizeof(delta_hashes) + count * sizeof(uint32_t);
+}
+
+void
+delta_hash(const void *image,
+	   size_t image_size,
+	   size_t block_size,
+	   delta_hashes *hashes)
+{
+	size_t off;
+	uint32_t i = 0;
+
+	hashes->magic = DELTA_HASHES_MAGIC;
+	hashes->block_size = block_size;
+	hashes->image_size = image_size;
+	hashes->reserved = 0;
+
+	for (off = 0; off < image_size; off += block_size) {
+		hashes->crc[i++] = crc32c(0, image + off,
+					  min(block_size, image_size - off));
+	}
+
+	hashes->count = i;
+}
+
+int
+delta_check(const void *delta,
+	    size_t delta_size,
+	    size_t *new_size)
+{
+	const delta_hdr *hdr = delta;
+
+	if (delta_size < sizeof(*hdr) ||
+	    hdr->magic != DELTA_MAGIC ||
+	    hdr->block_size == 0) {
+		return -1;
+	}
+
+	*new_size = hdr->new_size;
+	return 0;
+}
+
+int
+delta_apply(const void *base,
+	    size_t base_size,
+	    const void *delta,
+	    size_t delta_size,
+	    void *out,
+	    size_t out_size)
+{
+	uint32_t i;
+	size_t done = 0;
+	const delta_hdr *hdr = delta;
+	const uint8_t *p = delta + sizeof(*hdr);
+	const uint8_t *end = delta + delta_size;
+
+	for (i = 0; i < hdr->records; i++) {
+		size_t len;
+		const void *src;
+		const delta_rec *rec = (const delta_rec *) p;
+
+		if (end - p < sizeof(*rec)) {
+			return -1;
+		}
+		p += sizeof(*rec);
+
+		if (rec->op == DELTA_OP_COPY) {
+			size_t from;
+
+			/*
+			 * Before multiplying, which could wrap.
+			 */
+			if (base_size == 0 ||
+			    rec->arg > (base_size - 1) / hdr->block_size) {
+				return -1;
+			}
+
+			from = rec->arg * hdr->block_size;
+
+			len = min((size_t) rec->count * hdr->block_size,
+				  base_size - from);
+			src = base + from;
+		} else if (rec->op == DELTA_OP_DATA) {
+			len = rec->count;
+			if (end - p < A_UP(len, 8)) {
+				return -1;
+			}
+
+			src = p;
+			p += A_UP(len, 8);
+		} else {
+			return -1;
+		}
+
+		if (out_size - done < len) {
+			return -1;
+		}
+
+		memcpy(out + done, src, len);
+		done += len;
+	}
+
+	return done == out_size ? 0 : -1;
+}
@@ -0,0 +1,82 @@
+/*
+ * Block-hash index and delta patching of staged images.
+ *
+ * Copyright (C) 2018 Andrei Warkentin <andrey.warkentin@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <defs.h>
+
+#define DELTA_BLOCK_SIZE 0x10000
+
+/*
+ * What "oem blockhashes" stages for upload: this header
+ * followed by one CRC32C per block. All fields are
+ * little-endian.
+ */
+#define DELTA_HASHES_MAGIC 0x48534842 /* "BHSH" */
+typedef struct delta_hashes {
+	uint32_t magic;
+	uint32_t block_size;
+	uint64_t image_size;
+	uint32_t count;
+	uint32_t reserved;
+	uint32_t crc[0];
+} delta_hashes;
+
+/*
+ * What "oem patch" consumes: this header followed by
+ * 'records' delta_rec entries. A DELTA_OP_DATA record
+ * is immediately followed by 'count' literal bytes,
+ * padded to 8 bytes.
+ */
+#define DELTA_MAGIC 0x50544c44 /* "DLTP" */
+typedef struct delta_hdr {
+	uint32_t magic;
+	uint32_t block_size;
+	uint64_t new_size;
+	uint32_t records;
+	uint32_t reserved;
+} delta_hdr;
+
+typedef struct delta_rec {
+	/*
+	 * Copy 'count' blocks starting at block 'arg' of the
+	 * base image. The last base block may be short.
+	 */
+#define DELTA_OP_COPY 1
+	/*
+	 * Copy 'count' literal bytes following the record.
+	 */
+#define DELTA_OP_DATA 2
+	uint32_t op;
+	uint32_t count;
+	uint64_t arg;
+} delta_rec;
+
+size_t delta_hashes_size(size_t image_size, size_t block_size);
+void delta_hash(const void *image, size_t image_size,
+		size_t block_size, delta_hashes *hashes);
+int delta_check(const void *delta, size_t delta_size,
+		size_t *new_size);
+int delta_apply(const void *base, size_t base_size,
+		const void *delta, size_t delta_size,
+		void *out, size_t out_size);
+
+#endif /* DELTA_H */
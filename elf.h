@@ -0,0 +1,90 @@
+/*
+ * Minimal ELF64 definitions.
+ *
+ * Copyright (C) 2018 Andrei Warkentin <andrey.warkentin@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef ELF_H
+#define ELF_H
+
+#include <defs.h>
+
+#define ELFMAG      "\177ELF"
+#define SELFMAG     4
+#define EI_CLASS    4
+#define EI_DATA     5
+#define EI_NIDENT   16
+#define ELFCLASS64  2
+#define ELFDATA2LSB 1
+
+#define ET_EXEC 2
+#define ET_DYN  3
+
+#define EM_AARCH64 183
+
+#define PT_LOAD    1
+#define PT_DYNAMIC 2
+
+#define DT_NULL    0
+#define DT_RELA    7
+#define DT_RELASZ  8
+#define DT_RELAENT 9
+
+#define R_AARCH64_RELATIVE 0x403
+
+#define ELF64_R_TYPE(info) ((uint32_t) (info))
+
+typedef struct Elf64_Ehdr {
+	uint8_t e_ident[EI_NIDENT];
+	uint16_t e_type;
+	uint16_t e_machine;
+	uint32_t e_version;
+	uint64_t e_entry;
+	uint64_t e_phoff;
+	uint64_t e_shoff;
+	uint32_t e_flags;
+	uint16_t e_ehsize;
+	uint16_t e_phentsize;
+	uint16_t e_phnum;
+	uint16_t e_shentsize;
+	uint16_t e_shnum;
+	uint16_t e_shstrndx;
+} Elf64_Ehdr;
+
+typedef struct Elf64_Phdr {
+	uint32_t p_type;
+	uint32_t p_flags;
+	uint64_t p_offset;
+	uint64_t p_vaddr;
+	uint64_t p_paddr;
+	uint64_t p_filesz;
+	uint64_t p_memsz;
+	uint64_t p_align;
+} Elf64_Phdr;
+
+typedef struct Elf64_Dyn {
+	int64_t d_tag;
+	uint64_t d_val;
+} Elf64_Dyn;
+
+typedef struct Elf64_Rela {
+	uint64_t r_offset;
+	uint64_t r_info;
+	int64_t r_addend;
+} Elf64_Rela;
+
+#endif /* ELF_H */
@@ -53,41 +53,39 @@
 #include <lmb.h>
 #include <usb_descriptors.h>
 #include <tegra.h>
+#include <delta.h>
+#include <image_cache.h>
+#include <payload.h>
+#include <arena.h>
+#include <libfdt.h>
+#include <fdt_index.h>
+#include <fdt_overlay.h>
+#include <cmdline.h>
 
 #define DOWNLOAD_ALIGNMENT 0x100000
-
-#define BOOT_MAGIC "ANDROID!"
-#define BOOT_MAGIC_SIZE 8
-#define BOOT_NAME_SIZE 16
-#define BOOT_ARGS_SIZE 512
-#define BOOT_EXTRA_ARGS_SIZE 1024
+/*
+ * Below 4GB, so scratch buffers can be sent with "upload".
+ */
+#define SCRATCH_SIZE MB(4)
+#define UPLOAD_ALIGNMENT PAGE_SIZE
 
 #define FB_BAD_COMMAND "FAILBad command"
 #define FB_UNKNOWN_COMMAND "FAILUnknown command"
 #define FB_OOM "FAILOut of memory"
 #define FB_NOT_DOWNLOADED "FAILNothing downloaded"
+#define FB_NOT_STAGED "FAILNothing staged"
+#define FB_NO_BASE "FAILNo base image"
+#define FB_BAD_PATCH "FAILBad patch"
+#define FB_NOT_CACHED "FAILNothing cached"
+#define FB_UNKNOWN_VAR "FAILUnknown variable"
+#define FB_BAD_IMAGE "FAILBad image"
+#define FB_NOT_ALLOCATED "FAILNot allocated"
+#define FB_BAD_OVERLAY "FAILBad overlay"
+#define FB_BAD_FDT "FAILBad FDT"
+#define FB_NOT_FOUND "FAILNot found"
 
 #define FB_OK NULL
 
-typedef struct boot_img {
-	unsigned char magic[BOOT_MAGIC_SIZE];
-	unsigned kernel_size;  /* size in bytes */
-	unsigned kernel_addr;  /* physical load addr */
-	unsigned ramdisk_size; /* size in bytes */
-	unsigned ramdisk_addr; /* physical load addr */
-	unsigned second_size;  /* size in bytes */
-	unsigned second_addr;  /* physical load addr */
-	unsigned tags_addr;    /* physical addr for kernel tags */
-	unsigned page_size;    /* flash page size we assume */
-	unsigned unused[2];    /* future expansion: should be 0 */
-	unsigned char name[BOOT_NAME_SIZE]; /* asciiz product name */
-	unsigned char cmdline[BOOT_ARGS_SIZE];
-	unsigned id[8]; /* timestamp / checksum / sha1 / etc */
-	/* Supplemental command line data; kept here to maintain
-	 * binary compatibility with older versions of mkbootimg */
-	unsigned char extra_cmdline[BOOT_EXTRA_ARGS_SIZE];
-} boot_img;
-
 typedef char *fb_status;
 
 typedef struct fb_reboot_state {
@@ -103,27 +101,71 @@ typedef struct fb_peek_state {
 	size_t buffer_len;
 } fb_peek_state;
 
+/*
+ * NUL-separated lines in the scratch arena, sent
+ * one INFO at a time.
+ */
+typedef struct fb_info_state {
+	char *next;
+	char *end;
+	/*
+	 * Ends the command once all lines are sent.
+	 */
+	fb_status status;
+} fb_info_state;
+
 typedef struct fb_mem {
 	/*
 	 * 2 per EP0, 2 per EP1.
 	 */
 	usbd_td qtds[4];
 	usbd uctx;
-	usbd_req ep1_out_req;
-	usbd_req ep1_in_req;
+	usbd_req *ep1_out_req;
+	usbd_req *ep1_in_req;
 	bool_t in_command;
 	uint8_t *last_loaded;
 	size_t load_size;
 	size_t load_rem;
-	size_t load_align;
+	/*
+	 * Set if last_loaded came from the image cache, and thus
+	 * doesn't need to be cached again when run.
+	 */
+	bool_t load_cached;
+	/*
+	 * Previous download kept around by "oem blockhashes"
+	 * for "oem patch" to copy unchanged blocks from.
+	 */
+	uint8_t *patch_base;
+	size_t patch_base_size;
+	/*
+	 * Buffer staged for the "upload" command.
+	 */
+	uint8_t *staged;
+	size_t staged_size;
+	size_t staged_rem;
+	/*
+	 * What "flash:run" is about to enter.
+	 */
+	payload payload;
+	/*
+	 * Temporary buffers for the command being processed,
+	 * dropped once its response is sent. Use fb_scratch().
+	 */
+	arena scratch;
 	/*
 	 * Command states.
 	 */
 	union {
 		fb_peek_state peek;
 		fb_reboot_state reboot;
+		fb_info_state info;
 	};
 	void *fdt;
+	/*
+	 * Set once fdt is a copy with overlays applied,
+	 * rather than what we were started with.
+	 */
+	bool_t fdt_copied;
 } fb_mem;
 
 static usbd_ep fb_ep1_out = {
@@ -150,6 +192,9 @@ static void fb_rx_data(struct usbd *context,
 static void fb_rx_cmd(struct usbd *context,
 		      usbd_req *unused);
 
+static void fb_tx_staged(struct usbd *context,
+			 usbd_req *unused);
+
 
 static void
 fb_end_command_complete(usbd *context,
@@ -157,6 +202,30 @@ fb_end_command_complete(usbd *context,
 {
 	fb_mem *fb = context->ctx;
 	fb->in_command = false;
+	arena_reset(&fb->scratch);
+}
+
+static void *
+fb_scratch(fb_mem *fb,
+	   size_t size)
+{
+	return arena_alloc(&fb->scratch, size, sizeof(uint64_t));
+}
+
+/*
+ * Stops the controller and returns the bulk requests
+ * before fastboot hands off to a payload or reboots.
+ */
+static void
+fb_fini(usbd *context)
+{
+	fb_mem *fb = context->ctx;
+
+	usbd_fini(context);
+	usbd_req_free(fb->ep1_out_req);
+	usbd_req_free(fb->ep1_in_req);
+	fb->ep1_out_req = NULL;
+	fb->ep1_in_req = NULL;
 }
 
 static void
@@ -170,13 +239,13 @@ fb_end_command_with_custom_complete(struct usbd *context,
 		status = "OKAY";
 	}
 
-	fb->ep1_in_req.buffer = fb->ep1_in_req.small_buffer;
-	fb->ep1_in_req.buffer_length = strlen(status) + 1;
-	BUG_ON (fb->ep1_in_req.buffer_length >
-		sizeof(fb->ep1_in_req.small_buffer));
-	memcpy(fb->ep1_in_req.buffer, status, strlen(status) + 1);
-	fb->ep1_in_req.complete = complete;
-	usbd_req_submit(context, &(fb->ep1_in_req));
+	fb->ep1_in_req->buffer = fb->ep1_in_req->small_buffer;
+	fb->ep1_in_req->buffer_length = strlen(status) + 1;
+	BUG_ON (fb->ep1_in_req->buffer_length >
+		sizeof(fb->ep1_in_req->small_buffer));
+	memcpy(fb->ep1_in_req->buffer, status, strlen(status) + 1);
+	fb->ep1_in_req->complete = complete;
+	usbd_req_submit(context, fb->ep1_in_req);
 }
 
 static void
@@ -187,6 +256,27 @@ fb_end_command(struct usbd *context,
 					    fb_end_command_complete);
 }
 
+static void
+fb_end_command_with_value(struct usbd *context, char *fmt, ...)
+{
+	va_list list;
+	fb_mem *fb = context->ctx;
+
+	va_start(list, fmt);
+	fb->ep1_in_req->buffer = fb->ep1_in_req->small_buffer;
+
+	memcpy(fb->ep1_in_req->buffer, "OKAY", 4);
+	fb->ep1_in_req->buffer_length =
+		vscnprintf(fb->ep1_in_req->buffer + 4,
+			   sizeof(fb->ep1_in_req->small_buffer) - 4,
+			   fmt, list) + 4;
+
+	fb->ep1_in_req->complete = fb_end_command_complete;
+	usbd_req_submit(context, fb->ep1_in_req);
+
+	va_end(list);
+}
+
 static void
 fb_end_command_with_info_complete(usbd *context,
 				  usbd_req *req)
@@ -201,34 +291,157 @@ fb_end_command_with_info(struct usbd *context, char *fmt, ...)
 	fb_mem *fb = context->ctx;
 
 	va_start(list, fmt);
-	fb->ep1_in_req.buffer = fb->ep1_in_req.small_buffer;
+	fb->ep1_in_req->buffer = fb->ep1_in_req->small_buffer;
 
-	memcpy(fb->ep1_in_req.buffer, "INFO", 4);
-	fb->ep1_in_req.buffer_length =
-		vscnprintf(fb->ep1_in_req.buffer + 4,
-			   sizeof(fb->ep1_in_req.small_buffer) - 4,
+	memcpy(fb->ep1_in_req->buffer, "INFO", 4);
+	fb->ep1_in_req->buffer_length =
+		vscnprintf(fb->ep1_in_req->buffer + 4,
+			   sizeof(fb->ep1_in_req->small_buffer) - 4,
 			   fmt, list) + 4;
 
-	fb->ep1_in_req.complete = fb_end_command_with_info_complete;
-	usbd_req_submit(context, &(fb->ep1_in_req));
+	fb->ep1_in_req->complete = fb_end_command_with_info_complete;
+	usbd_req_submit(context, fb->ep1_in_req);
 
 	va_end(list);
 }
 
+static void
+fb_info_begin(fb_mem *fb)
+{
+	fb->info.next = NULL;
+	fb->info.end = NULL;
+	fb->info.status = FB_OK;
+}
+
+static void
+fb_info_add(fb_mem *fb, char *fmt, ...)
+{
+	char *line;
+	va_list list;
+	size_t len;
+	char buf[sizeof(fb->ep1_in_req->small_buffer) - 4];
+
+	va_start(list, fmt);
+	len = vscnprintf(buf, sizeof(buf), fmt, list);
+	va_end(list);
+
+	/*
+	 * Byte-aligned, so lines stay back to back.
+	 */
+	line = arena_alloc(&fb->scratch, len + 1, 1);
+	if (line == NULL) {
+		return;
+	}
+
+	memcpy(line, buf, len + 1);
+	if (fb->info.next == NULL) {
+		fb->info.next = line;
+	}
+	fb->info.end = line + len + 1;
+}
+
+/*
+ * Kept short of the 60 characters an INFO line can have.
+ */
+#define FB_INFO_CHARS 56
+
+/*
+ * Split over as many lines as it takes.
+ */
+static void
+fb_info_add_string(fb_mem *fb,
+		   const char *s)
+{
+	size_t i;
+	size_t len = strlen(s);
+
+	for (i = 0; i < len; i += FB_INFO_CHARS) {
+		fb_info_add(fb, "%.*s", (int) min(len - i,
+						  (size_t) FB_INFO_CHARS),
+			    s + i);
+	}
+}
+
+static void
+fb_info_send(usbd *context,
+	     usbd_req *req)
+{
+	size_t len;
+	fb_mem *fb = context->ctx;
+	fb_info_state *info = &fb->info;
+
+	if (req != NULL && req->error) {
+		return;
+	}
+
+	if (info->next == info->end) {
+		fb_end_command(context, info->status);
+		return;
+	}
+
+	len = strlen(info->next);
+	fb->ep1_in_req->buffer = fb->ep1_in_req->small_buffer;
+	memcpy(fb->ep1_in_req->buffer, "INFO", 4);
+	memcpy(fb->ep1_in_req->buffer + 4, info->next, len);
+	fb->ep1_in_req->buffer_length = len + 4;
+	info->next += len + 1;
+
+	fb->ep1_in_req->complete = fb_info_send;
+	usbd_req_submit(context, fb->ep1_in_req);
+}
+
 static void
 fb_request_data(struct usbd *context)
 {
 	fb_mem *fb = context->ctx;
 
-	fb->ep1_in_req.buffer = fb->ep1_in_req.small_buffer;
+	fb->ep1_in_req->buffer = fb->ep1_in_req->small_buffer;
 
-	fb->ep1_in_req.buffer_length =
-		scnprintf(fb->ep1_in_req.buffer,
-			  sizeof(fb->ep1_in_req.small_buffer),
+	fb->ep1_in_req->buffer_length =
+		scnprintf(fb->ep1_in_req->buffer,
+			  sizeof(fb->ep1_in_req->small_buffer),
 			  "DATA%08x", fb->load_size);
 
-	fb->ep1_in_req.complete = NULL;
-	usbd_req_submit(context, &(fb->ep1_in_req));
+	fb->ep1_in_req->complete = NULL;
+	usbd_req_submit(context, fb->ep1_in_req);
+}
+
+static void
+fb_free_download(fb_mem *fb,
+		 uint8_t *buffer)
+{
+	lmb_free_addr(&lmb, (phys_addr_t) buffer);
+}
+
+static void
+fb_unstage(fb_mem *fb)
+{
+	if (fb->staged != NULL) {
+		lmb_free_addr(&lmb, (phys_addr_t) fb->staged);
+		fb->staged = NULL;
+		fb->staged_size = 0;
+	}
+}
+
+/*
+ * Returns a buffer the caller fills with data for the
+ * next "upload" command. The buffer must be below 4GB
+ * as it is DMA'd from by USB.
+ */
+static void *
+fb_stage(fb_mem *fb,
+	 size_t size)
+{
+	fb_unstage(fb);
+
+	fb->staged = VP(lmb_alloc_base(&lmb, size, UPLOAD_ALIGNMENT,
+				       LMB_ALLOC_32BIT, LMB_BOOT,
+				       LMB_TAG("UPLD")));
+	if (fb->staged != NULL) {
+		fb->staged_size = size;
+	}
+
+	return fb->staged;
 }
 
 static void
@@ -289,9 +502,9 @@ fb_oem_cmd_peek_exe(usbd *context,
 
 	*b++ = '\0';
 	BUG_ON (b - peek->buffer > peek->buffer_len);
-	fb->ep1_in_req.buffer_length = b - peek->buffer;
-	fb->ep1_in_req.complete = fb_oem_cmd_peek_exe;
-	usbd_req_submit(context, &(fb->ep1_in_req));
+	fb->ep1_in_req->buffer_length = b - peek->buffer;
+	fb->ep1_in_req->complete = fb_oem_cmd_peek_exe;
+	usbd_req_submit(context, fb->ep1_in_req);
 }
 
 static fb_status
@@ -333,9 +546,9 @@ fb_oem_cmd_peek(usbd *context,
 		return FB_BAD_COMMAND;
 	}
 
-	C_ASSERT(sizeof(fb->ep1_in_req.small_buffer) >= 64);
-	peek->buffer = (char *) fb->ep1_in_req.small_buffer;
-	peek->buffer_len = sizeof(fb->ep1_in_req.small_buffer);
+	C_ASSERT(sizeof(fb->ep1_in_req->small_buffer) >= 64);
+	peek->buffer = (char *) fb->ep1_in_req->small_buffer;
+	peek->buffer_len = sizeof(fb->ep1_in_req->small_buffer);
 	fb_oem_cmd_peek_exe(context, NULL);
 	return FB_OK;
 }
@@ -437,8 +650,8 @@ fb_oem_cmd_alloc_ex(usbd *context,
 			type = LMB_BOOT;
 		} else if (!memcmp(cmd, "runtime", sizeof("runtime"))) {
 			/*
-			 * Today, there is no difference between boot and
-			 * runtime allocations. Tomorrow? We'll see.
+			 * Runtime allocations are handed to the payload
+			 * as reserved memory.
 			 */
 			type = LMB_RUNTIME;
 		} else {
@@ -479,6 +692,19 @@ fb_oem_cmd_free(usbd *context,
 	size_t align;
 
 	addr = simple_strtoull(cmd, &cmd, 0);
+	if (*cmd == '\0') {
+		if (lmb_free_addr(&lmb, addr) != 0) {
+			return FB_NOT_ALLOCATED;
+		}
+
+		fb_end_command(context, FB_OK);
+		return FB_OK;
+	}
+
+	/*
+	 * Older form, for freeing memory that wasn't
+	 * allocated by lmb_alloc (or just a part of it).
+	 */
 	if (*cmd != ' ') {
 		return FB_BAD_COMMAND;
 	}
@@ -501,6 +727,153 @@ fb_oem_cmd_free(usbd *context,
 	return FB_OK;
 }
 
+static fb_status
+fb_oem_cmd_blockhashes(usbd *context,
+		       char *cmd)
+{
+	size_t block_size;
+	delta_hashes *hashes;
+	fb_mem *fb = context->ctx;
+
+	block_size = DELTA_BLOCK_SIZE;
+	if (*cmd != '\0') {
+		block_size = simple_strtoull(cmd, &cmd, 0);
+		/*
+		 * The block size goes back to the host as a u32.
+		 */
+		if (*cmd != '\0' || block_size == 0 ||
+		    block_size > UINT_MAX) {
+			return FB_BAD_COMMAND;
+		}
+	}
+
+	if (fb->last_loaded == NULL) {
+		return FB_NOT_DOWNLOADED;
+	}
+
+	hashes = fb_stage(fb, delta_hashes_size(fb->load_size,
+						block_size));
+	if (hashes == NULL) {
+		return FB_OOM;
+	}
+
+	delta_hash(fb->last_loaded, fb->load_size, block_size, hashes);
+
+	/*
+	 * The current download becomes the base for the next
+	 * "oem patch", and survives the next "download".
+	 */
+	if (fb->patch_base != NULL &&
+	    fb->patch_base != fb->last_loaded) {
+		fb_free_download(fb, fb->patch_base);
+	}
+	fb->patch_base = fb->last_loaded;
+	fb->patch_base_size = fb->load_size;
+
+	fb_end_command_with_info(context, "%u blocks, 0x%lx bytes staged",
+				 hashes->count, fb->staged_size);
+	return FB_OK;
+}
+
+static fb_status
+fb_oem_cmd_patch(usbd *context,
+		 char *cmd)
+{
+	uint8_t *out;
+	size_t new_size;
+	fb_mem *fb = context->ctx;
+
+	if (*cmd != '\0') {
+		return FB_BAD_COMMAND;
+	}
+
+	if (fb->patch_base == NULL) {
+		return FB_NO_BASE;
+	}
+
+	if (fb->last_loaded == NULL ||
+	    fb->last_loaded == fb->patch_base) {
+		return FB_NOT_DOWNLOADED;
+	}
+
+	if (delta_check(fb->last_loaded, fb->load_size, &new_size) != 0) {
+		return FB_BAD_PATCH;
+	}
+
+	out = VP(lmb_alloc_base(&lmb, new_size, DOWNLOAD_ALIGNMENT,
+				LMB_ALLOC_32BIT, LMB_BOOT,
+				LMB_TAG("DLOD")));
+	if (out == NULL) {
+		return FB_OOM;
+	}
+
+	if (delta_apply(fb->patch_base, fb->patch_base_size,
+			fb->last_loaded, fb->load_size,
+			out, new_size) != 0) {
+		fb_free_download(fb, out);
+		return FB_BAD_PATCH;
+	}
+
+	/*
+	 * The patched image replaces both the delta and the
+	 * base, and becomes what "flash:run" will boot.
+	 */
+	fb_free_download(fb, fb->last_loaded);
+	fb_free_download(fb, fb->patch_base);
+	fb->patch_base = NULL;
+	fb->patch_base_size = 0;
+	fb->last_loaded = out;
+	fb->load_size = new_size;
+	fb->load_cached = false;
+
+	fb_end_command_with_info(context, "Patched at %p-%p",
+				 out, out + new_size - 1);
+	return FB_OK;
+}
+
+static fb_status
+fb_oem_cmd_cached(usbd *context,
+		  char *cmd)
+{
+	uint8_t *image;
+	const image_cache_hdr *hdr;
+	fb_mem *fb = context->ctx;
+
+	if (*cmd != '\0') {
+		return FB_BAD_COMMAND;
+	}
+
+	hdr = image_cache_get();
+	if (hdr == NULL) {
+		return FB_NOT_CACHED;
+	}
+
+	/*
+	 * The cached copy must stay pristine for the next
+	 * reboot, so we boot a copy of it, just like a download.
+	 */
+	image = VP(lmb_alloc_base(&lmb, hdr->length, DOWNLOAD_ALIGNMENT,
+				  LMB_ALLOC_32BIT, LMB_BOOT,
+				  LMB_TAG("DLOD")));
+	if (image == NULL) {
+		return FB_OOM;
+	}
+
+	if (fb->last_loaded != NULL &&
+	    fb->last_loaded != fb->patch_base) {
+		fb_free_download(fb, fb->last_loaded);
+	}
+
+	memcpy(image, image_cache_data(), hdr->length);
+	fb->last_loaded = image;
+	fb->load_size = hdr->length;
+	fb->load_cached = true;
+
+	fb_end_command_with_info(context, "Loaded at %p-%p",
+				 image, image + hdr->length - 1);
+	return FB_OK;
+}
+
 static fb_status
 fb_oem_cmd_smccc(usbd *context,
 		 char *cmd)
@@ -538,7 +911,8 @@ fb_cmd_reboot_complete(usbd *context,
 		       usbd_req *req)
 {
 	fb_mem *fb = context->ctx;
-	usbd_fini(context);
+	fb_fini(context);
+	printk_sync();
 	tegra_reboot(fb->reboot.type);
 }
 
@@ -579,6 +953,510 @@ fb_oem_cmd_reboot(usbd *context,
 	return fb_cmd_reboot(context, s);
 }
 
+typedef struct fb_tag_bytes {
+	lmb_tag_t tag;
+	size_t bytes;
+} fb_tag_bytes;
+
+static fb_status
+fb_oem_cmd_lmbstat(usbd *context,
+		   char *cmd)
+{
+	unsigned long i;
+	unsigned long j;
+	unsigned long nr_tags = 0;
+	struct lmb_property *p;
+	fb_tag_bytes *tags;
+	size_t by_type[LMB_MMIO + 1] = { 0 };
+	fb_mem *fb = context->ctx;
+	struct lmb_stats *stats = &lmb.stats;
+
+	if (*cmd != '\0') {
+		return FB_BAD_COMMAND;
+	}
+
+	tags = fb_scratch(fb, lmb.reserved.cnt * sizeof(fb_tag_bytes));
+	if (tags == NULL) {
+		return FB_OOM;
+	}
+
+	for (p = lmb_region_first(&lmb.reserved); p != NULL;
+	     p = lmb_region_next(&lmb.reserved, p)) {
+		if (p->type <= LMB_MMIO) {
+			by_type[p->type] += p->size;
+		}
+
+		for (j = 0; j < nr_tags; j++) {
+			if (tags[j].tag == p->tag) {
+				break;
+			}
+		}
+
+		if (j == nr_tags) {
+			tags[j].tag = p->tag;
+			tags[j].bytes = 0;
+			nr_tags++;
+		}
+		tags[j].bytes += p->size;
+	}
+
+	fb_info_begin(fb);
+	fb_info_add(fb, "allocs %lu frees %lu failed %lu",
+		    stats->allocs, stats->frees, stats->failed);
+	fb_info_add(fb, "tracked %lu max %lu",
+		    lmb.allocs.cnt, stats->allocs_max);
+	fb_info_add(fb, "regions %lu/%lu max %lu",
+		    lmb.reserved.cnt, lmb.reserved.max,
+		    stats->regions_max);
+	fb_info_add(fb, "ram 0x%lx used max 0x%lx",
+		    stats->ram, stats->used_max);
+	fb_info_add(fb, "free 0x%lx in %lu extents, %lu%% frag",
+		    lmb_extents_total(&lmb.free),
+		    lmb_extents_count(&lmb.free),
+		    lmb_fragmentation(&lmb));
+	fb_info_add(fb, "largest free <4G 0x%lx >=4G 0x%lx",
+		    lmb_extents_largest_in(&lmb.free, 0, BIT(32)),
+		    lmb_extents_largest_in(&lmb.free, BIT(32), ~0UL));
+	for (i = LMB_BOOT; i <= LMB_MMIO; i++) {
+		fb_info_add(fb, "%s 0x%lx", lmb_type_name(i), by_type[i]);
+	}
+	for (j = 0; j < nr_tags; j++) {
+		fb_info_add(fb, "tag %.4s 0x%lx",
+			    (char *) &tags[j].tag, tags[j].bytes);
+	}
+
+	fb_info_send(context, NULL);
+	return FB_OK;
+}
+
+/*
+ * A few entries more than the current map, as staging
+ * the buffer adds reservations of its own.
+ */
+#define MEMMAP_SLACK (4 * sizeof(lmb_map_entry))
+
+static fb_status
+fb_oem_cmd_memmap(usbd *context,
+		  char *cmd)
+{
+	void *map;
+	size_t size;
+	fb_mem *fb = context->ctx;
+
+	if (*cmd != '\0') {
+		return FB_BAD_COMMAND;
+	}
+
+	map = fb_stage(fb, lmb_map_size(&lmb) + MEMMAP_SLACK);
+	if (map == NULL) {
+		return FB_OOM;
+	}
+
+	size = lmb_map(&lmb, map, fb->staged_size);
+	if (size == 0) {
+		fb_unstage(fb);
+		return FB_OOM;
+	}
+
+	fb->staged_size = size;
+	fb_end_command_with_info(context, "0x%lx bytes staged", size);
+	return FB_OK;
+}
+
+/*
+ * The FDT main was passed can't grow, so edits are made to
+ * a copy, which then replaces it (or the previous copy).
+ */
+static void
+fb_fdt_install(fb_mem *fb,
+	       void *copy)
+{
+	if (fb->fdt_copied) {
+		lmb_free_addr(&lmb, (phys_addr_t) fb->fdt);
+	}
+
+	fb->fdt = copy;
+	fb->fdt_copied = true;
+}
+
+/*
+ * Room for what an overlay adds beyond its own size: the longer
+ * __symbols__ paths and strings the base tree didn't have.
+ */
+#define FDT_OVERLAY_SLACK 0x1000
+
+static fb_status
+fb_oem_cmd_fdt_overlay(usbd *context,
+		       char *cmd)
+{
+	int err;
+	size_t size;
+	void *copy;
+	fdt_index idx;
+	fb_mem *fb = context->ctx;
+
+	if (*cmd != '\0') {
+		return FB_BAD_COMMAND;
+	}
+
+	if (fb->last_loaded == NULL) {
+		return FB_NOT_DOWNLOADED;
+	}
+
+	if (fdt_check_header(fb->last_loaded) != 0 ||
+	    fdt_totalsize(fb->last_loaded) > fb->load_size) {
+		return FB_BAD_OVERLAY;
+	}
+
+	/*
+	 * Merged into a copy, so a bad overlay leaves the FDT
+	 * "flash:run" passes on as it was.
+	 */
+	size = fdt_totalsize(fb->fdt) + fdt_totalsize(fb->last_loaded) +
+		FDT_OVERLAY_SLACK;
+	copy = VP(lmb_alloc_base(&lmb, size, PAGE_SIZE, LMB_ALLOC_ANYWHERE,
+				 LMB_BOOT, LMB_TAG("FDTO")));
+	if (copy == NULL) {
+		return FB_OOM;
+	}
+
+	err = fdt_open_into(fb->fdt, copy, size);
+	if (err == 0) {
+		/*
+		 * If the scratch arena is short, idx is left
+		 * invalid and the lookups just use libfdt.
+		 */
+		fdt_index_build(&idx, copy, &fb->scratch);
+		err = fdt_overlay_apply(copy, &idx, fb->last_loaded);
+	}
+
+	/*
+	 * The overlay had its phandles fixed up either way,
+	 * so it's no good for another go.
+	 */
+	if (fb->last_loaded != fb->patch_base) {
+		fb_free_download(fb, fb->last_loaded);
+	}
+	fb->last_loaded = NULL;
+	fb->load_size = 0;
+
+	fb_info_begin(fb);
+	if (err != 0) {
+		lmb_free_addr(&lmb, (phys_addr_t) copy);
+		fb_info_add(fb, "%s", fdt_strerror(err));
+		fb->info.status = FB_BAD_OVERLAY;
+	} else {
+		fb_fdt_install(fb, copy);
+		fb_info_add(fb, "FDT at %p, 0x%x of 0x%lx bytes used", copy,
+			    fdt_off_dt_strings(copy) +
+			    fdt_size_dt_strings(copy), size);
+	}
+
+	fb_info_send(context, NULL);
+	return FB_OK;
+}
+
+static fb_status
+fb_oem_cmd_fdt_dump(usbd *context,
+		    char *cmd)
+{
+	void *copy;
+	size_t size;
+	bool_t packed = false;
+	fb_mem *fb = context->ctx;
+
+	if (!strcmp(cmd, "packed")) {
+		packed = true;
+	} else if (*cmd != '\0') {
+		return FB_BAD_COMMAND;
+	}
+
+	size = fdt_totalsize(fb->fdt);
+	copy = fb_stage(fb, size);
+	if (copy == NULL) {
+		return FB_OOM;
+	}
+
+	if (!packed) {
+		memcpy(copy, fb->fdt, size);
+	} else if (fdt_open_into(fb->fdt, copy, size) != 0 ||
+		   fdt_pack(copy) != 0) {
+		fb_unstage(fb);
+		return FB_BAD_FDT;
+	} else {
+		fb->staged_size = fdt_totalsize(copy);
+	}
+
+	fb_end_command_with_info(context, "0x%lx bytes staged",
+				 fb->staged_size);
+	return FB_OK;
+}
+
+/*
+ * One or more non-empty, printable, NUL-terminated
+ * strings, as dtc would decide.
+ */
+static bool_t
+fb_fdt_is_strings(const char *val,
+		  int len)
+{
+	int i;
+
+	if (len == 0 || val[0] == '\0' || val[len - 1] != '\0') {
+		return false;
+	}
+
+	for (i = 0; i < len - 1; i++) {
+		if (val[i] == '\0' ? val[i + 1] == '\0' : !isprint(val[i])) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+#define FDT_GET_CELLS 6
+#define FDT_GET_BYTES 16
+
+static void
+fb_fdt_info_value(fb_mem *fb,
+		  const void *val,
+		  int len)
+{
+	int i;
+	int n;
+	int line_len = 0;
+	const char *s;
+	int cells = len / sizeof(uint32_t);
+	char line[sizeof(fb->ep1_in_req->small_buffer) - 4];
+
+	if (len == 0) {
+		fb_info_add(fb, "(empty)");
+	} else if (fb_fdt_is_strings(val, len)) {
+		for (s = val; s < (const char *) val + len; s += n + 1) {
+			n = strlen(s);
+			fb_info_add_string(fb, s);
+		}
+	} else if (len % sizeof(uint32_t) == 0) {
+		for (i = 0; i < cells; i++) {
+			line_len += scnprintf(line + line_len,
+					      sizeof(line) - line_len, "%08x ",
+					      fdt32_to_cpu(((const uint32_t *)
+							    val)[i]));
+			if (i % FDT_GET_CELLS == FDT_GET_CELLS - 1 ||
+			    i == cells - 1) {
+				fb_info_add(fb, "%s", line);
+				line_len = 0;
+			}
+		}
+	} else {
+		for (i = 0; i < len; i++) {
+			line_len += scnprintf(line + line_len,
+					      sizeof(line) - line_len, "%02x ",
+					      ((const uint8_t *) val)[i]);
+			if (i % FDT_GET_BYTES == FDT_GET_BYTES - 1 ||
+			    i == len - 1) {
+				fb_info_add(fb, "%s", line);
+				line_len = 0;
+			}
+		}
+	}
+}
+
+/*
+ * Without a property name, lists the node's
+ * properties and then its subnodes.
+ */
+static fb_status
+fb_oem_cmd_fdt_get(usbd *context,
+		   char *cmd)
+{
+	int len;
+	int node;
+	int offset;
+	char *prop;
+	const char *name;
+	const void *val;
+	fb_mem *fb = context->ctx;
+
+	prop = strchr(cmd, ' ');
+	if (prop != NULL) {
+		*prop++ = '\0';
+	}
+
+	if (*cmd == '\0' || (prop != NULL && *prop == '\0')) {
+		return FB_BAD_COMMAND;
+	}
+
+	node = fdt_index_path_offset(&boot_fdt_index, fb->fdt, cmd);
+	if (node < 0) {
+		return FB_NOT_FOUND;
+	}
+
+	fb_info_begin(fb);
+	if (prop != NULL) {
+		val = fdt_getprop(fb->fdt, node, prop, &len);
+		if (val == NULL) {
+			fb->info.status = FB_NOT_FOUND;
+		} else {
+			fb_fdt_info_value(fb, val, len);
+		}
+	} else {
+		for (offset = fdt_first_property_offset(fb->fdt, node);
+		     offset >= 0;
+		     offset = fdt_next_property_offset(fb->fdt, offset)) {
+			fdt_getprop_by_offset(fb->fdt, offset, &name, &len);
+			fb_info_add(fb, "%s (%d bytes)", name, len);
+		}
+
+		for (offset = fdt_first_subnode(fb->fdt, node);
+		     offset >= 0;
+		     offset = fdt_next_subnode(fb->fdt, offset)) {
+			fb_info_add(fb, "%s/", fdt_get_name(fb->fdt,
+							    offset, NULL));
+		}
+	}
+
+	fb_info_send(context, NULL);
+	return FB_OK;
+}
+
+/*
+ * Room for a /chosen node and the bootargs property
+ * header and name, if the FDT has neither.
+ */
+#define FDT_CMDLINE_SLACK 0x100
+
+static int
+fb_fdt_set_bootargs(fb_mem *fb,
+		    const char *args)
+{
+	int err;
+	int chosen;
+	size_t size;
+	void *copy;
+
+	size = fdt_totalsize(fb->fdt) + strlen(args) + 1 + FDT_CMDLINE_SLACK;
+	copy = VP(lmb_alloc_base(&lmb, size, PAGE_SIZE, LMB_ALLOC_ANYWHERE,
+				 LMB_BOOT, LMB_TAG("FDTO")));
+	if (copy == NULL) {
+		return -FDT_ERR_NOSPACE;
+	}
+
+	err = fdt_open_into(fb->fdt, copy, size);
+	if (err == 0) {
+		chosen = fdt_path_offset(copy, "/chosen");
+		if (chosen == -FDT_ERR_NOTFOUND) {
+			chosen = fdt_add_subnode(copy, 0, "chosen");
+		}
+
+		err = chosen < 0 ? chosen :
+			fdt_setprop_string(copy, chosen, "bootargs", args);
+	}
+
+	if (err != 0) {
+		lmb_free_addr(&lmb, (phys_addr_t) copy);
+		return err;
+	}
+
+	fb_fdt_install(fb, copy);
+	return 0;
+}
+
+/*
+ * Edits the FDT's /chosen/bootargs, which is what
+ * "flash:run" starts the payload's command line from.
+ */
+static fb_status
+fb_oem_cmd_cmdline(usbd *context,
+		   char *cmd)
+{
+	int len;
+	int err;
+	int node;
+	char *val;
+	char *args;
+	cmdline *c;
+	cmdline_param *p;
+	unsigned long i;
+	const char *bootargs = NULL;
+	fb_mem *fb = context->ctx;
+
+	c = fb_scratch(fb, sizeof(*c));
+	args = fb_scratch(fb, CMDLINE_SIZE);
+	if (c == NULL || args == NULL) {
+		return FB_OOM;
+	}
+
+	cmdline_init(c);
+	node = fdt_index_path_offset(&boot_fdt_index, fb->fdt, "/chosen");
+	if (node >= 0) {
+		bootargs = fdt_getprop(fb->fdt, node, "bootargs", &len);
+	}
+
+	if (bootargs != NULL && len > 0 && bootargs[len - 1] == '\0' &&
+	    cmdline_append(c, bootargs) != 0) {
+		return FB_OOM;
+	}
+
+	if (*cmd == '\0') {
+		fb_info_begin(fb);
+		for (i = 0; i < c->nr_params; i++) {
+			p = &c->params[i];
+			if (p->val == NULL) {
+				fb_info_add_string(fb, p->key);
+			} else if (strlen(p->key) + 1 + strlen(p->val) <=
+				   FB_INFO_CHARS) {
+				fb_info_add(fb, "%s=%s", p->key, p->val);
+			} else {
+				fb_info_add(fb, "%s=", p->key);
+				fb_info_add_string(fb, p->val);
+			}
+		}
+
+		fb_info_send(context, NULL);
+		return FB_OK;
+	}
+
+	if (!memcmp(cmd, "set ", sizeof("set ") - 1)) {
+		cmd += sizeof("set ") - 1;
+		val = strchr(cmd, '=');
+		if (val != NULL) {
+			*val++ = '\0';
+		}
+
+		if (*cmd == '\0') {
+			return FB_BAD_COMMAND;
+		}
+
+		if (cmdline_set(c, cmd, val) != 0) {
+			return FB_OOM;
+		}
+	} else if (!memcmp(cmd, "del ", sizeof("del ") - 1)) {
+		if (cmdline_delete(c, cmd + sizeof("del ") - 1) != 0) {
+			return FB_NOT_FOUND;
+		}
+	} else {
+		return FB_BAD_COMMAND;
+	}
+
+	if (cmdline_write(c, args, CMDLINE_SIZE) < 0) {
+		return FB_OOM;
+	}
+
+	err = fb_fdt_set_bootargs(fb, args);
+	if (err != 0) {
+		fb_info_begin(fb);
+		fb_info_add(fb, "%s", fdt_strerror(err));
+		fb->info.status = FB_BAD_FDT;
+		fb_info_send(context, NULL);
+	} else {
+		fb_end_command(context, FB_OK);
+	}
+
+	return FB_OK;
+}
+
 static fb_status
 fb_cmd_oem(usbd *context,
 	   char *cmd)
@@ -594,15 +1472,31 @@ fb_cmd_oem(usbd *context,
 	CMD(free)					\
 	CMD(smccc)					\
 	CMD(reboot)					\
-
-#define CMD(x) else if (!memcmp(cmd, S(x)" ", sizeof(S(x)" ") - 1)) {	\
-		status = fb_oem_cmd_##x(context, cmd + sizeof(S(x)" ") - 1); \
+	CMD(blockhashes)				\
+	CMD(patch)					\
+	CMD(cached)					\
+	CMD(lmbstat)					\
+	CMD(memmap)					\
+	CMD_AS("fdt-overlay", fdt_overlay)		\
+	CMD_AS("fdt-dump", fdt_dump)			\
+	CMD_AS("fdt-get", fdt_get)			\
+	CMD(cmdline)					\
+
+#define CMD_LEN(s) (sizeof(s) - 1)
+#define CMD_AS(s, x) else if (!memcmp(cmd, s, CMD_LEN(s)) &&		\
+			      (cmd[CMD_LEN(s)] == ' ' ||		\
+			       cmd[CMD_LEN(s)] == '\0')) {		\
+		status = fb_oem_cmd_##x(context, cmd + CMD_LEN(s) +	\
+					(cmd[CMD_LEN(s)] == ' '));	\
 	}
+#define CMD(x) CMD_AS(S(x), x)
 
 	if (0) {
 	} CMD_LIST;
 
 #undef CMD
+#undef CMD_AS
+#undef CMD_LEN
 #undef CMD_LIST
 
 	return status;
@@ -613,27 +1507,15 @@ fb_cmd_flash_complete(usbd *context,
 		       usbd_req *req)
 {
 	fb_mem *fb = context->ctx;
-	void (*binary)(void *fdt);
 
-	binary = VP(fb->last_loaded);
-	if (!memcmp(fb->last_loaded, BOOT_MAGIC, BOOT_MAGIC_SIZE)) {
-		/*
-		 * An Android boot image-formatted binary blob. We
-		 * completely ignore the header today. Eventually, we may
-		 * support initrd and etc.
-		 */
-		boot_img *img = VP(fb->last_loaded);
-		/*
-		 * Only those binaries that can deal with the img->page_size
-		 * alignment will run. shieldTV_loader itself is okay as
-		 * it is expecting a PAGE_SIZE alignment (and img->page_size
-		 * is thus set to PAGE_SIZE, too).
-		 */
-		binary = VP(img->page_size + fb->last_loaded);
+	if (!fb->load_cached) {
+		image_cache_store(fb->last_loaded, fb->load_size,
+				  (phys_addr_t) fb->last_loaded);
 	}
 
-	usbd_fini(context);
-	binary(fb->fdt);
+	fb_fini(context);
+	printk_sync();
+	payload_enter(&fb->payload);
 }
 
 static fb_status
@@ -650,6 +1532,15 @@ fb_cmd_flash(usbd *context,
 		return FB_NOT_DOWNLOADED;
 	}
 
+	/*
+	 * Done before replying, so a bad image can still
+	 * be reported to the host.
+	 */
+	if (payload_prepare(&fb->payload, fb->last_loaded,
+			    fb->load_size, fb->fdt) != 0) {
+		return FB_BAD_IMAGE;
+	}
+
 	fb_end_command_with_custom_complete(context, FB_OK,
 		fb_cmd_flash_complete);
 	return FB_OK;
@@ -663,13 +1554,11 @@ fb_cmd_download(usbd *context,
 	fb_mem *fb = context->ctx;
 
 	if (fb->last_loaded != NULL) {
-		lmb_free(&lmb,
-			 (phys_addr_t) fb->last_loaded,
-			 fb->load_size,
-			 fb->load_align);
+		if (fb->last_loaded != fb->patch_base) {
+			fb_free_download(fb, fb->last_loaded);
+		}
 		fb->last_loaded = NULL;
 		fb->load_size = 0;
-		fb->load_align = 0;
 	}
 
 	size = simple_strtoull(cmd, &cmd, 16);
@@ -688,18 +1577,125 @@ fb_cmd_download(usbd *context,
 
 	fb->load_size = size;
 	fb->load_rem = size;
-	fb->load_align = DOWNLOAD_ALIGNMENT;
+	fb->load_cached = false;
 
 	/*
 	 * Cancel pending rx_cmd, because we'll want to receive data.
 	 */
-	usbd_req_cancel(context, &(fb->ep1_out_req));
+	usbd_req_cancel(context, fb->ep1_out_req);
 	fb_request_data(context);
 	fb_rx_data(context, NULL);
 
 	return FB_OK;
 }
 
+static void
+fb_tx_staged_complete(usbd *context,
+		      usbd_req *req)
+{
+	fb_mem *fb = context->ctx;
+
+	if (req->error) {
+		if (req->cancel) {
+			return;
+		}
+	} else {
+		fb->staged_rem -= req->io_done;
+	}
+
+	if (fb->staged_rem == 0) {
+		fb_end_command(context, FB_OK);
+		return;
+	}
+
+	fb_tx_staged(context, NULL);
+}
+
+static void
+fb_tx_staged(struct usbd *context, usbd_req *unused)
+{
+	fb_mem *fb = context->ctx;
+	uint8_t *p = fb->staged + (fb->staged_size - fb->staged_rem);
+
+	/*
+	 * A TD covers at most 5 pages, fewer when not starting
+	 * on a page boundary.
+	 */
+	fb->ep1_in_req->buffer = p;
+	fb->ep1_in_req->buffer_length = min(fb->staged_rem,
+					   (size_t) 0x5000 -
+					   (UN(p) & (PAGE_SIZE - 1)));
+	fb->ep1_in_req->complete = fb_tx_staged_complete;
+	usbd_req_submit(context, fb->ep1_in_req);
+}
+
+static fb_status
+fb_cmd_getvar(usbd *context,
+	      char *var)
+{
+	unsigned i;
+	char sha[28 * 2 + 1];
+	const image_cache_hdr *hdr = image_cache_get();
+
+	if (!strcmp(var, "version")) {
+		fb_end_command_with_value(context, "0.4");
+	} else if (!strcmp(var, "product")) {
+		fb_end_command_with_value(context, "shieldTV_loader");
+	} else if (!strcmp(var, "cached")) {
+		fb_end_command_with_value(context, hdr != NULL ? "yes" : "no");
+	} else if (!strcmp(var, "cached-size")) {
+		if (hdr == NULL) {
+			return FB_NOT_CACHED;
+		}
+		fb_end_command_with_value(context, "0x%lx", hdr->length);
+	} else if (!strcmp(var, "cached-sha256")) {
+		if (hdr == NULL) {
+			return FB_NOT_CACHED;
+		}
+
+		/*
+		 * Responses are limited to 64 bytes, so this
+		 * gets truncated to the leading 224 bits.
+		 */
+		for (i = 0; i < 28; i++) {
+			pack_hex_byte(sha + i * 2, hdr->sha256[i]);
+		}
+		sha[i * 2] = '\0';
+
+		fb_end_command_with_value(context, "%s", sha);
+	} else {
+		return FB_UNKNOWN_VAR;
+	}
+
+	return FB_OK;
+}
+
+static fb_status
+fb_cmd_upload(usbd *context,
+	      char *cmd)
+{
+	fb_mem *fb = context->ctx;
+
+	if (*cmd != '\0') {
+		return FB_BAD_COMMAND;
+	}
+
+	if (fb->staged == NULL) {
+		return FB_NOT_STAGED;
+	}
+
+	fb->ep1_in_req->buffer = fb->ep1_in_req->small_buffer;
+	fb->ep1_in_req->buffer_length =
+		scnprintf(fb->ep1_in_req->buffer,
+			  sizeof(fb->ep1_in_req->small_buffer),
+			  "DATA%08x", fb->staged_size);
+	fb->staged_rem = fb->staged_size;
+	fb->ep1_in_req->complete = fb_tx_staged;
+	usbd_req_submit(context, fb->ep1_in_req);
+
+	return FB_OK;
+}
+
 static void
 fb_rx_cmd_complete(usbd *context,
 		   usbd_req *req)
@@ -729,14 +1725,15 @@ fb_rx_cmd_complete(usbd *context,
 		 * the completion ack. But this is fine...
 		 */
 		fb->in_command = false;
-		usbd_req_cancel(context, &(fb->ep1_in_req));
+		arena_reset(&fb->scratch);
+		usbd_req_cancel(context, fb->ep1_in_req);
 	}
 	fb->in_command = true;
 
 	/*
 	 * For ease of parsing, consider this to be an ASCIIZ buffer.
 	 */
-	cbuf[sizeof(fb->ep1_out_req.small_buffer) - 1] = '\0';
+	cbuf[sizeof(fb->ep1_out_req->small_buffer) - 1] = '\0';
  
 #define CMD_LIST				\
 	CMD(oem)				\
@@ -759,6 +1756,10 @@ fb_rx_cmd_complete(usbd *context,
 		status = fb_cmd_download(context, cbuf + sizeof("download:") - 1);
 	} else if (!memcmp(cbuf, "flash:", sizeof("flash:") - 1)) {
 		status = fb_cmd_flash(context, cbuf + sizeof("flash:") - 1);
+	} else if (!memcmp(cbuf, "getvar:", sizeof("getvar:") - 1)) {
+		status = fb_cmd_getvar(context, cbuf + sizeof("getvar:") - 1);
+	} else if (!memcmp(cbuf, "upload", sizeof("upload") - 1)) {
+		status = fb_cmd_upload(context, cbuf + sizeof("upload") - 1);
 	}
 
 
@@ -817,11 +1818,11 @@ fb_rx_data(struct usbd *context, usbd_req *unused)
 {
 	fb_mem *fb = context->ctx;
 
-	fb->ep1_out_req.buffer = fb->last_loaded +
+	fb->ep1_out_req->buffer = fb->last_loaded +
 		(fb->load_size - fb->load_rem);
-	fb->ep1_out_req.buffer_length = fb->load_rem;
-	fb->ep1_out_req.complete = fb_rx_data_complete;
-	usbd_req_submit(context, &(fb->ep1_out_req));
+	fb->ep1_out_req->buffer_length = fb->load_rem;
+	fb->ep1_out_req->complete = fb_rx_data_complete;
+	usbd_req_submit(context, fb->ep1_out_req);
 }
 
 static void
@@ -829,11 +1830,11 @@ fb_rx_cmd(struct usbd *context, usbd_req *unused)
 {
 	fb_mem *fb = context->ctx;
 
-	C_ASSERT(sizeof(fb->ep1_out_req.small_buffer) >= 64);
-	fb->ep1_out_req.buffer = fb->ep1_out_req.small_buffer;
-	fb->ep1_out_req.buffer_length = 64;
-	fb->ep1_out_req.complete = fb_rx_cmd_complete;
-	usbd_req_submit(context, &(fb->ep1_out_req));
+	C_ASSERT(sizeof(fb->ep1_out_req->small_buffer) >= 64);
+	fb->ep1_out_req->buffer = fb->ep1_out_req->small_buffer;
+	fb->ep1_out_req->buffer_length = 64;
+	fb->ep1_out_req->complete = fb_rx_cmd_complete;
+	usbd_req_submit(context, fb->ep1_out_req);
 }
 
 static usbd_status
@@ -851,8 +1852,8 @@ fb_set_config(struct usbd *context,
 		fb_mem *fb = context->ctx;
 		usbd_ep_disable(context, &fb_ep1_out, &fb_ep1_in);
 		fb->in_command = false;
-		usbd_req_cancel(context, &(fb->ep1_in_req));
-		usbd_req_cancel(context, &(fb->ep1_out_req));
+		usbd_req_cancel(context, fb->ep1_in_req);
+		usbd_req_cancel(context, fb->ep1_out_req);
 	}
 
 	return USBD_SUCCESS;
@@ -865,6 +1866,15 @@ fb_launch(void *fdt)
 	usbd_status usbd_stat;
 	phys_addr_t usb_dma_memory;
 
+	/*
+	 * Downloads come from the top of the 32-bit window (the
+	 * default), as kernels older than 4.6 are placed as low
+	 * as possible and can't use anything below themselves.
+	 * Small stuff goes into holes.
+	 */
+	lmb_set_tag_policy(&lmb, LMB_TAG("UPLD"), LMB_POLICY_KEEP_HUGE);
+	lmb_set_tag_policy(&lmb, LMB_TAG("FBRQ"), LMB_POLICY_KEEP_HUGE);
+
 	usb_dma_memory = lmb_alloc_base(&lmb, sizeof(fb_mem),
 					USBD_TD_ALIGNMENT,
 					LMB_ALLOC_32BIT, LMB_BOOT,
@@ -882,13 +1892,27 @@ fb_launch(void *fdt)
 	fb->uctx.set_config = fb_set_config;
 	fb->fdt = fdt;
 
-	usbd_req_init(&(fb->ep1_out_req), &fb_ep1_out);
-	usbd_req_init(&(fb->ep1_in_req), &fb_ep1_in);
+	if (arena_init(&fb->scratch, SCRATCH_SIZE, LMB_ALLOC_32BIT,
+		       LMB_TAG("SCRA")) != 0) {
+		printk("No scratch memory for fastboot commands\n");
+	}
+
+	fb->ep1_out_req = usbd_req_alloc(&fb_ep1_out);
+	fb->ep1_in_req = usbd_req_alloc(&fb_ep1_in);
+	BUG_ON (fb->ep1_out_req == NULL || fb->ep1_in_req == NULL);
 
 	usbd_stat = usbd_init(&(fb->uctx), fb->qtds, ELES(fb->qtds));
 	BUG_ON (usbd_stat != USBD_SUCCESS);
 
 	while(1) {
 		usbd_poll(&(fb->uctx));
+
+		/*
+		 * Drawing the console is slow, so it waits
+		 * until the host has nothing for us.
+		 */
+		if (printk_pending() && usbd_idle(&(fb->uctx))) {
+			printk_flush();
+		}
 	}
 }
@@ -55,39 +55,107 @@
 
 #include "libfdt_internal.h"
 
+static int _fdt_check_off(uint32_t hdrsize, uint32_t totalsize, uint32_t off)
+{
+	return (off >= hdrsize) && (off <= totalsize);
+}
+
+static int _fdt_check_block(uint32_t hdrsize, uint32_t totalsize,
+			    uint32_t base, uint32_t size)
+{
+	if (!_fdt_check_off(hdrsize, totalsize, base))
+		return 0; /* block start out of bounds */
+	if ((base + size) < base)
+		return 0; /* overflow */
+	if (!_fdt_check_off(hdrsize, totalsize, base + size))
+		return 0; /* block end out of bounds */
+	return 1;
+}
+
+static uint32_t _fdt_header_size(const void *fdt)
+{
+	uint32_t version = fdt_version(fdt);
+
+	if (version <= 1)
+		return FDT_V1_SIZE;
+	else if (version <= 2)
+		return FDT_V2_SIZE;
+	else if (version <= 16)
+		return FDT_V16_SIZE;
+	else
+		return FDT_V17_SIZE;
+}
+
 int fdt_check_header(const void *fdt)
 {
-	if (fdt_magic(fdt) == FDT_MAGIC) {
-		/* Complete tree */
-		if (fdt_version(fdt) < FDT_FIRST_SUPPORTED_VERSION)
-			return -FDT_ERR_BADVERSION;
-		if (fdt_last_comp_version(fdt) > FDT_LAST_SUPPORTED_VERSION)
-			return -FDT_ERR_BADVERSION;
-	} else if (fdt_magic(fdt) == FDT_SW_MAGIC) {
-		/* Unfinished sequential-write blob */
-		if (fdt_size_dt_struct(fdt) == 0)
-			return -FDT_ERR_BADSTATE;
-	} else {
+	uint32_t hdrsize;
+
+	/*
+	 * Nothing here writes sequential-write (FDT_SW_MAGIC)
+	 * blobs, so they are not accepted either.
+	 */
+	if (fdt_magic(fdt) != FDT_MAGIC)
 		return -FDT_ERR_BADMAGIC;
+	if ((fdt_version(fdt) < FDT_FIRST_SUPPORTED_VERSION)
+	    || (fdt_last_comp_version(fdt) > FDT_LAST_SUPPORTED_VERSION)
+	    || (fdt_version(fdt) < fdt_last_comp_version(fdt)))
+		return -FDT_ERR_BADVERSION;
+
+	hdrsize = _fdt_header_size(fdt);
+	if ((fdt_totalsize(fdt) < hdrsize)
+	    || (fdt_totalsize(fdt) > INT_MAX))
+		return -FDT_ERR_TRUNCATED;
+
+	/* Bounds check memrsv block */
+	if (!_fdt_check_off(hdrsize, fdt_totalsize(fdt),
+			    fdt_off_mem_rsvmap(fdt)))
+		return -FDT_ERR_TRUNCATED;
+
+	/*
+	 * The loader is built with -mstrict-align, so the blocks
+	 * have to be aligned the way the spec says for the
+	 * entries and tags in them to be loaded directly.
+	 */
+	if ((fdt_off_mem_rsvmap(fdt) % sizeof(uint64_t)) != 0
+	    || (fdt_off_dt_struct(fdt) % FDT_TAGSIZE) != 0)
+		return -FDT_ERR_BADSTRUCTURE;
+
+	/* Bounds check structure block */
+	if (fdt_version(fdt) < 17) {
+		if (!_fdt_check_off(hdrsize, fdt_totalsize(fdt),
+				    fdt_off_dt_struct(fdt)))
+			return -FDT_ERR_TRUNCATED;
+	} else {
+		if (!_fdt_check_block(hdrsize, fdt_totalsize(fdt),
+				      fdt_off_dt_struct(fdt),
+				      fdt_size_dt_struct(fdt)))
+			return -FDT_ERR_TRUNCATED;
 	}
 
+	/* Bounds check strings block */
+	if (!_fdt_check_block(hdrsize, fdt_totalsize(fdt),
+			      fdt_off_dt_strings(fdt),
+			      fdt_size_dt_strings(fdt)))
+		return -FDT_ERR_TRUNCATED;
+
 	return 0;
 }
 
 const void *fdt_offset_ptr(const void *fdt, int offset, unsigned int len)
 {
-	const char *p;
+	unsigned int absoffset = offset + fdt_off_dt_struct(fdt);
+
+	if ((absoffset < (unsigned int) offset)
+	    || ((absoffset + len) < absoffset)
+	    || (absoffset + len) > fdt_totalsize(fdt))
+		return NULL;
 
 	if (fdt_version(fdt) >= 0x11)
 		if (((offset + len) < offset)
 		    || ((offset + len) > fdt_size_dt_struct(fdt)))
 			return NULL;
 
-	p = _fdt_offset_ptr(fdt, offset);
-
-	if (p + len < p)
-		return NULL;
-	return p;
+	return _fdt_offset_ptr(fdt, offset);
 }
 
 uint32_t fdt_next_tag(const void *fdt, int startoffset, int *nextoffset)
@@ -120,6 +188,9 @@ uint32_t fdt_next_tag(const void *fdt, int startoffset, int *nextoffset)
 		if (!lenp)
 			return FDT_END; /* premature end */
 		/* skip-name offset, length and value */
+		if (fdt32_to_cpu(*lenp) > INT_MAX - offset -
+		    (sizeof(struct fdt_property) - FDT_TAGSIZE))
+			return FDT_END; /* would overflow offset */
 		offset += sizeof(struct fdt_property) - FDT_TAGSIZE
 			+ fdt32_to_cpu(*lenp);
 		break;
@@ -149,6 +220,15 @@ int _fdt_check_node_offset(const void *fdt, int offset)
 	return offset;
 }
 
+int _fdt_check_prop_offset(const void *fdt, int offset)
+{
+	if ((offset < 0) || (offset % FDT_TAGSIZE)
+	    || (fdt_next_tag(fdt, offset, &offset) != FDT_PROP))
+		return -FDT_ERR_BADOFFSET;
+
+	return offset;
+}
+
 int fdt_next_node(const void *fdt, int offset, int *depth)
 {
 	int nextoffset = 0;
@@ -189,6 +269,34 @@ int fdt_next_node(const void *fdt, int offset, int *depth)
 	return offset;
 }
 
+int fdt_first_subnode(const void *fdt, int offset)
+{
+	int depth = 0;
+
+	offset = fdt_next_node(fdt, offset, &depth);
+	if (offset < 0 || depth != 1)
+		return -FDT_ERR_NOTFOUND;
+
+	return offset;
+}
+
+int fdt_next_subnode(const void *fdt, int offset)
+{
+	int depth = 1;
+
+	/*
+	 * With respect to the parent, the depth of the next subnode will be
+	 * the same as the last.
+	 */
+	do {
+		offset = fdt_next_node(fdt, offset, &depth);
+		if (offset < 0 || depth < 1)
+			return -FDT_ERR_NOTFOUND;
+	} while (depth > 1);
+
+	return offset;
+}
+
 const char *_fdt_find_string(const char *strtab, int tabsize, const char *s)
 {
 	int len = strlen(s) + 1;
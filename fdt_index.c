@@ -0,0 +1,453 @@
+/*
+ * Hashed FDT node lookups.
+ *
+ * Copyright (C) 2018 Andrei Warkentin <andrey.warkentin@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <lib.h>
+#include <libfdt.h>
+#include <fdt_index.h>
+
+/*
+ * Every node takes at least 12 bytes of structure block
+ * (BEGIN_NODE, a name, END_NODE), so this is about one
+ * bucket for every 4 nodes at worst. Chains keep it correct
+ * regardless.
+ */
+#define FDT_INDEX_STRUCT_PER_BUCKET 48
+#define FDT_INDEX_MIN_BUCKETS       64
+
+static uint32_t
+fdt_index_hash(const char *s,
+	       size_t len,
+	       int parent)
+{
+	uint32_t hash = 2166136261u ^ (uint32_t) parent;
+
+	while (len-- != 0) {
+		hash ^= (uint8_t) *s++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static bool_t
+fdt_index_valid(fdt_index *idx,
+		const void *fdt)
+{
+	return idx != NULL && idx->fdt == fdt &&
+		idx->struct_off == fdt_off_dt_struct(fdt) &&
+		idx->struct_size == fdt_size_dt_struct(fdt) &&
+		idx->strings_off == fdt_off_dt_strings(fdt);
+}
+
+static fdt_index_entry *
+fdt_index_lookup(fdt_index *idx,
+		 fdt_index_entry **table,
+		 const char *key,
+		 size_t len,
+		 int parent)
+{
+	fdt_index_entry *e;
+	uint32_t hash = fdt_index_hash(key, len, parent);
+
+	for (e = table[hash & (idx->nr_buckets - 1)];
+	     e != NULL; e = e->next) {
+		if (e->hash == hash && e->parent == parent &&
+		    e->key_len == len && !memcmp(e->key, key, len)) {
+			return e;
+		}
+	}
+
+	return NULL;
+}
+
+static int
+fdt_index_add(fdt_index *idx,
+	      arena *a,
+	      fdt_index_entry **table,
+	      const char *key,
+	      size_t len,
+	      uint32_t hash,
+	      int parent,
+	      int offset)
+{
+	fdt_index_entry **bucket = &table[hash & (idx->nr_buckets - 1)];
+	fdt_index_entry *e = arena_alloc(a, sizeof(*e),
+					 sizeof(void *));
+
+	if (e == NULL) {
+		return -1;
+	}
+
+	e->key = key;
+	e->key_len = len;
+	e->hash = hash;
+	e->parent = parent;
+	e->offset = offset;
+	e->next = *bucket;
+	*bucket = e;
+	return 0;
+}
+
+static int
+fdt_index_add_strings(fdt_index *idx,
+		      arena *a,
+		      fdt_index_entry **table,
+		      const char *list,
+		      int len,
+		      int offset)
+{
+	const char *end = list + len;
+
+	while (list < end) {
+		size_t l = strnlen(list, end - list);
+
+		if (fdt_index_add(idx, a, table, list, l,
+				  fdt_index_hash(list, l, -1), -1,
+				  offset) != 0) {
+			return -1;
+		}
+
+		list += l + 1;
+	}
+
+	return 0;
+}
+
+static int
+fdt_index_add_node(fdt_index *idx,
+		   arena *a,
+		   int offset,
+		   int parent)
+{
+	int len;
+	size_t base_len;
+	const char *at;
+	const char *name = fdt_get_name(idx->fdt, offset, &len);
+
+	if (name == NULL) {
+		return -1;
+	}
+
+	idx->nr_nodes++;
+	if (fdt_index_add(idx, a, idx->names, name, len,
+			  fdt_index_hash(name, len, parent),
+			  parent, offset) != 0) {
+		return -1;
+	}
+
+	at = memchr(name, '@', len);
+	base_len = at == NULL ? len : at - name;
+	if (fdt_index_lookup(idx, idx->bases, name, base_len,
+			     parent) != NULL) {
+		return 0;
+	}
+
+	return fdt_index_add(idx, a, idx->bases, name, base_len,
+			     fdt_index_hash(name, base_len, parent),
+			     parent, offset);
+}
+
+static int
+fdt_index_add_prop(fdt_index *idx,
+		   arena *a,
+		   int prop_offset,
+		   int node,
+		   bool_t *have_phandle)
+{
+	int len;
+	const char *name;
+	const struct fdt_property *prop;
+
+	prop = fdt_offset_ptr(idx->fdt, prop_offset, sizeof(*prop));
+	if (prop == NULL) {
+		return -1;
+	}
+
+	len = fdt32_to_cpu(prop->len);
+	name = fdt_string(idx->fdt, fdt32_to_cpu(prop->nameoff));
+	if (!strcmp(name, "compatible")) {
+		return fdt_index_add_strings(idx, a, idx->compats,
+					     prop->data, len, node);
+	}
+
+	if (!strcmp(name, "device_type")) {
+		return fdt_index_add_strings(idx, a, idx->dtypes,
+					     prop->data, len, node);
+	}
+
+	if ((!strcmp(name, "phandle") ||
+	     !strcmp(name, "linux,phandle")) &&
+	    len == sizeof(uint32_t) && !*have_phandle) {
+		uint32_t phandle = fdt32_to_cpu(*(uint32_t *) prop->data);
+
+		*have_phandle = true;
+		if (phandle != (uint32_t) -1 && phandle > idx->max_phandle) {
+			idx->max_phandle = phandle;
+		}
+
+		return fdt_index_add(idx, a, idx->phandles, NULL, 0,
+				     phandle, -1, node);
+	}
+
+	return 0;
+}
+
+static fdt_index_entry **
+fdt_index_table(arena *a,
+		unsigned long nr_buckets)
+{
+	fdt_index_entry **table;
+
+	table = arena_alloc(a, nr_buckets * sizeof(*table),
+			    sizeof(void *));
+	if (table != NULL) {
+		memset(table, 0, nr_buckets * sizeof(*table));
+	}
+
+	return table;
+}
+
+/*
+ * Walks the structure block once, recording every node by
+ * name, phandle, compatible and device_type. Returns -1 if
+ * the arena ran out or the tree is malformed, in which case
+ * the lookups just use libfdt.
+ */
+int
+fdt_index_build(fdt_index *idx,
+		const void *fdt,
+		arena *a)
+{
+	int next;
+	uint32_t tag;
+	int depth = -1;
+	int offset = 0;
+	bool_t have_phandle = false;
+	int nodes[FDT_INDEX_MAX_DEPTH];
+
+	idx->fdt = NULL;
+	if (fdt_check_header(fdt) != 0) {
+		return -1;
+	}
+
+	idx->nr_nodes = 0;
+	idx->max_phandle = 0;
+	idx->struct_off = fdt_off_dt_struct(fdt);
+	idx->struct_size = fdt_size_dt_struct(fdt);
+	idx->strings_off = fdt_off_dt_strings(fdt);
+	idx->nr_buckets = FDT_INDEX_MIN_BUCKETS;
+	while (idx->nr_buckets * FDT_INDEX_STRUCT_PER_BUCKET <
+	       idx->struct_size) {
+		idx->nr_buckets *= 2;
+	}
+
+	idx->names = fdt_index_table(a, idx->nr_buckets);
+	idx->bases = fdt_index_table(a, idx->nr_buckets);
+	idx->phandles = fdt_index_table(a, idx->nr_buckets);
+	idx->compats = fdt_index_table(a, idx->nr_buckets);
+	idx->dtypes = fdt_index_table(a, idx->nr_buckets);
+	if (idx->names == NULL || idx->bases == NULL ||
+	    idx->phandles == NULL || idx->compats == NULL ||
+	    idx->dtypes == NULL) {
+		return -1;
+	}
+
+	/*
+	 * The helpers go through idx->fdt.
+	 */
+	idx->fdt = fdt;
+	do {
+		tag = fdt_next_tag(fdt, offset, &next);
+		switch (tag) {
+		case FDT_BEGIN_NODE:
+			if (++depth == FDT_INDEX_MAX_DEPTH ||
+			    fdt_index_add_node(idx, a, offset, depth == 0 ?
+					       -1 : nodes[depth - 1]) != 0) {
+				goto err;
+			}
+
+			nodes[depth] = offset;
+			have_phandle = false;
+			break;
+		case FDT_END_NODE:
+			if (depth-- < 0) {
+				goto err;
+			}
+			break;
+		case FDT_PROP:
+			if (depth < 0 ||
+			    fdt_index_add_prop(idx, a, offset, nodes[depth],
+					       &have_phandle) != 0) {
+				goto err;
+			}
+			break;
+		case FDT_END:
+			if (next < 0) {
+				goto err;
+			}
+			break;
+		}
+
+		offset = next;
+	} while (tag != FDT_END);
+
+	return 0;
+err:
+	idx->fdt = NULL;
+	return -1;
+}
+
+/*
+ * Like libfdt, a component without a unit address matches
+ * the first child with that name, with or without one.
+ */
+int
+fdt_index_path_offset(fdt_index *idx,
+		      const void *fdt,
+		      const char *path)
+{
+	const char *q;
+	fdt_index_entry *e;
+	int offset = 0;
+
+	if (!fdt_index_valid(idx, fdt) || *path != '/') {
+		return fdt_path_offset(fdt, path);
+	}
+
+	while (*path != '\0') {
+		while (*path == '/') {
+			path++;
+		}
+
+		if (*path == '\0') {
+			break;
+		}
+
+		q = strchr(path, '/');
+		if (q == NULL) {
+			q = path + strlen(path);
+		}
+
+		e = fdt_index_lookup(idx, memchr(path, '@', q - path) ?
+				     idx->names : idx->bases,
+				     path, q - path, offset);
+		if (e == NULL) {
+			return -FDT_ERR_NOTFOUND;
+		}
+
+		offset = e->offset;
+		path = q;
+	}
+
+	return offset;
+}
+
+int
+fdt_index_node_offset_by_phandle(fdt_index *idx,
+				 const void *fdt,
+				 uint32_t phandle)
+{
+	fdt_index_entry *e;
+
+	if (!fdt_index_valid(idx, fdt)) {
+		return fdt_node_offset_by_phandle(fdt, phandle);
+	}
+
+	if (phandle == 0 || phandle == -1) {
+		return -FDT_ERR_BADPHANDLE;
+	}
+
+	for (e = idx->phandles[phandle & (idx->nr_buckets - 1)];
+	     e != NULL; e = e->next) {
+		if (e->hash == phandle &&
+		    fdt_get_phandle(fdt, e->offset) == phandle) {
+			return e->offset;
+		}
+	}
+
+	return -FDT_ERR_NOTFOUND;
+}
+
+uint32_t
+fdt_index_get_max_phandle(fdt_index *idx,
+			  const void *fdt)
+{
+	if (!fdt_index_valid(idx, fdt)) {
+		return fdt_get_max_phandle(fdt);
+	}
+
+	return idx->max_phandle;
+}
+
+/*
+ * The first node after startoffset listing the string.
+ * Chains are in reverse tree order, so look at all of them.
+ */
+static int
+fdt_index_find_string(fdt_index *idx,
+		      fdt_index_entry **table,
+		      int startoffset,
+		      const char *s)
+{
+	fdt_index_entry *e;
+	size_t len = strlen(s);
+	int found = -FDT_ERR_NOTFOUND;
+	uint32_t hash = fdt_index_hash(s, len, -1);
+
+	for (e = table[hash & (idx->nr_buckets - 1)];
+	     e != NULL; e = e->next) {
+		if (e->hash == hash && e->offset > startoffset &&
+		    (found < 0 || e->offset < found) &&
+		    e->key_len == len && !memcmp(e->key, s, len)) {
+			found = e->offset;
+		}
+	}
+
+	return found;
+}
+
+int
+fdt_index_node_offset_by_compatible(fdt_index *idx,
+				    const void *fdt,
+				    int startoffset,
+				    const char *compatible)
+{
+	if (!fdt_index_valid(idx, fdt)) {
+		return fdt_node_offset_by_compatible(fdt, startoffset,
+						     compatible);
+	}
+
+	return fdt_index_find_string(idx, idx->compats, startoffset,
+				     compatible);
+}
+
+int
+fdt_index_node_offset_by_dtype(fdt_index *idx,
+			       const void *fdt,
+			       int startoffset,
+			       const char *dtype)
+{
+	if (!fdt_index_valid(idx, fdt)) {
+		return fdt_node_offset_by_dtype(fdt, startoffset, dtype);
+	}
+
+	return fdt_index_find_string(idx, idx->dtypes, startoffset,
+				     dtype);
+}
@@ -0,0 +1,103 @@
+/*
+ * Hashed FDT node lookups.
+ *
+ * Copyright (C) 2018 Andrei Warkentin <andrey.warkentin@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef FDT_INDEX_H
+#define FDT_INDEX_H
+
+#include <arena.h>
+
+#define FDT_INDEX_MAX_DEPTH 32
+
+typedef struct fdt_index_entry {
+	/*
+	 * Points into the FDT: a node name (or the part before
+	 * the unit address), a compatible or a device_type string.
+	 * Phandles have no key.
+	 */
+	const char *key;
+	uint32_t key_len;
+	uint32_t hash;
+	/*
+	 * Node names are only unique among siblings.
+	 */
+	int parent;
+	int offset;
+	struct fdt_index_entry *next;
+} fdt_index_entry;
+
+/*
+ * Built in one pass over the structure block, and only good
+ * for as long as the FDT isn't modified. Lookups notice if the
+ * structure or strings block moved or changed size (e.g.
+ * fdt_add_mem_rsv moves both) and fall back to the plain
+ * libfdt walks, but any other edit needs fdt_index_build again.
+ */
+typedef struct fdt_index {
+	const void *fdt;
+	uint32_t struct_off;
+	uint32_t struct_size;
+	uint32_t strings_off;
+	unsigned long nr_nodes;
+	uint32_t max_phandle;
+	unsigned long nr_buckets;
+	/*
+	 * Nodes by parent and name, and the first node
+	 * by parent and name without the unit address, which
+	 * is what a path component without one matches.
+	 */
+	fdt_index_entry **names;
+	fdt_index_entry **bases;
+	fdt_index_entry **phandles;
+	fdt_index_entry **compats;
+	fdt_index_entry **dtypes;
+} fdt_index;
+
+/*
+ * The FDT main was started with.
+ */
+extern fdt_index boot_fdt_index;
+
+int fdt_index_build(fdt_index *idx,
+		    const void *fdt,
+		    arena *a);
+
+/*
+ * Same semantics as the libfdt functions of the same name,
+ * minus the 'index_'. idx may be NULL. Paths are looked up
+ * a component at a time; only aliases need libfdt.
+ */
+int fdt_index_path_offset(fdt_index *idx,
+			  const void *fdt,
+			  const char *path);
+int fdt_index_node_offset_by_phandle(fdt_index *idx,
+				     const void *fdt,
+				     uint32_t phandle);
+uint32_t fdt_index_get_max_phandle(fdt_index *idx,
+				   const void *fdt);
+int fdt_index_node_offset_by_compatible(fdt_index *idx,
+					const void *fdt,
+					int startoffset,
+					const char *compatible);
+int fdt_index_node_offset_by_dtype(fdt_index *idx,
+				   const void *fdt,
+				   int startoffset,
+				   const char *dtype);
+
+#endif /* FDT_INDEX_H */
@@ -0,0 +1,617 @@
+/*
+ * Device tree overlays.
+ *
+ * Copyright (C) 2018 Andrei Warkentin <andrey.warkentin@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <lib.h>
+#include <libfdt.h>
+#include <fdt_overlay.h>
+
+#define FDT_OVERLAY_MAX_FRAGS 64
+#define FDT_OVERLAY_PATH_MAX  256
+
+typedef struct fdt_overlay_frag {
+	/*
+	 * The __overlay__ node in the overlay, and the
+	 * node it gets merged into.
+	 */
+	int node;
+	int target;
+} fdt_overlay_frag;
+
+/*
+ * Fixup offsets needn't be aligned, and -mstrict-align
+ * means no unaligned loads.
+ */
+static uint32_t
+fdt_overlay_ld(const void *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return fdt32_to_cpu(v);
+}
+
+static void
+fdt_overlay_st(void *p,
+	       uint32_t v)
+{
+	v = cpu_to_fdt32(v);
+	memcpy(p, &v, sizeof(v));
+}
+
+static int
+fdt_overlay_adjust_phandle(void *fdto,
+			   int node,
+			   const char *name,
+			   uint32_t delta)
+{
+	int len;
+	uint32_t phandle;
+	uint32_t *p = fdt_getprop_w(fdto, node, name, &len);
+
+	if (p == NULL) {
+		return len == -FDT_ERR_NOTFOUND ? 0 : len;
+	}
+
+	if (len != sizeof(*p)) {
+		return -FDT_ERR_BADPHANDLE;
+	}
+
+	phandle = fdt_overlay_ld(p);
+	if (phandle + delta < phandle ||
+	    phandle + delta == (uint32_t) -1) {
+		return -FDT_ERR_NOPHANDLES;
+	}
+
+	fdt_overlay_st(p, phandle + delta);
+	return 0;
+}
+
+/*
+ * Moves every phandle the overlay defines past the
+ * ones already in the base tree.
+ */
+static int
+fdt_overlay_adjust_phandles(void *fdto,
+			    uint32_t delta)
+{
+	int err;
+	int node;
+
+	for (node = fdt_next_node(fdto, -1, NULL); node >= 0;
+	     node = fdt_next_node(fdto, node, NULL)) {
+		err = fdt_overlay_adjust_phandle(fdto, node, "phandle", delta);
+		if (err != 0) {
+			return err;
+		}
+
+		err = fdt_overlay_adjust_phandle(fdto, node, "linux,phandle",
+						 delta);
+		if (err != 0) {
+			return err;
+		}
+	}
+
+	return node == -FDT_ERR_NOTFOUND ? 0 : node;
+}
+
+/*
+ * __local_fixups__ mirrors the overlay: each property lists
+ * the offsets of phandles inside the property of the same name,
+ * in the node at the same path, that refer to the overlay itself.
+ */
+static int
+fdt_overlay_local_fixups(void *fdto,
+			 int node,
+			 int fixups,
+			 uint32_t delta)
+{
+	int i;
+	int len;
+	int plen;
+	int err;
+	int sub;
+	int prop;
+	int child;
+	uint32_t off;
+	uint8_t *data;
+	const char *name;
+	const uint8_t *offs;
+
+	for (prop = fdt_first_property_offset(fdto, fixups); prop >= 0;
+	     prop = fdt_next_property_offset(fdto, prop)) {
+		offs = fdt_getprop_by_offset(fdto, prop, &name, &len);
+		if (offs == NULL) {
+			return len;
+		}
+
+		if (len % sizeof(uint32_t) != 0) {
+			return -FDT_ERR_BADOVERLAY;
+		}
+
+		data = fdt_getprop_w(fdto, node, name, &plen);
+		if (data == NULL) {
+			return plen == -FDT_ERR_NOTFOUND ?
+				-FDT_ERR_BADOVERLAY : plen;
+		}
+
+		for (i = 0; i < len; i += sizeof(uint32_t)) {
+			off = fdt_overlay_ld(offs + i);
+			if (plen < sizeof(uint32_t) ||
+			    off > plen - sizeof(uint32_t)) {
+				return -FDT_ERR_BADOVERLAY;
+			}
+
+			fdt_overlay_st(data + off,
+				       fdt_overlay_ld(data + off) + delta);
+		}
+	}
+
+	if (prop != -FDT_ERR_NOTFOUND) {
+		return prop;
+	}
+
+	for (sub = fdt_first_subnode(fdto, fixups); sub >= 0;
+	     sub = fdt_next_subnode(fdto, sub)) {
+		name = fdt_get_name(fdto, sub, &len);
+		if (name == NULL) {
+			return len;
+		}
+
+		child = fdt_subnode_offset_namelen(fdto, node, name, len);
+		if (child < 0) {
+			return child == -FDT_ERR_NOTFOUND ?
+				-FDT_ERR_BADOVERLAY : child;
+		}
+
+		err = fdt_overlay_local_fixups(fdto, child, sub, delta);
+		if (err != 0) {
+			return err;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * One "path:property:offset" reference to a label
+ * in the base tree.
+ */
+static int
+fdt_overlay_fixup_one(void *fdto,
+		      const char *fixup,
+		      uint32_t phandle)
+{
+	int len;
+	int node;
+	char *end;
+	uint8_t *data;
+	unsigned long off;
+	const char *prop;
+	const char *sep;
+	char path[FDT_OVERLAY_PATH_MAX];
+
+	prop = strchr(fixup, ':');
+	if (prop == NULL) {
+		return -FDT_ERR_BADOVERLAY;
+	}
+
+	sep = strchr(++prop, ':');
+	if (sep == NULL || prop - fixup > sizeof(path)) {
+		return -FDT_ERR_BADOVERLAY;
+	}
+
+	memcpy(path, fixup, prop - fixup - 1);
+	path[prop - fixup - 1] = '\0';
+
+	off = simple_strtoull(sep + 1, &end, 10);
+	if (end == sep + 1 || *end != '\0') {
+		return -FDT_ERR_BADOVERLAY;
+	}
+
+	node = fdt_path_offset(fdto, path);
+	if (node < 0) {
+		return node;
+	}
+
+	data = (uint8_t *) fdt_getprop_namelen(fdto, node, prop,
+					       sep - prop, &len);
+	if (data == NULL) {
+		return len;
+	}
+
+	if (len < sizeof(uint32_t) || off > len - sizeof(uint32_t)) {
+		return -FDT_ERR_BADOVERLAY;
+	}
+
+	fdt_overlay_st(data + off, phandle);
+	return 0;
+}
+
+/*
+ * __fixups__ has a property per label the overlay uses from
+ * the base tree, listing every place that wants its phandle.
+ * The base tree's __symbols__ gives the labelled node's path.
+ */
+static int
+fdt_overlay_fixups(void *fdt,
+		   fdt_index *idx,
+		   void *fdto)
+{
+	int len;
+	int err;
+	int node;
+	int prop;
+	int fixups;
+	int symbols;
+	int list_len;
+	uint32_t phandle;
+	const char *label;
+	const char *path;
+	const char *list;
+	const char *s;
+
+	fixups = fdt_subnode_offset(fdto, 0, "__fixups__");
+	if (fixups < 0) {
+		return fixups == -FDT_ERR_NOTFOUND ? 0 : fixups;
+	}
+
+	symbols = fdt_index_path_offset(idx, fdt, "/__symbols__");
+	for (prop = fdt_first_property_offset(fdto, fixups); prop >= 0;
+	     prop = fdt_next_property_offset(fdto, prop)) {
+		list = fdt_getprop_by_offset(fdto, prop, &label, &list_len);
+		if (list == NULL) {
+			return list_len;
+		}
+
+		if (list_len == 0 || list[list_len - 1] != '\0') {
+			return -FDT_ERR_BADVALUE;
+		}
+
+		if (symbols < 0) {
+			return symbols;
+		}
+
+		path = fdt_getprop(fdt, symbols, label, &len);
+		if (path == NULL) {
+			return len;
+		}
+
+		if (len == 0 || path[len - 1] != '\0') {
+			return -FDT_ERR_BADVALUE;
+		}
+
+		node = fdt_index_path_offset(idx, fdt, path);
+		if (node < 0) {
+			return node;
+		}
+
+		phandle = fdt_get_phandle(fdt, node);
+		if (phandle == 0) {
+			return -FDT_ERR_BADPHANDLE;
+		}
+
+		for (s = list; s < list + list_len; s += strlen(s) + 1) {
+			err = fdt_overlay_fixup_one(fdto, s, phandle);
+			if (err != 0) {
+				return err;
+			}
+		}
+	}
+
+	return prop == -FDT_ERR_NOTFOUND ? 0 : prop;
+}
+
+/*
+ * A fragment names its target either by phandle or by path.
+ * With idx NULL this works on a tree that has been edited.
+ */
+static int
+fdt_overlay_get_target(const void *fdt,
+		       fdt_index *idx,
+		       const void *fdto,
+		       int frag)
+{
+	int len;
+	const char *path;
+	const uint32_t *phandle;
+
+	phandle = fdt_getprop(fdto, frag, "target", &len);
+	if (phandle != NULL) {
+		if (len != sizeof(*phandle)) {
+			return -FDT_ERR_BADOVERLAY;
+		}
+
+		return fdt_index_node_offset_by_phandle(idx, fdt,
+							fdt_overlay_ld(phandle));
+	}
+
+	if (len != -FDT_ERR_NOTFOUND) {
+		return len;
+	}
+
+	path = fdt_getprop(fdto, frag, "target-path", &len);
+	if (path == NULL) {
+		return len == -FDT_ERR_NOTFOUND ? -FDT_ERR_BADOVERLAY : len;
+	}
+
+	if (len == 0 || path[len - 1] != '\0') {
+		return -FDT_ERR_BADVALUE;
+	}
+
+	return fdt_index_path_offset(idx, fdt, path);
+}
+
+/*
+ * Properties overwrite, subnodes merge.
+ */
+static int
+fdt_overlay_apply_node(void *fdt,
+		       int target,
+		       void *fdto,
+		       int node)
+{
+	int len;
+	int err;
+	int sub;
+	int prop;
+	int child;
+	const char *name;
+	const void *val;
+
+	for (prop = fdt_first_property_offset(fdto, node); prop >= 0;
+	     prop = fdt_next_property_offset(fdto, prop)) {
+		val = fdt_getprop_by_offset(fdto, prop, &name, &len);
+		if (val == NULL) {
+			return len;
+		}
+
+		err = fdt_setprop(fdt, target, name, val, len);
+		if (err != 0) {
+			return err;
+		}
+	}
+
+	if (prop != -FDT_ERR_NOTFOUND) {
+		return prop;
+	}
+
+	for (sub = fdt_first_subnode(fdto, node); sub >= 0;
+	     sub = fdt_next_subnode(fdto, sub)) {
+		name = fdt_get_name(fdto, sub, &len);
+		if (name == NULL) {
+			return len;
+		}
+
+		child = fdt_add_subnode_namelen(fdt, target, name, len);
+		if (child == -FDT_ERR_EXISTS) {
+			child = fdt_subnode_offset_namelen(fdt, target,
+							   name, len);
+		}
+
+		if (child < 0) {
+			return child;
+		}
+
+		err = fdt_overlay_apply_node(fdt, child, fdto, sub);
+		if (err != 0) {
+			return err;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Labels in the overlay's __symbols__ are relative to its
+ * fragments. Rewritten against the targets and added to the
+ * base tree's __symbols__, a later overlay can refer to them.
+ */
+static int
+fdt_overlay_symbols(void *fdt,
+		    void *fdto)
+{
+	int len;
+	int err;
+	int prop;
+	int frag;
+	int target;
+	int symbols;
+	int ov_symbols;
+	size_t n;
+	size_t rel_len;
+	const char *s;
+	const char *rel;
+	const char *name;
+	const char *path;
+	char buf[FDT_OVERLAY_PATH_MAX];
+
+	ov_symbols = fdt_subnode_offset(fdto, 0, "__symbols__");
+	if (ov_symbols < 0) {
+		return ov_symbols == -FDT_ERR_NOTFOUND ? 0 : ov_symbols;
+	}
+
+	symbols = fdt_subnode_offset(fdt, 0, "__symbols__");
+	if (symbols == -FDT_ERR_NOTFOUND) {
+		symbols = fdt_add_subnode(fdt, 0, "__symbols__");
+	}
+
+	if (symbols < 0) {
+		return symbols;
+	}
+
+	for (prop = fdt_first_property_offset(fdto, ov_symbols); prop >= 0;
+	     prop = fdt_next_property_offset(fdto, prop)) {
+		path = fdt_getprop_by_offset(fdto, prop, &name, &len);
+		if (path == NULL) {
+			return len;
+		}
+
+		if (len < 2 || path[len - 1] != '\0' || path[0] != '/') {
+			return -FDT_ERR_BADVALUE;
+		}
+
+		/*
+		 * Only "/<fragment>/__overlay__[/<path>]" ends
+		 * up in the base tree.
+		 */
+		s = strchr(path + 1, '/');
+		if (s == NULL) {
+			continue;
+		}
+
+		if (!strncmp(s, "/__overlay__/", sizeof("/__overlay__/") - 1)) {
+			rel = s + sizeof("/__overlay__/") - 1;
+		} else if (!strcmp(s, "/__overlay__")) {
+			rel = "";
+		} else {
+			continue;
+		}
+
+		frag = fdt_subnode_offset_namelen(fdto, 0, path + 1,
+						  s - path - 1);
+		if (frag < 0) {
+			return -FDT_ERR_BADOVERLAY;
+		}
+
+		target = fdt_overlay_get_target(fdt, NULL, fdto, frag);
+		if (target < 0) {
+			return target;
+		}
+
+		err = fdt_get_path(fdt, target, buf, sizeof(buf));
+		if (err != 0) {
+			return err;
+		}
+
+		n = strlen(buf);
+		rel_len = strlen(rel);
+		if (rel_len != 0) {
+			if (n + 1 + rel_len + 1 > sizeof(buf)) {
+				return -FDT_ERR_NOSPACE;
+			}
+
+			if (n > 1) {
+				buf[n++] = '/';
+			}
+
+			memcpy(buf + n, rel, rel_len + 1);
+		}
+
+		err = fdt_setprop_string(fdt, symbols, name, buf);
+		if (err != 0) {
+			return err;
+		}
+	}
+
+	return prop == -FDT_ERR_NOTFOUND ? 0 : prop;
+}
+
+int
+fdt_overlay_apply(void *fdt,
+		  fdt_index *idx,
+		  void *fdto)
+{
+	int i;
+	int err;
+	int frag;
+	int node;
+	int target;
+	int fixups;
+	uint32_t delta;
+	int nr_frags = 0;
+	fdt_overlay_frag frags[FDT_OVERLAY_MAX_FRAGS];
+
+	err = fdt_check_header(fdto);
+	if (err != 0) {
+		return err;
+	}
+
+	delta = fdt_index_get_max_phandle(idx, fdt);
+	if (delta == (uint32_t) -1) {
+		return -FDT_ERR_BADSTRUCTURE;
+	}
+
+	err = fdt_overlay_adjust_phandles(fdto, delta);
+	if (err != 0) {
+		return err;
+	}
+
+	fixups = fdt_subnode_offset(fdto, 0, "__local_fixups__");
+	if (fixups >= 0) {
+		err = fdt_overlay_local_fixups(fdto, 0, fixups, delta);
+	} else if (fixups != -FDT_ERR_NOTFOUND) {
+		err = fixups;
+	}
+
+	if (err != 0) {
+		return err;
+	}
+
+	err = fdt_overlay_fixups(fdt, idx, fdto);
+	if (err != 0) {
+		return err;
+	}
+
+	/*
+	 * Every target is looked up before the first edit, while
+	 * idx still matches fdt. Merging into a node only moves
+	 * what comes after it, so going from the last target to
+	 * the first keeps the rest valid. Fragments for the same
+	 * node still merge in the order they're in the overlay.
+	 */
+	for (frag = fdt_first_subnode(fdto, 0); frag >= 0;
+	     frag = fdt_next_subnode(fdto, frag)) {
+		node = fdt_subnode_offset(fdto, frag, "__overlay__");
+		if (node == -FDT_ERR_NOTFOUND) {
+			continue;
+		}
+
+		if (node < 0) {
+			return node;
+		}
+
+		if (nr_frags == FDT_OVERLAY_MAX_FRAGS) {
+			return -FDT_ERR_NOSPACE;
+		}
+
+		target = fdt_overlay_get_target(fdt, idx, fdto, frag);
+		if (target < 0) {
+			return target;
+		}
+
+		for (i = nr_frags; i > 0 && frags[i - 1].target < target; i--) {
+			frags[i] = frags[i - 1];
+		}
+
+		frags[i].node = node;
+		frags[i].target = target;
+		nr_frags++;
+	}
+
+	for (i = 0; i < nr_frags; i++) {
+		err = fdt_overlay_apply_node(fdt, frags[i].target,
+					     fdto, frags[i].node);
+		if (err != 0) {
+			return err;
+		}
+	}
+
+	return fdt_overlay_symbols(fdt, fdto);
+}
@@ -0,0 +1,39 @@
+/*
+ * Device tree overlays.
+ *
+ * Copyright (C) 2018 Andrei Warkentin <andrey.warkentin@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef FDT_OVERLAY_H
+#define FDT_OVERLAY_H
+
+#include <fdt_index.h>
+
+/*
+ * Merges the overlay fdto into fdt, which must have been through
+ * fdt_open_into with enough room to grow. idx must be good for fdt
+ * as passed in, or NULL.
+ *
+ * fdto has its phandles fixed up in place, and on failure either
+ * tree may be left half-merged, so work on copies of both.
+ * Returns 0 or a libfdt error.
+ */
+int fdt_overlay_apply(void *fdt,
+		      fdt_index *idx,
+		      void *fdto);
+
+#endif /* FDT_OVERLAY_H */
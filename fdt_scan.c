@@ -0,0 +1,367 @@
+/*
+ * Boot-time FDT scan.
+ *
+ * Copyright (C) 2018 Andrei Warkentin <andrey.warkentin@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <lib.h>
+#include <libfdt.h>
+#include <fdt_scan.h>
+
+#define FDT_SCAN_MEMORY    BIT(0)
+#define FDT_SCAN_NO_MAP    BIT(1)
+#define FDT_SCAN_DISABLED  BIT(2)
+#define FDT_SCAN_CHOSEN    BIT(3)
+#define FDT_SCAN_RESMEM    BIT(4)
+#define FDT_SCAN_IN_RESMEM BIT(5)
+
+typedef struct fdt_scan_node {
+	/*
+	 * What the children's reg is made of. The
+	 * defaults are from the devicetree spec.
+	 */
+	uint32_t addr_cells;
+	uint32_t size_cells;
+	/*
+	 * Parsed when the node ends, as it depends on
+	 * properties that may come after it.
+	 */
+	const uint32_t *reg;
+	int reg_len;
+	unsigned flags;
+} fdt_scan_node;
+
+static void
+fdt_scan_add(fdt_scan *scan,
+	     phys_addr_t base,
+	     uint64_t size,
+	     lmb_type_t type,
+	     lmb_tag_t tag)
+{
+	fdt_scan_range *r;
+
+	if (size == 0) {
+		return;
+	}
+
+	if (scan->nr_ranges == FDT_SCAN_MAX_RANGES) {
+		scan->dropped++;
+		return;
+	}
+
+	r = &scan->ranges[scan->nr_ranges++];
+	r->base = base;
+	r->size = size;
+	r->type = type;
+	r->tag = tag;
+}
+
+static uint64_t
+fdt_scan_cells(const uint32_t *p,
+	       uint32_t cells)
+{
+	uint64_t v = 0;
+
+	while (cells-- != 0) {
+		v = (v << 32) | fdt32_to_cpu(*p++);
+	}
+
+	return v;
+}
+
+static bool_t
+fdt_scan_is(const void *data,
+	    int len,
+	    const char *s)
+{
+	return len == strlen(s) + 1 && !memcmp(data, s, len);
+}
+
+static void
+fdt_scan_reg(fdt_scan *scan,
+	     fdt_scan_node *parent,
+	     fdt_scan_node *node,
+	     lmb_type_t type,
+	     lmb_tag_t tag)
+{
+	uint32_t ac = parent->addr_cells;
+	uint32_t sc = parent->size_cells;
+	const uint32_t *reg = node->reg;
+	int len = node->reg_len;
+	int entry = (ac + sc) * sizeof(uint32_t);
+
+	if (ac < 1 || ac > 2 || sc < 1 || sc > 2 || len % entry != 0) {
+		scan->dropped++;
+		return;
+	}
+
+	for (; len != 0; len -= entry, reg += ac + sc) {
+		fdt_scan_add(scan, fdt_scan_cells(reg, ac),
+			     fdt_scan_cells(reg + ac, sc), type, tag);
+	}
+}
+
+static void
+fdt_scan_prop(fdt_scan *scan,
+	      fdt_scan_node *node,
+	      const char *name,
+	      const void *data,
+	      int len,
+	      uint64_t *initrd)
+{
+	if (!strcmp(name, "#address-cells") && len == sizeof(uint32_t)) {
+		node->addr_cells = fdt_scan_cells(data, 1);
+	} else if (!strcmp(name, "#size-cells") && len == sizeof(uint32_t)) {
+		node->size_cells = fdt_scan_cells(data, 1);
+	} else if (!strcmp(name, "reg")) {
+		node->reg = data;
+		node->reg_len = len;
+	} else if (!strcmp(name, "device_type")) {
+		if (fdt_scan_is(data, len, "memory")) {
+			node->flags |= FDT_SCAN_MEMORY;
+		}
+	} else if (!strcmp(name, "no-map")) {
+		node->flags |= FDT_SCAN_NO_MAP;
+	} else if (!strcmp(name, "status")) {
+		if (!fdt_scan_is(data, len, "okay") &&
+		    !fdt_scan_is(data, len, "ok")) {
+			node->flags |= FDT_SCAN_DISABLED;
+		}
+	} else if ((node->flags & FDT_SCAN_CHOSEN) != 0) {
+		if (!strcmp(name, "bootargs")) {
+			if (len != 0 && ((const char *) data)[len - 1] == '\0') {
+				scan->cmdline = data;
+			}
+		} else if (!strcmp(name, "linux,initrd-start") &&
+			   (len == 4 || len == 8)) {
+			initrd[0] = fdt_scan_cells(data, len / 4);
+		} else if (!strcmp(name, "linux,initrd-end") &&
+			   (len == 4 || len == 8)) {
+			initrd[1] = fdt_scan_cells(data, len / 4);
+		}
+	}
+}
+
+static void
+fdt_scan_node_end(fdt_scan *scan,
+		  fdt_scan_node *parent,
+		  fdt_scan_node *node)
+{
+	if ((node->flags & FDT_SCAN_DISABLED) != 0 || node->reg == NULL) {
+		return;
+	}
+
+	if ((node->flags & FDT_SCAN_MEMORY) != 0) {
+		fdt_scan_reg(scan, parent, node, LMB_FREE, LMB_TAG("RAMR"));
+	} else if ((node->flags & FDT_SCAN_IN_RESMEM) != 0) {
+		fdt_scan_reg(scan, parent, node, LMB_RUNTIME,
+			     (node->flags & FDT_SCAN_NO_MAP) != 0 ?
+			     LMB_TAG("RMNM") : LMB_TAG("RMEM"));
+	}
+}
+
+/*
+ * One pass over the structure block, with each reg parsed
+ * according to its parent's #address-cells and #size-cells.
+ * Dynamically placed /reserved-memory children (no reg) are
+ * left to the OS, and subtrees that are too deep are skipped.
+ * Returns -1 where the structure block is damaged, having
+ * kept what came before.
+ */
+static int
+fdt_scan_struct(const void *fdt,
+		fdt_scan *scan,
+		uint64_t *initrd)
+{
+	int len;
+	int next;
+	uint32_t tag;
+	int depth = -1;
+	int skip = 0;
+	int offset = 0;
+	const char *name;
+	fdt_scan_node *node;
+	const struct fdt_property *prop;
+	fdt_scan_node nodes[FDT_SCAN_MAX_DEPTH];
+
+	do {
+		tag = fdt_next_tag(fdt, offset, &next);
+		switch (tag) {
+		case FDT_BEGIN_NODE:
+			if (skip > 0 || depth + 1 == FDT_SCAN_MAX_DEPTH) {
+				if (skip++ == 0) {
+					scan->dropped++;
+				}
+				break;
+			}
+
+			name = fdt_get_name(fdt, offset, &len);
+			if (name == NULL) {
+				return -1;
+			}
+
+			node = &nodes[++depth];
+			node->addr_cells = 2;
+			node->size_cells = 1;
+			node->reg = NULL;
+			node->reg_len = 0;
+			node->flags = 0;
+			if (depth == 1 && !strcmp(name, "chosen")) {
+				node->flags |= FDT_SCAN_CHOSEN;
+			} else if (depth == 1 &&
+				   !strcmp(name, "reserved-memory")) {
+				node->flags |= FDT_SCAN_RESMEM;
+			} else if (depth == 2 &&
+				   (nodes[1].flags & FDT_SCAN_RESMEM) != 0) {
+				node->flags |= FDT_SCAN_IN_RESMEM;
+			}
+			break;
+		case FDT_PROP:
+			if (skip > 0) {
+				break;
+			}
+
+			prop = fdt_offset_ptr(fdt, offset, sizeof(*prop));
+			if (depth < 0 || prop == NULL) {
+				return -1;
+			}
+
+			name = fdt_string(fdt, fdt32_to_cpu(prop->nameoff));
+			fdt_scan_prop(scan, &nodes[depth], name, prop->data,
+				      fdt32_to_cpu(prop->len), initrd);
+			break;
+		case FDT_END_NODE:
+			if (skip > 0) {
+				skip--;
+				break;
+			}
+
+			if (depth < 0) {
+				return -1;
+			}
+
+			if (depth > 0) {
+				fdt_scan_node_end(scan, &nodes[depth - 1],
+						  &nodes[depth]);
+			}
+			depth--;
+			break;
+		case FDT_END:
+			if (next < 0) {
+				return -1;
+			}
+			break;
+		}
+
+		offset = next;
+	} while (tag != FDT_END);
+
+	return 0;
+}
+
+int
+fdt_scan_boot(const void *fdt,
+	      fdt_scan *scan)
+{
+	int i;
+	uint64_t base;
+	uint64_t size;
+	uint64_t initrd[2] = { 0, 0 };
+
+	scan->cmdline = NULL;
+	scan->nr_ranges = 0;
+	scan->dropped = 0;
+	scan->partial = false;
+	if (fdt_check_header(fdt) != 0) {
+		return -1;
+	}
+
+	for (i = 0; i < fdt_num_mem_rsv(fdt); i++) {
+		fdt_get_mem_rsv(fdt, i, &base, &size);
+		fdt_scan_add(scan, base, size, LMB_BOOT, LMB_TAG("RESV"));
+	}
+
+	scan->partial = fdt_scan_struct(fdt, scan, initrd) != 0;
+	if (initrd[1] > initrd[0]) {
+		fdt_scan_add(scan, initrd[0], initrd[1] - initrd[0],
+			     LMB_BOOT, LMB_TAG("INRD"));
+	}
+
+	return 0;
+}
+
+/*
+ * Firmware often lists a carveout both as /memreserve/ and
+ * under /reserved-memory, so only what isn't reserved yet
+ * gets reserved.
+ */
+static void
+fdt_scan_reserve(struct lmb *lmb,
+		 fdt_scan_range *r)
+{
+	struct lmb_property *p;
+	phys_addr_t rb;
+	phys_addr_t rb_end;
+	phys_addr_t pos = r->base;
+	phys_addr_t end = r->base + r->size;
+
+	while (pos < end) {
+		p = lmb_overlaps_region(&lmb->reserved, pos, end - pos);
+		rb = p == NULL ? end : p->base;
+		rb_end = p == NULL ? end : rb + p->size;
+		if (rb > pos &&
+		    lmb_reserve(lmb, pos, rb - pos, r->type, r->tag) < 0 &&
+		    lmb_overlaps_region(&lmb->memory, pos, rb - pos) != NULL) {
+			printk("FDT: couldn't reserve 0x%lx-0x%lx\n",
+			       pos, rb - 1);
+		}
+
+		pos = max(pos, rb_end);
+	}
+}
+
+void
+fdt_scan_to_lmb(fdt_scan *scan,
+		struct lmb *lmb)
+{
+	unsigned long i;
+	unsigned long pass;
+	fdt_scan_range *r;
+	/*
+	 * Reservations have to be in known memory, so all of RAM
+	 * goes in first. Runtime reservations go before boot ones,
+	 * so where they overlap the region stays runtime.
+	 */
+	static const lmb_type_t order[] = {
+		LMB_FREE, LMB_RUNTIME, LMB_BOOT
+	};
+
+	for (pass = 0; pass < ELES(order); pass++) {
+		for (i = 0; i < scan->nr_ranges; i++) {
+			r = &scan->ranges[i];
+			if (r->type != order[pass]) {
+				continue;
+			}
+
+			if (r->type == LMB_FREE) {
+				lmb_add(lmb, r->base, r->size, r->tag);
+			} else {
+				fdt_scan_reserve(lmb, r);
+			}
+		}
+	}
+}
@@ -0,0 +1,70 @@
+/*
+ * Boot-time FDT scan.
+ *
+ * Copyright (C) 2018 Andrei Warkentin <andrey.warkentin@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef FDT_SCAN_H
+#define FDT_SCAN_H
+
+#include <lmb.h>
+
+#define FDT_SCAN_MAX_DEPTH  16
+#define FDT_SCAN_MAX_RANGES 128
+
+typedef struct fdt_scan_range {
+	phys_addr_t base;
+	uint64_t size;
+	/*
+	 * LMB_FREE for RAM, otherwise how to reserve it.
+	 */
+	lmb_type_t type;
+	lmb_tag_t tag;
+} fdt_scan_range;
+
+/*
+ * What the loader needs from the FDT it was started with, which
+ * is RAM (memory nodes), what not to touch (/reserved-memory
+ * children, the initrd in /chosen and /memreserve/ entries)
+ * and the command line.
+ */
+typedef struct fdt_scan {
+	const char *cmdline;
+	unsigned long nr_ranges;
+	/*
+	 * Ranges that didn't fit, nodes with a reg that
+	 * couldn't be parsed, and subtrees nested deeper
+	 * than FDT_SCAN_MAX_DEPTH.
+	 */
+	unsigned long dropped;
+	/*
+	 * Set if the structure block is damaged, in which
+	 * case only what came before the damage is here.
+	 */
+	bool_t partial;
+	fdt_scan_range ranges[FDT_SCAN_MAX_RANGES];
+} fdt_scan;
+
+/*
+ * Fails only if the header is bad.
+ */
+int fdt_scan_boot(const void *fdt,
+		  fdt_scan *scan);
+void fdt_scan_to_lmb(fdt_scan *scan,
+		     struct lmb *lmb);
+
+#endif /* FDT_SCAN_H */
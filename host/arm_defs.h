@@ -0,0 +1,33 @@
+/*
+ * arm_defs.h for host-built tests.
+ *
+ * Copyright (C) 2018 Andrei Warkentin <andrey.warkentin@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef ARM_DEFS_H
+#define ARM_DEFS_H
+
+/*
+ * Nothing under test touches system registers or devices,
+ * barriers are all that's needed.
+ */
+#define ISB() asm volatile("" : : : "memory");
+#define DSB_LD() asm volatile("" : : : "memory");
+#define DSB_ST() asm volatile("" : : : "memory");
+#define DSB_ISH() asm volatile("" : : : "memory");
+
+#endif /* ARM_DEFS_H */
@@ -0,0 +1,841 @@
+#!/usr/bin/env python3
+#
+# Writes the synthetic Tegra X1 (tegra210) DTBs in this directory.
+#
+# Copyright (C) 2018 Andrei Warkentin <andrey.warkentin@gmail.com>
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+#
+# The layout follows the kernel's tegra210.dtsi and the
+# p2371-2180 (Jetson TX1) and darcy (Shield TV) board files:
+# the same nodes, compatibles, addresses and cell counts,
+# pinmux and EMC tables of the usual size, and phandles
+# with __symbols__ the way dtc -@ writes them. The property
+# values are plausible, not copied. Output is deterministic.
+#
+# Usage: mkdtb.py [output directory]
+#
+
+import os
+import struct
+import sys
+
+FDT_MAGIC = 0xd00dfeed
+FDT_BEGIN_NODE = 1
+FDT_END_NODE = 2
+FDT_PROP = 3
+FDT_END = 9
+
+
+class Node(object):
+    def __init__(self, name, label=None):
+        self.name = name
+        self.label = label
+        self.props = []
+        self.children = []
+        self.parent = None
+        self.phandle = None
+
+    def prop(self, name, value=b""):
+        self.props.append((name, value))
+        return self
+
+    def add(self, child):
+        child.parent = self
+        self.children.append(child)
+        return child
+
+    def path(self):
+        if self.parent is None:
+            return "/"
+        up = self.parent.path()
+        return (up if up != "/" else "") + "/" + self.name
+
+
+def cells(*values):
+    return b"".join(struct.pack(">I", v & 0xffffffff) for v in values)
+
+
+def string(*values):
+    return b"".join(v.encode() + b"\0" for v in values)
+
+
+class Ref(object):
+    """A phandle, filled in once every node has one."""
+
+    def __init__(self, label, *args):
+        self.label = label
+        self.args = args
+
+
+def refs(*items):
+    return list(items)
+
+
+class Tree(object):
+    def __init__(self):
+        self.root = Node("")
+        self.labels = {}
+
+    def node(self, parent, name, label=None):
+        n = parent.add(Node(name, label))
+        if label is not None:
+            self.labels[label] = n
+        return n
+
+    def resolve(self, symbols):
+        handle = 1
+        for n in self.walk(self.root):
+            if n.label is not None:
+                n.phandle = handle
+                handle += 1
+
+        for n in self.walk(self.root):
+            props = []
+            for name, value in n.props:
+                if isinstance(value, list):
+                    out = b""
+                    for item in value:
+                        if isinstance(item, Ref):
+                            out += cells(self.labels[item.label].phandle,
+                                         *item.args)
+                        else:
+                            out += item
+                    value = out
+                props.append((name, value))
+            if n.phandle is not None:
+                props.append(("phandle", cells(n.phandle)))
+            n.props = props
+
+        if symbols:
+            sym = self.node(self.root, "__symbols__")
+            for label in sorted(self.labels):
+                sym.prop(label, string(self.labels[label].path()))
+
+    def walk(self, n):
+        yield n
+        for c in n.children:
+            for d in self.walk(c):
+                yield d
+
+    def blob(self, memreserve):
+        strings = b""
+        offsets = {}
+        struct_block = []
+
+        def name_off(name):
+            nonlocal strings
+            if name not in offsets:
+                offsets[name] = len(strings)
+                strings += name.encode() + b"\0"
+            return offsets[name]
+
+        def pad(b):
+            return b + b"\0" * (-len(b) % 4)
+
+        def emit(n):
+            struct_block.append(cells(FDT_BEGIN_NODE) +
+                                pad(n.name.encode() + b"\0"))
+            for name, value in n.props:
+                struct_block.append(cells(FDT_PROP, len(value),
+                                          name_off(name)) + pad(value))
+            for c in n.children:
+                emit(c)
+            struct_block.append(cells(FDT_END_NODE))
+
+        emit(self.root)
+        struct_block.append(cells(FDT_END))
+        dt_struct = b"".join(struct_block)
+
+        rsvmap = b"".join(struct.pack(">QQ", a, s) for a, s in memreserve)
+        rsvmap += struct.pack(">QQ", 0, 0)
+
+        off_rsvmap = 40
+        off_struct = off_rsvmap + len(rsvmap)
+        off_strings = off_struct + len(dt_struct)
+        total = off_strings + len(strings)
+        header = struct.pack(">10I", FDT_MAGIC, total, off_struct,
+                             off_strings, off_rsvmap, 17, 16, 0,
+                             len(strings), len(dt_struct))
+        return header + rsvmap + dt_struct + strings
+
+
+# Pin groups from the tegra210 pinmux binding, enough of them
+# for a board file's worth of configuration.
+PINS = [
+    "als_prox_int_px3", "ap_ready_pv5", "ap_wake_bt_ph3",
+    "ap_wake_nfc_ph7", "aud_mclk_pbb0", "batt_bcl", "bt_rst_ph4",
+    "bt_wake_ap_ph5", "button_home_py1", "button_power_on_px5",
+    "button_slide_sw_py0", "button_vol_down_px7", "button_vol_up_px6",
+    "cam1_mclk_ps0", "cam1_pwdn_ps7", "cam1_strobe_pt1",
+    "cam2_mclk_ps1", "cam2_pwdn_pt0", "cam_af_en_ps5",
+    "cam_flash_en_ps6", "cam_i2c_scl_ps2", "cam_i2c_sda_ps3",
+    "cam_rst_ps4", "clk_32k_in", "clk_32k_out_py5", "clk_req",
+    "core_pwr_req", "cpu_pwr_req", "dap1_din_pb1", "dap1_dout_pb2",
+    "dap1_fs_pb0", "dap1_sclk_pb3", "dap2_din_paa2",
+    "dap2_dout_paa3", "dap2_fs_paa0", "dap2_sclk_paa1",
+    "dap4_din_pj5", "dap4_dout_pj6", "dap4_fs_pj4", "dap4_sclk_pj7",
+    "dap6_din_pa2", "dap6_dout_pa3", "dap6_fs_pa1", "dap6_sclk_pa0",
+    "dmic1_clk_pe0", "dmic1_dat_pe1", "dmic2_clk_pe2",
+    "dmic2_dat_pe3", "dmic3_clk_pe4", "dmic3_dat_pe5", "dp_hpd0_pcc6",
+    "dvfs_clk_pbb2", "dvfs_pwm_pbb1", "gen1_i2c_scl_pj1",
+    "gen1_i2c_sda_pj0", "gen2_i2c_scl_pj2", "gen2_i2c_sda_pj3",
+    "gen3_i2c_scl_pf0", "gen3_i2c_sda_pf1", "gpio_x1_aud_pbb3",
+    "gpio_x3_aud_pbb4", "gps_en_pi2", "gps_rst_pi3",
+    "hdmi_cec_pcc0", "hdmi_int_dp_hpd_pcc1", "jtag_rtck",
+    "lcd_bl_en_pv1", "lcd_bl_pwm_pv0", "lcd_gpio1_pv3",
+    "lcd_gpio2_pv4", "lcd_rst_pv2", "lcd_te_py2", "modem_wake_ap_px0",
+    "motion_int_px2", "nfc_en_pi0", "nfc_int_pi1", "pa6", "pcc7",
+    "pe6", "pe7", "pex_l0_clkreq_n_pa1", "pex_l0_rst_n_pa0",
+    "pex_l1_clkreq_n_pa4", "pex_l1_rst_n_pa3", "pex_wake_n_pa2",
+    "ph6", "pk0", "pk1", "pk2", "pk3", "pk4", "pk5", "pk6", "pk7",
+    "pl0", "pl1", "pwr_i2c_scl_py3", "pwr_i2c_sda_py4", "pwr_int_n",
+    "pz0", "pz1", "pz2", "pz3", "pz4", "pz5", "qspi_cs_n_pee1",
+    "qspi_io0_pee2", "qspi_io1_pee3", "qspi_io2_pee4",
+    "qspi_io3_pee5", "qspi_sck_pee0", "sata_led_active_pa5",
+    "sdmmc1_clk_pm0", "sdmmc1_cmd_pm1", "sdmmc1_dat0_pm5",
+    "sdmmc1_dat1_pm4", "sdmmc1_dat2_pm3", "sdmmc1_dat3_pm2",
+    "sdmmc3_clk_pp0", "sdmmc3_cmd_pp1", "sdmmc3_dat0_pp5",
+    "sdmmc3_dat1_pp4", "sdmmc3_dat2_pp3", "sdmmc3_dat3_pp2",
+    "shutdown", "spdif_in_pcc3", "spdif_out_pcc2", "spi1_cs0_pc3",
+    "spi1_cs1_pc4", "spi1_miso_pc1", "spi1_mosi_pc0", "spi1_sck_pc2",
+    "spi2_cs0_pb7", "spi2_cs1_pdd0", "spi2_miso_pb5", "spi2_mosi_pb4",
+    "spi2_sck_pb6", "spi4_cs0_pc6", "spi4_miso_pd0", "spi4_mosi_pc7",
+    "spi4_sck_pc5", "temp_alert_px4", "touch_clk_pv7",
+    "touch_int_px1", "touch_rst_pv6", "uart1_cts_pu3",
+    "uart1_rts_pu2", "uart1_rx_pu1", "uart1_tx_pu0", "uart2_cts_pg3",
+    "uart2_rts_pg2", "uart2_rx_pg1", "uart2_tx_pg0", "uart3_cts_pd4",
+    "uart3_rts_pd3", "uart3_rx_pd2", "uart3_tx_pd1", "uart4_cts_pi7",
+    "uart4_rts_pi6", "uart4_rx_pi5", "uart4_tx_pi4", "usb_vbus_en0_pcc4",
+    "usb_vbus_en1_pcc5", "wifi_en_ph0", "wifi_rst_ph1",
+    "wifi_wake_ap_ph2",
+]
+
+FUNCTIONS = ["rsvd0", "rsvd1", "gp", "i2c1", "i2c2", "i2c3", "i2cpmu",
+             "i2s1", "i2s2", "i2s4b", "uarta", "uartb", "uartc",
+             "uartd", "sdmmc1", "sdmmc3", "spi1", "spi2", "spi4",
+             "pe", "pe0", "pe1", "sata", "dmic1", "dmic2", "qspi"]
+
+
+def pinmux(t, parent, count):
+    pm = t.node(parent, "pinmux@700008d4", "pinmux")
+    pm.prop("compatible", string("nvidia,tegra210-pinmux"))
+    pm.prop("reg", cells(0, 0x700008d4, 0, 0x29c, 0, 0x70003000,
+                         0, 0x294))
+    pm.prop("pinctrl-names", string("boot"))
+    pm.prop("pinctrl-0", refs(Ref("state_boot")))
+    common = t.node(pm, "common", "state_boot")
+    for i, pin in enumerate(PINS[:count]):
+        g = t.node(common, pin)
+        g.prop("nvidia,pins", string(pin))
+        g.prop("nvidia,function", string(FUNCTIONS[i % len(FUNCTIONS)]))
+        g.prop("nvidia,pull", cells(i % 3))
+        g.prop("nvidia,tristate", cells((i >> 1) & 1))
+        g.prop("nvidia,enable-input", cells((i >> 2) & 1))
+        if i % 5 == 0:
+            g.prop("nvidia,io-hv", cells(1))
+    return pm
+
+
+def emc_tables(t, parent, rates, words):
+    emc = t.node(parent, "external-memory-controller@7001b000", "emc")
+    emc.prop("compatible", string("nvidia,tegra210-emc"))
+    emc.prop("reg", cells(0, 0x7001b000, 0, 0x1000, 0, 0x7001e000,
+                          0, 0x1000, 0, 0x7001f000, 0, 0x1000))
+    emc.prop("clocks", refs(Ref("tegra_car", 57)))
+    emc.prop("clock-names", string("emc"))
+    emc.prop("nvidia,memory-controller", refs(Ref("mc")))
+    for r in rates:
+        n = t.node(emc, "emc-table@%d" % r)
+        n.prop("compatible", string("nvidia,tegra21-emc-table"))
+        n.prop("nvidia,revision", cells(7))
+        n.prop("nvidia,dvfs-version", string("10_%d_V9.8.7_V1.6" % r))
+        n.prop("clock-frequency", cells(r))
+        n.prop("nvidia,emc-min-mv", cells(800))
+        n.prop("nvidia,gk20a-min-mv", cells(1150))
+        n.prop("nvidia,source", string("pllp_out0"))
+        n.prop("nvidia,src-sel-reg", cells(0x40188002))
+        n.prop("nvidia,emc-registers",
+               cells(*[(r * 7 + i * 0x9e3779b1) & 0xffff
+                       for i in range(words)]))
+        n.prop("nvidia,emc-trimmers",
+               cells(*[(r + i * 0x1f) & 0xff for i in range(words // 2)]))
+        n.prop("nvidia,emc-burst-mc-regs",
+               cells(*[(r ^ i) & 0x3f for i in range(33)]))
+    return emc
+
+
+def regulators(t, pmic, n_sd, n_ldo):
+    regs = t.node(pmic, "regulators")
+    for i in range(n_sd):
+        r = t.node(regs, "sd%d" % i, "max77620_sd%d" % i)
+        r.prop("regulator-name", string("vdd-sd%d" % i))
+        r.prop("regulator-min-microvolt", cells(600000 + i * 100000))
+        r.prop("regulator-max-microvolt", cells(1400000 + i * 100000))
+        r.prop("regulator-always-on")
+        r.prop("regulator-boot-on")
+        r.prop("maxim,active-fps-source", cells(i % 3))
+        r.prop("maxim,active-fps-power-up-slot", cells(i))
+    for i in range(n_ldo):
+        r = t.node(regs, "ldo%d" % i, "max77620_ldo%d" % i)
+        r.prop("regulator-name", string("vdd-ldo%d" % i))
+        r.prop("regulator-min-microvolt", cells(800000 + i * 100000))
+        r.prop("regulator-max-microvolt", cells(3300000))
+        if i % 2 == 0:
+            r.prop("regulator-always-on")
+        r.prop("maxim,active-fps-source", cells(3))
+
+
+def thermal(t, root, zones):
+    tz = t.node(root, "thermal-zones")
+    for name, sensor in zones:
+        z = t.node(tz, name)
+        z.prop("polling-delay", cells(0))
+        z.prop("polling-delay-passive", cells(500))
+        z.prop("thermal-sensors", refs(Ref("soctherm", sensor)))
+        trips = t.node(z, "trips")
+        for i, temp in enumerate((90000, 97000, 102500)):
+            tp = t.node(trips, "trip%d" % i, "%s_trip%d" %
+                        (name.replace("-", "_"), i))
+            tp.prop("temperature", cells(temp))
+            tp.prop("hysteresis", cells(1000))
+            tp.prop("type", string("passive" if i < 2 else "critical"))
+        maps = t.node(z, "cooling-maps")
+        m = t.node(maps, "map0")
+        m.prop("trip", refs(Ref("%s_trip0" % name.replace("-", "_"))))
+        m.prop("cooling-device", refs(Ref("throttle_heavy", 1, 1)))
+
+
+def tegra210(compatible, model, pins, rates, emc_words, i2c_devs,
+             symbols, cpus_a53):
+    t = Tree()
+    root = t.root
+    root.prop("compatible", string(*compatible))
+    root.prop("model", string(model))
+    root.prop("interrupt-parent", refs(Ref("lic")))
+    root.prop("#address-cells", cells(2))
+    root.prop("#size-cells", cells(2))
+
+    aliases = t.node(root, "aliases")
+    chosen = t.node(root, "chosen")
+    chosen.prop("bootargs", string("console=ttyS0,115200n8 "
+                                   "earlycon=uart8250,mmio32,0x70006000"))
+    chosen.prop("stdout-path", string("serial0:115200n8"))
+
+    mem = t.node(root, "memory@80000000")
+    mem.prop("device_type", string("memory"))
+    mem.prop("reg", cells(0, 0x80000000, 0, 0xc0000000))
+
+    rsv = t.node(root, "reserved-memory")
+    rsv.prop("#address-cells", cells(2))
+    rsv.prop("#size-cells", cells(2))
+    rsv.prop("ranges")
+    for name, label, base, size, flags in (
+            ("iram-carveout@40001000", "iram", 0x40001000, 0x3f000,
+             ("no-map",)),
+            ("ramoops@b0000000", "ramoops", 0xb0000000, 0x200000, ()),
+            ("fb0_carveout@0", "fb0", 0, 0x800000, ("reusable",)),
+            ("fb1_carveout@0", "fb1", 0, 0x800000, ("reusable",)),
+            ("vpr-carveout", "vpr", 0, 0x19000000, ("reusable",))):
+        n = t.node(rsv, name, label)
+        if base != 0:
+            n.prop("reg", cells(0, base, 0, size))
+        else:
+            n.prop("size", cells(0, size))
+            n.prop("alignment", cells(0, 0x400000))
+            n.prop("alloc-ranges", cells(0, 0x80000000, 0, 0x70000000))
+        for f in flags:
+            n.prop(f)
+
+    pcie = t.node(root, "pcie@1003000", "pcie")
+    pcie.prop("compatible", string("nvidia,tegra210-pcie"))
+    pcie.prop("device_type", string("pci"))
+    pcie.prop("reg", cells(0, 0x01003000, 0, 0x800, 0, 0x01003800,
+                           0, 0x800, 0, 0x11fff000, 0, 0x1000))
+    pcie.prop("reg-names", string("pads", "afi", "cs"))
+    pcie.prop("interrupts", cells(0, 98, 4, 0, 99, 4))
+    pcie.prop("interrupt-names", string("intr", "msi"))
+    pcie.prop("#address-cells", cells(3))
+    pcie.prop("#size-cells", cells(2))
+    pcie.prop("bus-range", cells(0, 0xff))
+    pcie.prop("ranges", cells(
+        0x82000000, 0, 0x01000000, 0, 0x01000000, 0, 0x1000,
+        0x82000000, 0, 0x01001000, 0, 0x01001000, 0, 0x1000,
+        0x81000000, 0, 0x0, 0, 0x12000000, 0, 0x10000,
+        0x82000000, 0, 0x13000000, 0, 0x13000000, 0, 0x0d000000,
+        0xc2000000, 0, 0x20000000, 0, 0x20000000, 0, 0x20000000))
+    pcie.prop("clocks", refs(Ref("tegra_car", 70), Ref("tegra_car", 72),
+                             Ref("tegra_car", 264)))
+    pcie.prop("clock-names", string("pex", "afi", "pll_e"))
+    pcie.prop("status", string("okay"))
+    for i in (1, 2):
+        p = t.node(pcie, "pci@%d,0" % i)
+        p.prop("device_type", string("pci"))
+        p.prop("assigned-addresses", cells(0x82000800 + (i - 1) * 0x800,
+                                           0, 0x01000000 + (i - 1) *
+                                           0x1000, 0, 0x1000))
+        p.prop("reg", cells(0x000800 * i, 0, 0, 0, 0))
+        p.prop("#address-cells", cells(3))
+        p.prop("#size-cells", cells(2))
+        p.prop("ranges")
+        p.prop("nvidia,num-lanes", cells(4 if i == 1 else 1))
+        p.prop("status", string("okay" if i == 1 else "disabled"))
+
+    host1x = t.node(root, "host1x@50000000", "host1x")
+    host1x.prop("compatible", string("nvidia,tegra210-host1x",
+                                     "simple-bus"))
+    host1x.prop("reg", cells(0, 0x50000000, 0, 0x34000))
+    host1x.prop("interrupts", cells(0, 65, 4, 0, 67, 4))
+    host1x.prop("clocks", refs(Ref("tegra_car", 28)))
+    host1x.prop("#address-cells", cells(2))
+    host1x.prop("#size-cells", cells(2))
+    host1x.prop("ranges", cells(0, 0x54000000, 0, 0x54000000,
+                                0, 0x01000000))
+    for name, label, compat, irq, clk in (
+            ("dpaux@54040000", "dpaux1", "nvidia,tegra210-dpaux", 11, 207),
+            ("vi@54080000", "vi", "nvidia,tegra210-vi", 69, 20),
+            ("tsec@54100000", "tsec", "nvidia,tegra210-tsec", 50, 83),
+            ("dc@54200000", "dc_a", "nvidia,tegra210-dc", 73, 27),
+            ("dc@54240000", "dc_b", "nvidia,tegra210-dc", 74, 26),
+            ("dsi@54300000", "dsi_a", "nvidia,tegra210-dsi", 0, 48),
+            ("dsi@54400000", "dsi_b", "nvidia,tegra210-dsi", 0, 82),
+            ("vic@54340000", "vic", "nvidia,tegra210-vic", 0, 178),
+            ("nvjpg@54380000", "nvjpg", "nvidia,tegra210-nvjpg", 0, 195),
+            ("nvdec@54480000", "nvdec", "nvidia,tegra210-nvdec", 0, 194),
+            ("nvenc@544c0000", "nvenc", "nvidia,tegra210-nvenc", 0, 219),
+            ("tsec@54500000", "tsecb", "nvidia,tegra210-tsec", 0, 206),
+            ("sor@54540000", "sor0", "nvidia,tegra210-sor", 76, 182),
+            ("sor@54580000", "sor1", "nvidia,tegra210-sor1", 76, 183),
+            ("dpaux@545c0000", "dpaux", "nvidia,tegra124-dpaux", 159, 181),
+            ("isp@54600000", "isp_a", "nvidia,tegra210-isp", 71, 23),
+            ("isp@54680000", "isp_b", "nvidia,tegra210-isp", 70, 3)):
+        n = t.node(host1x, name, label)
+        n.prop("compatible", string(compat))
+        n.prop("reg", cells(0, int(name.split("@")[1], 16), 0, 0x40000))
+        if irq != 0:
+            n.prop("interrupts", cells(0, irq, 4))
+        n.prop("clocks", refs(Ref("tegra_car", clk)))
+        n.prop("resets", refs(Ref("tegra_car", clk)))
+        n.prop("iommus", refs(Ref("mc", 14)))
+        n.prop("status", string("disabled" if "isp" in name else "okay"))
+        if name.startswith("vi@"):
+            n.prop("#address-cells", cells(1))
+            n.prop("#size-cells", cells(0))
+            for p in range(6):
+                csi = t.node(n, "port@%d" % p)
+                csi.prop("reg", cells(p))
+                ep = t.node(csi, "endpoint")
+                ep.prop("bus-width", cells(2))
+
+    gpu = t.node(root, "gpu@57000000", "gpu")
+    gpu.prop("compatible", string("nvidia,gm20b"))
+    gpu.prop("reg", cells(0, 0x57000000, 0, 0x01000000,
+                          0, 0x58000000, 0, 0x01000000))
+    gpu.prop("interrupts", cells(0, 157, 4, 0, 158, 4))
+    gpu.prop("interrupt-names", string("stall", "nonstall"))
+    gpu.prop("clocks", refs(Ref("tegra_car", 184), Ref("tegra_car", 241)))
+    gpu.prop("clock-names", string("gpu", "pwr"))
+    gpu.prop("iommus", refs(Ref("mc", 31)))
+    gpu.prop("status", string("okay"))
+
+    gic = t.node(root, "interrupt-controller@50041000", "gic")
+    gic.prop("compatible", string("arm,gic-400"))
+    gic.prop("#interrupt-cells", cells(3))
+    gic.prop("interrupt-controller")
+    gic.prop("reg", cells(0, 0x50041000, 0, 0x1000, 0, 0x50042000,
+                          0, 0x2000, 0, 0x50044000, 0, 0x2000,
+                          0, 0x50046000, 0, 0x2000))
+    gic.prop("interrupts", cells(1, 9, 0xf04))
+    gic.prop("interrupt-parent", refs(Ref("gic")))
+
+    lic = t.node(root, "interrupt-controller@60004000", "lic")
+    lic.prop("compatible", string("nvidia,tegra210-ictlr"))
+    lic.prop("reg", cells(0, 0x60004000, 0, 0x40, 0, 0x60004100, 0, 0x40,
+                          0, 0x60004200, 0, 0x40, 0, 0x60004300, 0, 0x40,
+                          0, 0x60004400, 0, 0x40, 0, 0x60004500, 0, 0x40))
+    lic.prop("interrupt-controller")
+    lic.prop("#interrupt-cells", cells(3))
+    lic.prop("interrupt-parent", refs(Ref("gic")))
+
+    timer = t.node(root, "timer@60005000", "tegra_timer")
+    timer.prop("compatible", string("nvidia,tegra210-timer",
+                                    "nvidia,tegra20-timer"))
+    timer.prop("reg", cells(0, 0x60005000, 0, 0x400))
+    timer.prop("interrupts", cells(*sum(([0, i, 4] for i in
+                                          (156, 0, 1, 41, 42, 121, 152,
+                                           153, 154, 155, 176, 177, 178,
+                                           179)), [])))
+    timer.prop("clocks", refs(Ref("tegra_car", 5)))
+
+    car = t.node(root, "clock@60006000", "tegra_car")
+    car.prop("compatible", string("nvidia,tegra210-car"))
+    car.prop("reg", cells(0, 0x60006000, 0, 0x1000))
+    car.prop("#clock-cells", cells(1))
+    car.prop("#reset-cells", cells(1))
+
+    flow = t.node(root, "flow-controller@60007000", "flow")
+    flow.prop("compatible", string("nvidia,tegra210-flowctrl"))
+    flow.prop("reg", cells(0, 0x60007000, 0, 0x1000))
+
+    gpio = t.node(root, "gpio@6000d000", "gpio")
+    gpio.prop("compatible", string("nvidia,tegra210-gpio",
+                                   "nvidia,tegra30-gpio"))
+    gpio.prop("reg", cells(0, 0x6000d000, 0, 0x1000))
+    gpio.prop("interrupts", cells(*sum(([0, i, 4] for i in
+                                         (32, 33, 34, 35, 55, 87, 89,
+                                          125)), [])))
+    gpio.prop("#gpio-cells", cells(2))
+    gpio.prop("gpio-controller")
+    gpio.prop("#interrupt-cells", cells(2))
+    gpio.prop("interrupt-controller")
+    for i, pin in enumerate(("usb_vbus_en0", "pex_l0_rst", "wifi_en")):
+        h = t.node(gpio, "%s-hog" % pin)
+        h.prop("gpio-hog")
+        h.prop("gpios", cells(200 + i * 8, 0))
+        h.prop("output-high")
+        h.prop("line-name", string(pin))
+
+    apbdma = t.node(root, "dma@60020000", "apbdma")
+    apbdma.prop("compatible", string("nvidia,tegra210-apbdma",
+                                     "nvidia,tegra148-apbdma"))
+    apbdma.prop("reg", cells(0, 0x60020000, 0, 0x1400))
+    apbdma.prop("interrupts", cells(*sum(([0, 104 + i, 4]
+                                           for i in range(32)), [])))
+    apbdma.prop("clocks", refs(Ref("tegra_car", 34)))
+    apbdma.prop("#dma-cells", cells(1))
+
+    pinmux(t, root, pins)
+
+    for i, base in enumerate((0x70006000, 0x70006040, 0x70006200,
+                              0x70006300)):
+        label = "uart%s" % "abcd"[i]
+        u = t.node(root, "serial@%x" % base, label)
+        u.prop("compatible", string("nvidia,tegra210-uart",
+                                    "nvidia,tegra20-uart"))
+        u.prop("reg", cells(0, base, 0, 0x40))
+        u.prop("reg-shift", cells(2))
+        u.prop("interrupts", cells(0, (36, 37, 46, 90)[i], 4))
+        u.prop("clocks", refs(Ref("tegra_car", (6, 7, 55, 65)[i])))
+        u.prop("resets", refs(Ref("tegra_car", (6, 7, 55, 65)[i])))
+        u.prop("dmas", refs(Ref("apbdma", 8 + i), Ref("apbdma", 8 + i)))
+        u.prop("dma-names", string("rx", "tx"))
+        u.prop("status", string("okay" if i == 0 else "disabled"))
+        aliases.prop("serial%d" % i, string(u.path()))
+
+    pwm = t.node(root, "pwm@7000a000", "pwm")
+    pwm.prop("compatible", string("nvidia,tegra210-pwm",
+                                  "nvidia,tegra20-pwm"))
+    pwm.prop("reg", cells(0, 0x7000a000, 0, 0x100))
+    pwm.prop("#pwm-cells", cells(2))
+    pwm.prop("clocks", refs(Ref("tegra_car", 17)))
+
+    i2c_bases = (0x7000c000, 0x7000c400, 0x7000c500, 0x7000c700,
+                 0x7000d000, 0x7000d100)
+    for i, base in enumerate(i2c_bases):
+        bus = t.node(root, "i2c@%x" % base, "gen%d_i2c" % (i + 1))
+        bus.prop("compatible", string("nvidia,tegra210-i2c",
+                                      "nvidia,tegra114-i2c"))
+        bus.prop("reg", cells(0, base, 0, 0x100))
+        bus.prop("interrupts", cells(0, (38, 84, 92, 120, 53, 63)[i], 4))
+        bus.prop("#address-cells", cells(1))
+        bus.prop("#size-cells", cells(0))
+        bus.prop("clocks", refs(Ref("tegra_car", (12, 54, 67, 103, 47,
+                                                  166)[i])))
+        bus.prop("clock-names", string("div-clk"))
+        bus.prop("clock-frequency", cells(400000 if i != 4 else 1000000))
+        bus.prop("status", string("okay"))
+        aliases.prop("i2c%d" % i, string(bus.path()))
+        if i == 4:
+            pmic = t.node(bus, "pmic@3c", "max77620")
+            pmic.prop("compatible", string("maxim,max77620"))
+            pmic.prop("reg", cells(0x3c))
+            pmic.prop("interrupts", cells(0, 86, 4))
+            pmic.prop("#interrupt-cells", cells(2))
+            pmic.prop("interrupt-controller")
+            pmic.prop("#gpio-cells", cells(2))
+            pmic.prop("gpio-controller")
+            regulators(t, pmic, 4, 9)
+            continue
+        for d in range(i2c_devs):
+            addr = 0x10 + d * 7 + i
+            dev = t.node(bus, "sensor@%x" % addr)
+            dev.prop("compatible", string("ti,tmp451" if d % 2 else
+                                          "nxp,pca9539"))
+            dev.prop("reg", cells(addr))
+            dev.prop("vcc-supply", refs(Ref("max77620_ldo%d" % (d % 9))))
+            dev.prop("status", string("okay" if d % 3 else "disabled"))
+
+    pmc = t.node(root, "pmc@7000e400", "pmc")
+    pmc.prop("compatible", string("nvidia,tegra210-pmc"))
+    pmc.prop("reg", cells(0, 0x7000e400, 0, 0x400))
+    pmc.prop("clocks", refs(Ref("tegra_car", 5), Ref("tegra_car", 12)))
+    pmc.prop("clock-names", string("pclk", "clk32k_in"))
+    pmc.prop("nvidia,invert-interrupt")
+    pmc.prop("nvidia,suspend-mode", cells(0))
+    pmc.prop("nvidia,cpu-pwr-good-time", cells(0))
+    pmc.prop("nvidia,cpu-pwr-off-time", cells(0))
+    pmc.prop("nvidia,core-pwr-good-time", cells(4587, 3876))
+    pmc.prop("nvidia,core-pwr-off-time", cells(39065))
+    pmc.prop("nvidia,core-power-req-active-high")
+    pmc.prop("nvidia,sys-clock-req-active-high")
+    pgs = t.node(pmc, "powergates")
+    for name, clk in (("venc", 20), ("vic", 178), ("nvdec", 194),
+                      ("nvjpg", 195), ("aud", 198), ("dfd", 201),
+                      ("ve2", 219), ("sor", 182), ("disa", 27),
+                      ("disb", 26), ("xusba", 89), ("xusbb", 90),
+                      ("xusbc", 91), ("pcie", 70), ("sata", 124)):
+        pg = t.node(pgs, name, "pd_%s" % name)
+        pg.prop("clocks", refs(Ref("tegra_car", clk)))
+        pg.prop("resets", refs(Ref("tegra_car", clk)))
+        pg.prop("#power-domain-cells", cells(0))
+
+    fuse = t.node(root, "fuse@7000f800", "fuse")
+    fuse.prop("compatible", string("nvidia,tegra210-efuse"))
+    fuse.prop("reg", cells(0, 0x7000f800, 0, 0x400))
+    fuse.prop("clocks", refs(Ref("tegra_car", 39)))
+
+    mc = t.node(root, "memory-controller@70019000", "mc")
+    mc.prop("compatible", string("nvidia,tegra210-mc"))
+    mc.prop("reg", cells(0, 0x70019000, 0, 0x1000))
+    mc.prop("clocks", refs(Ref("tegra_car", 32)))
+    mc.prop("interrupts", cells(0, 77, 4))
+    mc.prop("#iommu-cells", cells(1))
+
+    emc_tables(t, root, rates, emc_words)
+
+    soctherm = t.node(root, "thermal-sensor@700e2000", "soctherm")
+    soctherm.prop("compatible", string("nvidia,tegra210-soctherm"))
+    soctherm.prop("reg", cells(0, 0x700e2000, 0, 0x600, 0, 0x60006000,
+                               0, 0x400))
+    soctherm.prop("#thermal-sensor-cells", cells(1))
+    throttle = t.node(soctherm, "throttle-cfgs")
+    for name in ("heavy", "light"):
+        th = t.node(throttle, name, "throttle_%s" % name)
+        th.prop("nvidia,priority", cells(100 if name == "heavy" else 80))
+        th.prop("nvidia,cpu-throt-percent", cells(85 if name == "heavy"
+                                                  else 50))
+        th.prop("#cooling-cells", cells(2))
+
+    xusb = t.node(root, "padctl@7009f000", "padctl")
+    xusb.prop("compatible", string("nvidia,tegra210-xusb-padctl"))
+    xusb.prop("reg", cells(0, 0x7009f000, 0, 0x1000))
+    pads = t.node(xusb, "pads")
+    for pad, lanes in (("usb2", 4), ("hsic", 1), ("pcie", 7),
+                       ("sata", 1)):
+        p = t.node(pads, pad)
+        p.prop("clocks", refs(Ref("tegra_car", 209)))
+        p.prop("status", string("okay"))
+        ls = t.node(p, "lanes")
+        for l in range(lanes):
+            lane = t.node(ls, "%s-%d" % (pad, l), "%s_lane%d" % (pad, l))
+            lane.prop("nvidia,function", string("xusb" if pad != "sata"
+                                                else "sata"))
+            lane.prop("#phy-cells", cells(0))
+            lane.prop("status", string("okay" if l < 2 else "disabled"))
+    ports = t.node(xusb, "ports")
+    for p in range(4):
+        port = t.node(ports, "usb2-%d" % p)
+        port.prop("mode", string("otg" if p == 0 else "host"))
+        port.prop("vbus-supply", refs(Ref("max77620_sd%d" % (p % 4))))
+        port.prop("status", string("okay"))
+        port = t.node(ports, "usb3-%d" % p)
+        port.prop("nvidia,usb2-companion", cells(p))
+        port.prop("status", string("okay" if p < 2 else "disabled"))
+
+    for i, base in enumerate((0x700b0000, 0x700b0200, 0x700b0400,
+                              0x700b0600)):
+        s = t.node(root, "sdhci@%x" % base, "sdhci%d" % i)
+        s.prop("compatible", string("nvidia,tegra210-sdhci",
+                                    "nvidia,tegra124-sdhci"))
+        s.prop("reg", cells(0, base, 0, 0x200))
+        s.prop("interrupts", cells(0, (14, 15, 19, 31)[i], 4))
+        s.prop("clocks", refs(Ref("tegra_car", (14, 9, 69, 15)[i])))
+        s.prop("clock-names", string("sdhci"))
+        s.prop("resets", refs(Ref("tegra_car", (14, 9, 69, 15)[i])))
+        s.prop("reset-names", string("sdhci"))
+        s.prop("bus-width", cells(8 if i == 3 else 4))
+        s.prop("non-removable") if i == 3 else None
+        s.prop("status", string("okay" if i in (0, 3) else "disabled"))
+        aliases.prop("sdhci%d" % i, string(s.path()))
+
+    aconnect = t.node(root, "aconnect@702c0000", "aconnect")
+    aconnect.prop("compatible", string("nvidia,tegra210-aconnect"))
+    aconnect.prop("clocks", refs(Ref("tegra_car", 198),
+                                 Ref("tegra_car", 199)))
+    aconnect.prop("#address-cells", cells(1))
+    aconnect.prop("#size-cells", cells(1))
+    aconnect.prop("ranges", cells(0x702c0000, 0, 0x702c0000, 0x40000))
+    adma = t.node(aconnect, "dma@702e2000", "adma")
+    adma.prop("compatible", string("nvidia,tegra210-adma"))
+    adma.prop("reg", cells(0x702e2000, 0x2000))
+    adma.prop("#dma-cells", cells(1))
+    agic = t.node(aconnect, "agic@702f9000", "agic")
+    agic.prop("compatible", string("nvidia,tegra210-agic"))
+    agic.prop("#interrupt-cells", cells(3))
+    agic.prop("interrupt-controller")
+    agic.prop("reg", cells(0x702f9000, 0x1000, 0x702fa000, 0x2000))
+    ahub = t.node(aconnect, "ahub@702d0800", "ahub")
+    ahub.prop("compatible", string("nvidia,tegra210-axbar"))
+    ahub.prop("reg", cells(0x702d0800, 0x800))
+    ahub.prop("#address-cells", cells(1))
+    ahub.prop("#size-cells", cells(1))
+    for kind, count, base, stride in (("admaif", 1, 0x702d0000, 0x800),
+                                      ("i2s", 5, 0x702d1000, 0x100),
+                                      ("sfc", 4, 0x702d2000, 0x200),
+                                      ("amx", 2, 0x702d3000, 0x100),
+                                      ("adx", 2, 0x702d3800, 0x100),
+                                      ("dmic", 3, 0x702d4000, 0x100),
+                                      ("mixer", 1, 0x702dbb00, 0x800),
+                                      ("mvc", 2, 0x702da000, 0x200)):
+        for k in range(count):
+            n = t.node(ahub, "%s@%x" % (kind, base + k * stride),
+                       "tegra_%s%d" % (kind, k + 1))
+            n.prop("compatible", string("nvidia,tegra210-%s" % kind))
+            n.prop("reg", cells(base + k * stride, stride))
+            n.prop("nvidia,ahub-%s-id" % kind, cells(k))
+            n.prop("status", string("okay"))
+
+    for i, base in enumerate((0x7000d400, 0x7000d600, 0x7000d800,
+                              0x7000da00, 0x70410000)):
+        s = t.node(root, "spi@%x" % base, "spi%d" % (i + 1))
+        s.prop("compatible", string("nvidia,tegra210-spi" if i < 4 else
+                                    "nvidia,tegra210-qspi"))
+        s.prop("reg", cells(0, base, 0, 0x200 if i < 4 else 0x1000))
+        s.prop("#address-cells", cells(1))
+        s.prop("#size-cells", cells(0))
+        s.prop("spi-max-frequency", cells(25000000))
+        s.prop("status", string("okay" if i == 4 else "disabled"))
+        if i == 4:
+            flash = t.node(s, "flash@0")
+            flash.prop("compatible", string("jedec,spi-nor"))
+            flash.prop("reg", cells(0))
+            flash.prop("spi-max-frequency", cells(104000000))
+
+    for i, base in enumerate((0x7d000000, 0x7d004000)):
+        u = t.node(root, "usb@%x" % base, "usb%d" % (i + 1))
+        u.prop("compatible", string("nvidia,tegra210-ehci",
+                                    "nvidia,tegra30-ehci", "usb-ehci"))
+        u.prop("reg", cells(0, base, 0, 0x4000))
+        u.prop("interrupts", cells(0, (20, 21)[i], 4))
+        u.prop("phy_type", string("utmi"))
+        u.prop("dr_mode", string("otg" if i == 0 else "host"))
+        u.prop("status", string("okay"))
+
+    cpus = t.node(root, "cpus")
+    cpus.prop("#address-cells", cells(1))
+    cpus.prop("#size-cells", cells(0))
+    for i in range(4 + (4 if cpus_a53 else 0)):
+        c = t.node(cpus, "cpu@%d" % (i if i < 4 else 0x100 + i - 4),
+                   "cpu%d" % i)
+        c.prop("device_type", string("cpu"))
+        c.prop("compatible", string("arm,cortex-a57" if i < 4 else
+                                    "arm,cortex-a53"))
+        c.prop("reg", cells(i if i < 4 else 0x100 + i - 4))
+        c.prop("enable-method", string("psci"))
+        c.prop("clocks", refs(Ref("tegra_car", 126)))
+        c.prop("clock-names", string("cpu_g"))
+        c.prop("cpu-idle-states", refs(Ref("cpu_sleep")))
+        c.prop("#cooling-cells", cells(2))
+    idle = t.node(cpus, "idle-states")
+    idle.prop("entry-method", string("psci"))
+    sleep = t.node(idle, "cpu-sleep", "cpu_sleep")
+    sleep.prop("compatible", string("arm,idle-state"))
+    sleep.prop("arm,psci-suspend-param", cells(0x40000007))
+    sleep.prop("entry-latency-us", cells(100))
+    sleep.prop("exit-latency-us", cells(30))
+    sleep.prop("min-residency-us", cells(1000))
+    sleep.prop("local-timer-stop")
+
+    psci = t.node(root, "psci")
+    psci.prop("compatible", string("arm,psci-1.0", "arm,psci-0.2"))
+    psci.prop("method", string("smc"))
+
+    arch = t.node(root, "timer")
+    arch.prop("compatible", string("arm,armv8-timer"))
+    arch.prop("interrupts", cells(1, 13, 0xf08, 1, 14, 0xf08,
+                                  1, 11, 0xf08, 1, 10, 0xf08))
+    arch.prop("interrupt-parent", refs(Ref("gic")))
+
+    pmu = t.node(root, "pmu")
+    pmu.prop("compatible", string("arm,armv8-pmuv3"))
+    pmu.prop("interrupts", cells(0, 144, 4, 0, 145, 4, 0, 146, 4,
+                                 0, 147, 4))
+    pmu.prop("interrupt-affinity", refs(Ref("cpu0"), Ref("cpu1"),
+                                        Ref("cpu2"), Ref("cpu3")))
+
+    thermal(t, root, (("cpu", 0), ("gpu", 2), ("mem", 1), ("pllx", 3)))
+
+    keys = t.node(root, "gpio-keys")
+    keys.prop("compatible", string("gpio-keys"))
+    for name, code, pin in (("power", 116, 189), ("volume-up", 115, 190),
+                            ("volume-down", 114, 191)):
+        k = t.node(keys, name)
+        k.prop("label", string(name.title()))
+        k.prop("gpios", refs(Ref("gpio", pin, 1)))
+        k.prop("linux,code", cells(code))
+        k.prop("debounce-interval", cells(30))
+        k.prop("wakeup-source") if name == "power" else None
+
+    fixed = t.node(root, "regulators")
+    fixed.prop("compatible", string("simple-bus"))
+    fixed.prop("#address-cells", cells(1))
+    fixed.prop("#size-cells", cells(0))
+    for i, (name, uv) in enumerate((("vdd-5v0-sys", 5000000),
+                                    ("vdd-3v3-sys", 3300000),
+                                    ("vdd-5v0-hdmi", 5000000),
+                                    ("vdd-1v8-sys", 1800000),
+                                    ("vdd-usb-vbus", 5000000),
+                                    ("vdd-fan", 5000000))):
+        r = t.node(fixed, "regulator@%d" % i, "vdd_fixed%d" % i)
+        r.prop("compatible", string("regulator-fixed"))
+        r.prop("reg", cells(i))
+        r.prop("regulator-name", string(name))
+        r.prop("regulator-min-microvolt", cells(uv))
+        r.prop("regulator-max-microvolt", cells(uv))
+        r.prop("regulator-always-on") if i < 2 else None
+
+    t.resolve(symbols)
+    return t
+
+
+def main():
+    out = sys.argv[1] if len(sys.argv) > 1 else os.path.dirname(
+        os.path.abspath(__file__))
+
+    # Shield TV: the full pinmux, eleven EMC rates, a few
+    # /memreserve/ entries and __symbols__ for overlays.
+    darcy = tegra210(("nvidia,darcy", "nvidia,tegra210"),
+                     "NVIDIA Shield TV", len(PINS),
+                     (40800, 68000, 102000, 204000, 408000, 665600,
+                      800000, 1065600, 1331200, 1600000, 1862400),
+                     180, 2, True, False)
+    # Jetson TX1: part of the pinmux, fewer rates, more I2C
+    # devices, no __symbols__.
+    jetson = tegra210(("nvidia,p2371-2180", "nvidia,p2180",
+                       "nvidia,tegra210"),
+                      "NVIDIA Jetson TX1 Developer Kit", 96,
+                      (204000, 408000, 800000, 1600000), 120, 6, False,
+                      True)
+
+    for name, tree, memreserve in (
+            ("synthetic-tegra210-darcy.dtb", darcy,
+             ((0x80000000, 0x10000), (0xfed00000, 0x100000))),
+            ("synthetic-tegra210-p2371-2180.dtb", jetson, ())):
+        with open(os.path.join(out, name), "wb") as f:
+            f.write(tree.blob(memreserve))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,691 @@
+/*
+ * libfdt benchmark and fuzzer, built for and run on the host.
+ *
+ * Copyright (C) 2018 Andrei Warkentin <andrey.warkentin@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <lib.h>
+#include <libfdt.h>
+#include <fdt_index.h>
+
+/*
+ * Generated trees are written into 'tree' and then copied
+ * into a buffer of exactly their size, like the DTBs read
+ * in, so a sanitizer build catches libfdt reading past
+ * the end of a blob.
+ */
+#define FDTT_TREE_SIZE         MB(4)
+#define FDTT_INDEX_SIZE        MB(8)
+#define FDTT_SMALL_NODES       64
+#define FDTT_DEVS_PER_BUS      63
+#define FDTT_BENCH_ROUNDS      256
+#define FDTT_PATH_MAX          256
+#define FDTT_MAX_EDITS         4
+#define FDTT_HEADER_WORDS      (sizeof(struct fdt_header) / sizeof(uint32_t))
+#define FDTT_ABSENT            "shieldtv,fdt-test-absent"
+#define FDTT_DEFAULT_MUTATIONS 100000
+
+/*
+ * The property names generated trees use, at the
+ * offsets below in the strings block.
+ */
+static const char fdtt_strings[] =
+	"compatible\0reg\0status\0#address-cells\0#size-cells\0interrupts";
+#define FDTT_STR_COMPATIBLE    0
+#define FDTT_STR_REG           11
+#define FDTT_STR_STATUS        15
+#define FDTT_STR_ADDRESS_CELLS 22
+#define FDTT_STR_SIZE_CELLS    37
+#define FDTT_STR_INTERRUPTS    49
+
+typedef struct fdtt_gen {
+	uint8_t *buf;
+	size_t size;
+	size_t pos;
+	bool_t full;
+} fdtt_gen;
+
+/*
+ * Lookup cost in a tree of 'nodes' nodes and 'size' bytes,
+ * with libfdt and with an fdt_index (0 if it couldn't be
+ * built). The path is the last node's and the property
+ * its last one. The compatible and device_type lookups
+ * are for values that aren't there, so libfdt walks the
+ * whole tree.
+ */
+typedef struct fdtt_times {
+	unsigned long nodes;
+	unsigned long size;
+	unsigned long path_ns;
+	unsigned long getprop_ns;
+	unsigned long dtype_ns;
+	unsigned long compat_ns;
+	unsigned long index_path_ns;
+	unsigned long index_dtype_ns;
+	unsigned long index_compat_ns;
+} fdtt_times;
+
+typedef struct fdtt_edit {
+	uint32_t *word;
+	uint32_t old;
+} fdtt_edit;
+
+static uint8_t *tree;
+static uint8_t *index_mem;
+static unsigned long accepted;
+
+static const unsigned long bench_nodes[] = {
+	256, 1024, 4096, 16384
+};
+
+/*
+ * Sizes and offsets just past the end of or just
+ * before wrapping around are where the bugs are.
+ */
+static const uint32_t fdtt_values[] = {
+	0, 1, 4, 0x7fffffff, 0x80000000, 0xfffffffc, 0xffffffff
+};
+
+static unsigned long
+fdtt_ns(uint64_t ns)
+{
+	return ns / FDTT_BENCH_ROUNDS;
+}
+
+static void
+fdtt_put(fdtt_gen *g,
+	 const void *data,
+	 size_t len)
+{
+	size_t padded = A_UP(len, FDT_TAGSIZE);
+
+	if (g->full || g->pos + padded > g->size) {
+		g->full = true;
+		return;
+	}
+
+	memcpy(g->buf + g->pos, data, len);
+	memset(g->buf + g->pos + len, 0, padded - len);
+	g->pos += padded;
+}
+
+static void
+fdtt_u32(fdtt_gen *g,
+	 uint32_t v)
+{
+	v = cpu_to_fdt32(v);
+	fdtt_put(g, &v, sizeof(v));
+}
+
+static void
+fdtt_begin_node(fdtt_gen *g,
+		const char *name)
+{
+	fdtt_u32(g, FDT_BEGIN_NODE);
+	fdtt_put(g, name, strlen(name) + 1);
+}
+
+static void
+fdtt_prop(fdtt_gen *g,
+	  uint32_t nameoff,
+	  const void *data,
+	  size_t len)
+{
+	fdtt_u32(g, FDT_PROP);
+	fdtt_u32(g, len);
+	fdtt_u32(g, nameoff);
+	fdtt_put(g, data, len);
+}
+
+static void
+fdtt_prop_u32(fdtt_gen *g,
+	      uint32_t nameoff,
+	      uint32_t v)
+{
+	v = cpu_to_fdt32(v);
+	fdtt_prop(g, nameoff, &v, sizeof(v));
+}
+
+static void
+fdtt_prop_string(fdtt_gen *g,
+		 uint32_t nameoff,
+		 const char *s)
+{
+	fdtt_prop(g, nameoff, s, strlen(s) + 1);
+}
+
+/*
+ * Writes out a tree of buses with FDTT_DEVS_PER_BUS devices
+ * each, and about 'nodes' nodes, the way dtc lays one out.
+ * Adding that many nodes with fdt_add_subnode would move
+ * the whole tree around every time.
+ */
+static int
+fdtt_generate(void *buf,
+	      size_t size,
+	      unsigned long nodes)
+{
+	unsigned long b;
+	unsigned long d;
+	uint32_t addr;
+	uint32_t cells[3];
+	uint32_t struct_off;
+	uint32_t strings_off;
+	char name[32];
+	fdtt_gen g = { buf, size, sizeof(struct fdt_header), false };
+	unsigned long buses = max(nodes / (FDTT_DEVS_PER_BUS + 1), 1UL);
+
+	/*
+	 * An empty memory reservation map.
+	 */
+	fdtt_u32(&g, 0);
+	fdtt_u32(&g, 0);
+	fdtt_u32(&g, 0);
+	fdtt_u32(&g, 0);
+
+	struct_off = g.pos;
+	fdtt_begin_node(&g, "");
+	fdtt_prop_u32(&g, FDTT_STR_ADDRESS_CELLS, 1);
+	fdtt_prop_u32(&g, FDTT_STR_SIZE_CELLS, 1);
+	fdtt_prop_string(&g, FDTT_STR_COMPATIBLE, "shieldtv,fdt-test");
+	for (b = 0; b < buses; b++) {
+		scnprintf(name, sizeof(name), "bus@%lx", b << 24);
+		fdtt_begin_node(&g, name);
+		fdtt_prop_u32(&g, FDTT_STR_ADDRESS_CELLS, 1);
+		fdtt_prop_u32(&g, FDTT_STR_SIZE_CELLS, 1);
+		fdtt_prop_string(&g, FDTT_STR_COMPATIBLE, "simple-bus");
+		for (d = 0; d < FDTT_DEVS_PER_BUS; d++) {
+			addr = (b << 24) | (d << 12);
+			scnprintf(name, sizeof(name), "dev@%x", addr);
+			fdtt_begin_node(&g, name);
+			scnprintf(name, sizeof(name),
+				  "nvidia,tegra210-dev%lu", d);
+			fdtt_prop_string(&g, FDTT_STR_COMPATIBLE, name);
+			cells[0] = cpu_to_fdt32(addr);
+			cells[1] = cpu_to_fdt32(PAGE_SIZE);
+			fdtt_prop(&g, FDTT_STR_REG, cells,
+				  2 * sizeof(uint32_t));
+			cells[0] = 0;
+			cells[1] = cpu_to_fdt32(d);
+			cells[2] = cpu_to_fdt32(4);
+			fdtt_prop(&g, FDTT_STR_INTERRUPTS, cells,
+				  sizeof(cells));
+			fdtt_prop_string(&g, FDTT_STR_STATUS, "okay");
+			fdtt_u32(&g, FDT_END_NODE);
+		}
+		fdtt_u32(&g, FDT_END_NODE);
+	}
+	fdtt_u32(&g, FDT_END_NODE);
+	fdtt_u32(&g, FDT_END);
+
+	strings_off = g.pos;
+	fdtt_put(&g, fdtt_strings, sizeof(fdtt_strings));
+	if (g.full) {
+		return -1;
+	}
+
+	fdt_set_magic(buf, FDT_MAGIC);
+	fdt_set_totalsize(buf, g.pos);
+	fdt_set_off_dt_struct(buf, struct_off);
+	fdt_set_off_dt_strings(buf, strings_off);
+	fdt_set_off_mem_rsvmap(buf, sizeof(struct fdt_header));
+	fdt_set_version(buf, 17);
+	fdt_set_last_comp_version(buf, 16);
+	fdt_set_boot_cpuid_phys(buf, 0);
+	fdt_set_size_dt_strings(buf, sizeof(fdtt_strings));
+	fdt_set_size_dt_struct(buf, strings_off - struct_off);
+	return 0;
+}
+
+static char *
+fdtt_bench_tree(const void *fdt,
+		fdtt_times *b)
+{
+	int i;
+	int len;
+	int node;
+	int last = 0;
+	int depth = 0;
+	int offset;
+	uint64_t t;
+	arena a;
+	fdt_index idx;
+	char path[FDTT_PATH_MAX];
+	const char *prop = FDTT_ABSENT;
+
+	b->size = fdt_totalsize(fdt);
+	b->nodes = 0;
+	/*
+	 * fdt_next_node steps past the root's end with
+	 * depth going negative.
+	 */
+	for (node = 0; node >= 0 && depth >= 0;
+	     node = fdt_next_node(fdt, node, &depth)) {
+		last = node;
+		b->nodes++;
+	}
+
+	if (fdt_get_path(fdt, last, path, sizeof(path)) != 0) {
+		return "no path to last node";
+	}
+
+	for (offset = fdt_first_property_offset(fdt, last);
+	     offset >= 0;
+	     offset = fdt_next_property_offset(fdt, offset)) {
+		fdt_getprop_by_offset(fdt, offset, &prop, NULL);
+	}
+
+	t = host_ns();
+	for (i = 0; i < FDTT_BENCH_ROUNDS; i++) {
+		node = fdt_path_offset(fdt, path);
+	}
+	b->path_ns = fdtt_ns(host_ns() - t);
+	if (node != last) {
+		return "fdt_path_offset failed";
+	}
+
+	t = host_ns();
+	for (i = 0; i < FDTT_BENCH_ROUNDS; i++) {
+		fdt_getprop(fdt, last, prop, &len);
+	}
+	b->getprop_ns = fdtt_ns(host_ns() - t);
+
+	t = host_ns();
+	for (i = 0; i < FDTT_BENCH_ROUNDS; i++) {
+		node = fdt_node_offset_by_dtype(fdt, -1, FDTT_ABSENT);
+	}
+	b->dtype_ns = fdtt_ns(host_ns() - t);
+	if (node != -FDT_ERR_NOTFOUND) {
+		return "fdt_node_offset_by_dtype failed";
+	}
+
+	t = host_ns();
+	for (i = 0; i < FDTT_BENCH_ROUNDS; i++) {
+		node = fdt_node_offset_by_compatible(fdt, -1, FDTT_ABSENT);
+	}
+	b->compat_ns = fdtt_ns(host_ns() - t);
+	if (node != -FDT_ERR_NOTFOUND) {
+		return "fdt_node_offset_by_compatible failed";
+	}
+
+	/*
+	 * Not being able to index a tree this big
+	 * isn't a failure.
+	 */
+	arena_init_buffer(&a, index_mem, FDTT_INDEX_SIZE);
+	if (fdt_index_build(&idx, fdt, &a) != 0) {
+		return NULL;
+	}
+
+	t = host_ns();
+	for (i = 0; i < FDTT_BENCH_ROUNDS; i++) {
+		node = fdt_index_path_offset(&idx, fdt, path);
+	}
+	b->index_path_ns = fdtt_ns(host_ns() - t);
+	if (node != last) {
+		return "fdt_index_path_offset failed";
+	}
+
+	t = host_ns();
+	for (i = 0; i < FDTT_BENCH_ROUNDS; i++) {
+		node = fdt_index_node_offset_by_dtype(&idx, fdt, -1,
+						      FDTT_ABSENT);
+	}
+	b->index_dtype_ns = fdtt_ns(host_ns() - t);
+	if (node != -FDT_ERR_NOTFOUND) {
+		return "fdt_index_node_offset_by_dtype failed";
+	}
+
+	t = host_ns();
+	for (i = 0; i < FDTT_BENCH_ROUNDS; i++) {
+		node = fdt_index_node_offset_by_compatible(&idx, fdt, -1,
+							   FDTT_ABSENT);
+	}
+	b->index_compat_ns = fdtt_ns(host_ns() - t);
+	if (node != -FDT_ERR_NOTFOUND) {
+		return "fdt_index_node_offset_by_compatible failed";
+	}
+
+	return NULL;
+}
+
+/*
+ * A generated tree of about 'nodes' nodes, in a buffer
+ * of its own that it fills exactly.
+ */
+static void *
+fdtt_generate_copy(unsigned long nodes)
+{
+	void *fdt;
+
+	if (fdtt_generate(tree, FDTT_TREE_SIZE, nodes) != 0) {
+		return NULL;
+	}
+
+	fdt = host_alloc(fdt_totalsize(tree));
+	if (fdt != NULL) {
+		memcpy(fdt, tree, fdt_totalsize(tree));
+	}
+
+	return fdt;
+}
+
+static void
+fdtt_print(const char *name,
+	   fdtt_times *b)
+{
+	printk("fdt: %s: %lu nodes 0x%lx bytes: getprop %lu ns\n",
+	       name, b->nodes, b->size, b->getprop_ns);
+	printk("fdt: %s: path %lu/%lu dtype %lu/%lu compat %lu/%lu\n",
+	       name, b->path_ns, b->index_path_ns, b->dtype_ns,
+	       b->index_dtype_ns, b->compat_ns, b->index_compat_ns);
+}
+
+static char *
+fdtt_bench(const char *name,
+	   const void *fdt)
+{
+	char *err;
+	fdtt_times b;
+
+	memset(&b, 0, sizeof(b));
+	err = fdtt_bench_tree(fdt, &b);
+	if (err == NULL) {
+		fdtt_print(name, &b);
+	}
+
+	return err;
+}
+
+static char *
+fdtt_bench_generated(void)
+{
+	char *err;
+	void *fdt;
+	unsigned long s;
+	char name[32];
+
+	for (s = 0; s < ELES(bench_nodes); s++) {
+		fdt = fdtt_generate_copy(bench_nodes[s]);
+		if (fdt == NULL) {
+			return "generated tree too big";
+		}
+
+		scnprintf(name, sizeof(name), "generated-%lu", bench_nodes[s]);
+		err = fdtt_bench(name, fdt);
+		host_free(fdt);
+		if (err != NULL) {
+			return err;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Once fdt_check_header is happy, whatever libfdt
+ * hands back from walking the structure block has
+ * to be inside the blob. Property names go through
+ * fdt_string, which trusts nameoff, so they aren't
+ * looked at.
+ */
+static char *
+fdtt_walk(const void *fdt)
+{
+	int i;
+	int len;
+	int count;
+	int node;
+	int offset;
+	int depth = 0;
+	uint64_t address;
+	uint64_t size;
+	const char *p;
+	const char *start = fdt;
+	const char *end = start + fdt_totalsize(fdt);
+
+	count = fdt_num_mem_rsv(fdt);
+	for (i = 0; i < count; i++) {
+		if (fdt_get_mem_rsv(fdt, i, &address, &size) != 0) {
+			return "memreserve entry not found";
+		}
+	}
+
+	for (node = 0; node >= 0 && depth >= 0;
+	     node = fdt_next_node(fdt, node, &depth)) {
+		p = fdt_get_name(fdt, node, &len);
+		if (p != NULL && (p < start || p + len >= end)) {
+			return "node name outside the blob";
+		}
+
+		for (offset = fdt_first_property_offset(fdt, node);
+		     offset >= 0;
+		     offset = fdt_next_property_offset(fdt, offset)) {
+			p = fdt_getprop_by_offset(fdt, offset, NULL, &len);
+			if (p != NULL &&
+			    (len < 0 || p < start || p + len > end)) {
+				return "property outside the blob";
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static uint32_t
+fdtt_value(uint32_t old,
+	   size_t size)
+{
+	switch (host_below(4)) {
+	case 0:
+		return cpu_to_fdt32(fdtt_values[host_below(ELES(fdtt_values))]);
+	case 1:
+		return old ^ BIT(host_below(32));
+	case 2:
+		return cpu_to_fdt32(fdt32_to_cpu(old) + host_below(16) - 8);
+	default:
+		return cpu_to_fdt32(host_below(size + 64));
+	}
+}
+
+/*
+ * Overwrites a few words of fdt (header fields half the
+ * time) with values likely to upset it, checks the result
+ * if fdt_check_header lets it through, and puts the words
+ * back.
+ */
+static char *
+fdtt_mutate(void *fdt,
+	    size_t room)
+{
+	long e;
+	long edits;
+	char *err = NULL;
+	size_t size = fdt_totalsize(fdt);
+	fdtt_edit edit[FDTT_MAX_EDITS];
+
+	edits = 1 + host_below(FDTT_MAX_EDITS);
+	for (e = 0; e < edits; e++) {
+		edit[e].word = (uint32_t *) fdt +
+			(host_below(2) == 0 ? host_below(FDTT_HEADER_WORDS) :
+			 host_below(size / sizeof(uint32_t)));
+		edit[e].old = *edit[e].word;
+		*edit[e].word = fdtt_value(edit[e].old, size);
+	}
+
+	/*
+	 * Whether totalsize fits is the caller's to check.
+	 */
+	if (fdt_check_header(fdt) == 0 && fdt_totalsize(fdt) <= room) {
+		accepted++;
+		err = fdtt_walk(fdt);
+	}
+
+	/*
+	 * Backwards, in case a word was picked twice.
+	 */
+	for (e = edits - 1; e >= 0; e--) {
+		*edit[e].word = edit[e].old;
+	}
+
+	return err;
+}
+
+/*
+ * Alternates between mutating fdt and a small generated
+ * tree, each in a buffer of exactly its size.
+ */
+static char *
+fdtt_fuzz(const void *fdt,
+	  unsigned long mutations,
+	  unsigned long *done)
+{
+	char *err = NULL;
+	void *fuzz;
+	void *small;
+	size_t size = fdt_totalsize(fdt);
+
+	fuzz = host_alloc(size);
+	small = fdtt_generate_copy(FDTT_SMALL_NODES);
+	if (fuzz == NULL || small == NULL) {
+		err = "out of memory";
+		goto out;
+	}
+
+	memcpy(fuzz, fdt, size);
+	if (fdtt_walk(fuzz) != NULL || fdtt_walk(small) != NULL) {
+		err = "unmutated tree failed";
+		goto out;
+	}
+
+	for (*done = 0; *done < mutations; (*done)++) {
+		if ((*done & 1) == 0) {
+			err = fdtt_mutate(fuzz, size);
+		} else {
+			err = fdtt_mutate(small, fdt_totalsize(small));
+		}
+
+		if (err != NULL) {
+			break;
+		}
+	}
+
+out:
+	host_free(small);
+	host_free(fuzz);
+	return err;
+}
+
+static int
+fdtt_file(const char *name,
+	  unsigned long mutations,
+	  uint64_t seed)
+{
+	char *err;
+	void *fdt;
+	size_t size;
+	unsigned long done = 0;
+
+	fdt = host_read_file(name, &size);
+	if (fdt == NULL) {
+		printk("fdt: %s: can't read\n", name);
+		return -1;
+	}
+
+	if (size < sizeof(struct fdt_header) ||
+	    fdt_check_header(fdt) != 0 ||
+	    fdt_totalsize(fdt) > size) {
+		printk("fdt: %s: bad FDT\n", name);
+		host_free(fdt);
+		return -1;
+	}
+
+	err = fdtt_bench(name, fdt);
+	if (err != NULL) {
+		printk("fdt: %s: %s\n", name, err);
+		host_free(fdt);
+		return -1;
+	}
+
+	host_srand(seed);
+	accepted = 0;
+	err = fdtt_fuzz(fdt, mutations, &done);
+	host_free(fdt);
+	if (err != NULL) {
+		printk("fdt: %s: mutation %lu (seed %lu): %s\n",
+		       name, done, seed, err);
+		return -1;
+	}
+
+	printk("fdt: %s: %lu mutations, %lu passed the header\n",
+	       name, mutations, accepted);
+	return 0;
+}
+
+/*
+ * Times lookups in each DTB named and in generated trees of
+ * growing size, then fuzzes fdt_check_header and the walks
+ * it guards with mutated copies of each DTB and of a small
+ * generated tree.
+ */
+int
+main(int argc,
+     char **argv)
+{
+	int i;
+	char *err;
+	int failed = 0;
+	uint64_t seed = 1;
+	unsigned long mutations = FDTT_DEFAULT_MUTATIONS;
+
+	for (i = 1; i + 1 < argc && argv[i][0] == '-'; i += 2) {
+		if (!strcmp(argv[i], "-m")) {
+			mutations = simple_strtoull(argv[i + 1], NULL, 0);
+		} else if (!strcmp(argv[i], "-s")) {
+			seed = simple_strtoull(argv[i + 1], NULL, 0);
+		} else {
+			break;
+		}
+	}
+
+	if (i == argc || argv[i][0] == '-') {
+		printk("usage: %s [-m mutations] [-s seed] dtb...\n",
+		       argv[0]);
+		return 2;
+	}
+
+	tree = host_alloc(FDTT_TREE_SIZE);
+	index_mem = host_alloc(FDTT_INDEX_SIZE);
+	if (tree == NULL || index_mem == NULL) {
+		printk("fdt: out of memory\n");
+		return 1;
+	}
+
+	err = fdtt_bench_generated();
+	if (err != NULL) {
+		printk("fdt: bench: %s\n", err);
+		return 1;
+	}
+
+	for (; i < argc; i++) {
+		if (fdtt_file(argv[i], mutations, seed) != 0) {
+			failed = 1;
+		}
+	}
+
+	return failed;
+}
@@ -0,0 +1,178 @@
+/*
+ * Host side of host-built tests.
+ *
+ * Copyright (C) 2018 Andrei Warkentin <andrey.warkentin@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <lib.h>
+#include <lmb.h>
+
+#define HOST_CLOCK_MONOTONIC 1
+#define HOST_O_RDONLY        0
+#define HOST_SEEK_SET        0
+#define HOST_SEEK_END        2
+
+struct host_timespec {
+	long tv_sec;
+	long tv_nsec;
+};
+
+long write(int fd, const void *buf, size_t count);
+long read(int fd, void *buf, size_t count);
+int open(const char *path, int flags, ...);
+int close(int fd);
+long lseek(int fd, long offset, int whence);
+void *malloc(size_t size);
+void free(void *p);
+void exit(int status) __noreturn;
+int clock_gettime(int clock, struct host_timespec *ts);
+
+/*
+ * main.c isn't built, so the global allocator lives here.
+ */
+struct lmb lmb;
+
+static uint64_t rand_state = 1;
+
+void
+printk(char *fmt, ...)
+{
+	int len;
+	va_list args;
+	char buf[PRINTK_MAX];
+
+	va_start(args, fmt);
+	len = vscnprintf(buf, sizeof(buf), fmt, args);
+	va_end(args);
+
+	write(1, buf, len);
+}
+
+void
+printk_ring_init(void *ring,
+		 size_t size)
+{
+}
+
+bool_t
+printk_pending(void)
+{
+	return false;
+}
+
+void
+printk_flush(void)
+{
+}
+
+void
+printk_sync(void)
+{
+}
+
+void
+host_exit(int status)
+{
+	exit(status);
+}
+
+uint64_t
+host_ns(void)
+{
+	struct host_timespec ts;
+
+	clock_gettime(HOST_CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+void *
+host_alloc(size_t size)
+{
+	/*
+	 * malloc(0) may return NULL.
+	 */
+	return malloc(max(size, (size_t) 1));
+}
+
+void
+host_free(void *p)
+{
+	free(p);
+}
+
+void *
+host_read_file(const char *path,
+	       size_t *size)
+{
+	int fd;
+	long len;
+	long got;
+	size_t done = 0;
+	uint8_t *buf = NULL;
+
+	fd = open(path, HOST_O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	len = lseek(fd, 0, HOST_SEEK_END);
+	if (len < 0 || lseek(fd, 0, HOST_SEEK_SET) != 0) {
+		goto out;
+	}
+
+	buf = host_alloc(len);
+	if (buf == NULL) {
+		goto out;
+	}
+
+	while (done < len) {
+		got = read(fd, buf + done, len - done);
+		if (got <= 0) {
+			host_free(buf);
+			buf = NULL;
+			goto out;
+		}
+
+		done += got;
+	}
+
+	*size = len;
+out:
+	close(fd);
+	return buf;
+}
+
+void
+host_srand(uint64_t seed)
+{
+	rand_state = seed != 0 ? seed : 1;
+}
+
+uint64_t
+host_rand(void)
+{
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 7;
+	rand_state ^= rand_state << 17;
+	return rand_state;
+}
+
+unsigned long
+host_below(unsigned long n)
+{
+	return host_rand() % n;
+}
@@ -0,0 +1,49 @@
+/*
+ * Host side of host-built tests.
+ *
+ * Copyright (C) 2018 Andrei Warkentin <andrey.warkentin@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef HOST_H
+#define HOST_H
+
+#include <defs.h>
+
+/*
+ * The firmware headers clash with the C library's,
+ * so the little that's needed from it goes through here.
+ */
+void __noreturn host_exit(int status);
+uint64_t host_ns(void);
+void *host_alloc(size_t size);
+void host_free(void *p);
+
+/*
+ * The whole file, in a buffer of exactly its size
+ * (host_free it), or NULL.
+ */
+void *host_read_file(const char *path,
+		     size_t *size);
+
+/*
+ * xorshift64, so runs are repeatable from the seed.
+ */
+void host_srand(uint64_t seed);
+uint64_t host_rand(void);
+unsigned long host_below(unsigned long n);
+
+#endif /* HOST_H */
@@ -0,0 +1,66 @@
+/*
+ * lib.h for host-built tests.
+ *
+ * Copyright (C) 2018 Andrei Warkentin <andrey.warkentin@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef LIB_H
+#define LIB_H
+
+/*
+ * Found ahead of ../lib.h, so that the allocator and libfdt
+ * sources build unchanged. Same interface, but printk goes
+ * to stdout and a BUG exits instead of spinning.
+ */
+#include <defs.h>
+#include <arm_defs.h>
+#include <string.h>
+#include <ctype.h>
+#include <vsprintf.h>
+#include <host.h>
+
+#define PRINTK_MAX 512
+
+void printk(char *fmt, ...);
+void printk_ring_init(void *ring,
+		      size_t size);
+bool_t printk_pending(void);
+void printk_flush(void);
+void printk_sync(void);
+
+#define BUG() do {						\
+		printk("%s:%u BUG ()\n", __FILE__, __LINE__);	\
+		host_exit(2);					\
+	} while(0);
+
+#define BUG_ON(condition) do {						\
+		if (unlikely(condition)) {				\
+			printk("%s:%u BUG (%s)\n", __FILE__, __LINE__, \
+			       S(condition));				\
+			host_exit(2);					\
+		}							\
+	} while(0)
+
+#define BUG_ON_EX(condition, fmt, ...) do {				\
+		if (unlikely(condition)) {				\
+			printk("%s:%u BUG (%s): " fmt "\n", __FILE__, __LINE__, \
+			       S(condition), ## __VA_ARGS__);		\
+			host_exit(2);					\
+		}							\
+	} while(0)
+
+#endif /* LIB_H */
@@ -0,0 +1,1053 @@
+/*
+ * LMB self-test and benchmark, built for and run on the host.
+ *
+ * Copyright (C) 2018 Andrei Warkentin <andrey.warkentin@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <lib.h>
+#include <lmb.h>
+#include <slab.h>
+
+/*
+ * The allocator keeps its tables in the memory it manages, so
+ * it gets a real pool, added as two ranges with a hole in between.
+ */
+#define LMBT_POOL_SIZE      MB(32)
+#define LMBT_HOLE           0x10000
+#define LMBT_MAX_LIVE       16384
+#define LMBT_STRESS_LIVE    1024
+#define LMBT_MAX_TABLES     64
+#define LMBT_CHECK_INTERVAL 128
+#define LMBT_MODEL_INTERVAL 4096
+#define LMBT_BENCH_ROUNDS   16384
+#define LMBT_BENCH_STEPS    5
+#define LMBT_DEFAULT_OPS    2000000
+#define LMBT_SLAB_CACHES    4
+#define LMBT_SLAB_LIVE      4096
+
+typedef struct lmbt_alloc {
+	phys_addr_t base;
+	size_t size;
+	/*
+	 * From lmb_reserve rather than lmb_alloc, so
+	 * not tracked and only freed with lmb_free.
+	 */
+	bool_t reserved;
+} lmbt_alloc;
+
+typedef struct lmbt_range {
+	phys_addr_t base;
+	size_t size;
+} lmbt_range;
+
+typedef struct lmbt_slab {
+	size_t size;
+	size_t align;
+	/*
+	 * Relative to the pool, 0 for anywhere.
+	 */
+	size_t below;
+	slab_cache cache;
+	unsigned long live;
+} lmbt_slab;
+
+typedef struct lmbt_obj {
+	uint8_t *p;
+	lmbt_slab *slab;
+	uint8_t fill;
+} lmbt_obj;
+
+typedef struct lmbt_gap_sum {
+	size_t total;
+	unsigned long count;
+	bool_t unindexed;
+} lmbt_gap_sum;
+
+/*
+ * Return true to stop the walk.
+ */
+typedef bool_t (*lmbt_gap_fn)(phys_addr_t base,
+			      phys_addr_t end,
+			      void *arg);
+
+static uint8_t lmbt_pool[LMBT_POOL_SIZE] __align(MB(2));
+static phys_addr_t pool;
+static lmbt_alloc live[LMBT_MAX_LIVE];
+static unsigned long nr_live;
+static unsigned long checks;
+
+/*
+ * The reference model: a bit per byte of the pool, set if it
+ * is handed out (or is the hole), and nothing else. Whatever
+ * the allocator does has to agree with it.
+ */
+static uint64_t model[LMBT_POOL_SIZE / 64];
+static size_t model_free;
+
+/*
+ * Where the allocator's own tables are, which the model
+ * treats as handed out. They are the only regions taken from
+ * the allocator's region trees, and only when one of them
+ * grew or the allocation table moved.
+ */
+static lmbt_range tables[LMBT_MAX_TABLES];
+static unsigned long nr_tables;
+static struct {
+	unsigned long memory;
+	unsigned long reserved;
+	void *allocs;
+	unsigned long nodes;
+} tables_seen;
+
+/*
+ * The restricted one stands in for a DMA cache
+ * that must stay below 4GB.
+ */
+static lmbt_slab slabs[LMBT_SLAB_CACHES] = {
+	{ 8, 8, 0 },
+	{ 24, 64, 0 },
+	{ 2000, 32, 4 * SLAB_CHUNK_SIZE },
+	{ 3000, PAGE_SIZE, 0 },
+};
+static lmbt_obj objs[LMBT_SLAB_LIVE];
+static unsigned long nr_objs;
+
+static const unsigned long bench_steps[LMBT_BENCH_STEPS] = {
+	64, 256, 1024, 4096, LMBT_MAX_LIVE
+};
+
+static lmb_tag_t
+lmbt_tag(unsigned long i)
+{
+	char c = '0' + i;
+
+	return _LMB_TAG('L', 'M', 'T', c);
+}
+
+static bool_t
+lmbt_is_table(lmb_tag_t tag)
+{
+	return tag == LMB_TAG("LMBR") || tag == LMB_TAG("LMBX") ||
+		tag == LMB_TAG("LMBA");
+}
+
+static bool_t
+model_inside(phys_addr_t base,
+	     size_t size)
+{
+	return base >= pool && size <= LMBT_POOL_SIZE &&
+		base - pool <= LMBT_POOL_SIZE - size;
+}
+
+/*
+ * Sets or clears [base, base + size), which must all be the
+ * other way around.
+ */
+static void
+model_mark(phys_addr_t base,
+	   size_t size,
+	   bool_t used)
+{
+	size_t bit = base - pool;
+	size_t end = bit + size;
+
+	if (used) {
+		model_free -= size;
+	} else {
+		model_free += size;
+	}
+
+	while (bit < end) {
+		uint64_t mask;
+		size_t n = min(end - bit, 64 - bit % 64);
+
+		mask = n == 64 ? ~0UL : (BIT(n) - 1) << (bit % 64);
+		model[bit / 64] ^= mask;
+		bit += n;
+	}
+}
+
+static bool_t
+model_is_free(phys_addr_t base,
+	      size_t size)
+{
+	size_t bit = base - pool;
+	size_t end = bit + size;
+
+	if (!model_inside(base, size)) {
+		return false;
+	}
+
+	while (bit < end) {
+		uint64_t mask;
+		size_t n = min(end - bit, 64 - bit % 64);
+
+		mask = n == 64 ? ~0UL : (BIT(n) - 1) << (bit % 64);
+		if ((model[bit / 64] & mask) != 0) {
+			return false;
+		}
+		bit += n;
+	}
+
+	return true;
+}
+
+/*
+ * First clear (or set) bit at or after 'bit'.
+ */
+static size_t
+model_next(size_t bit,
+	   bool_t used)
+{
+	while (bit < LMBT_POOL_SIZE) {
+		uint64_t w = model[bit / 64];
+
+		if (!used) {
+			w = ~w;
+		}
+
+		w &= ~0UL << (bit % 64);
+		if (w != 0) {
+			return A_DOWN(bit, 64) + __builtin_ctzll(w);
+		}
+
+		bit = A_DOWN(bit, 64) + 64;
+	}
+
+	return LMBT_POOL_SIZE;
+}
+
+/*
+ * Calls fn for every free run in the model.
+ */
+static void
+model_gaps(lmbt_gap_fn fn,
+	   void *arg)
+{
+	size_t end;
+	size_t bit = 0;
+
+	while ((bit = model_next(bit, false)) < LMBT_POOL_SIZE) {
+		end = model_next(bit, true);
+		if (fn(pool + bit, pool + end, arg)) {
+			return;
+		}
+
+		bit = end;
+	}
+}
+
+static bool_t
+model_fits(size_t size,
+	   size_t align,
+	   phys_addr_t max_addr)
+{
+	size_t end;
+	size_t bit = 0;
+	phys_addr_t b;
+	phys_addr_t e;
+
+	while ((bit = model_next(bit, false)) < LMBT_POOL_SIZE) {
+		if (max_addr != LMB_ALLOC_ANYWHERE && pool + bit >= max_addr) {
+			break;
+		}
+
+		end = model_next(bit, true);
+		b = A_UP(pool + bit, align);
+		e = pool + end;
+		if (max_addr != LMB_ALLOC_ANYWHERE) {
+			e = min(e, max_addr);
+		}
+
+		if (b < e && e - b >= size) {
+			return true;
+		}
+
+		bit = end;
+	}
+
+	return false;
+}
+
+static void
+lmbt_setup(void)
+{
+	lmb_init(&lmb);
+	nr_live = 0;
+	nr_tables = 0;
+	tables_seen.memory = lmb.memory.max;
+	tables_seen.reserved = lmb.reserved.max;
+	tables_seen.allocs = lmb.allocs.slot;
+	tables_seen.nodes = lmb.free.nr_nodes;
+
+	memset(model, 0, sizeof(model));
+	model_free = LMBT_POOL_SIZE;
+	model_mark(pool + LMBT_POOL_SIZE / 2 - LMBT_HOLE, LMBT_HOLE, true);
+
+	lmb_add(&lmb, pool, LMBT_POOL_SIZE / 2 - LMBT_HOLE,
+		_LMB_TAG('R', 'A', 'M', '0'));
+	lmb_add(&lmb, pool + LMBT_POOL_SIZE / 2, LMBT_POOL_SIZE / 2,
+		_LMB_TAG('R', 'A', 'M', '1'));
+}
+
+/*
+ * Called after every operation, as any of them may have
+ * grown the region trees, moved the allocation table or added
+ * extent nodes.
+ */
+static char *
+lmbt_tables_sync(void)
+{
+	unsigned long i;
+	struct lmb_property *p;
+
+	if (tables_seen.memory == lmb.memory.max &&
+	    tables_seen.reserved == lmb.reserved.max &&
+	    tables_seen.allocs == lmb.allocs.slot &&
+	    tables_seen.nodes == lmb.free.nr_nodes) {
+		return NULL;
+	}
+
+	tables_seen.memory = lmb.memory.max;
+	tables_seen.reserved = lmb.reserved.max;
+	tables_seen.allocs = lmb.allocs.slot;
+	tables_seen.nodes = lmb.free.nr_nodes;
+
+	for (i = 0; i < nr_tables; i++) {
+		model_mark(tables[i].base, tables[i].size, false);
+	}
+
+	nr_tables = 0;
+	for (p = lmb_region_first(&lmb.reserved); p != NULL;
+	     p = lmb_region_next(&lmb.reserved, p)) {
+		if (!lmbt_is_table(p->tag)) {
+			continue;
+		}
+
+		if (nr_tables == LMBT_MAX_TABLES) {
+			return "too many table regions";
+		}
+
+		if (!model_is_free(p->base, p->size)) {
+			return "tables overlap an allocation";
+		}
+
+		model_mark(p->base, p->size, true);
+		tables[nr_tables].base = p->base;
+		tables[nr_tables].size = p->size;
+		nr_tables++;
+	}
+
+	return NULL;
+}
+
+/*
+ * Walks the tree itself rather than through the accessors,
+ * so that a broken tree can't hide from them. Returns the
+ * height, or -1 with *err set.
+ */
+static int
+lmbt_check_tree(struct lmb_property *n,
+		struct lmb_property **prev,
+		unsigned long *count,
+		char **err)
+{
+	int l;
+	int r;
+	unsigned long before = *count;
+
+	if (n == NULL) {
+		return 0;
+	}
+
+	l = lmbt_check_tree(n->left, prev, count, err);
+	if (l < 0) {
+		return -1;
+	}
+
+	if (*prev != NULL) {
+		if ((*prev)->base + (*prev)->size > n->base) {
+			*err = "regions unsorted or overlapping";
+			return -1;
+		}
+
+		if ((*prev)->base + (*prev)->size == n->base &&
+		    (*prev)->tag == n->tag &&
+		    (*prev)->type == n->type) {
+			*err = "regions not coalesced";
+			return -1;
+		}
+	}
+
+	*prev = n;
+	(*count)++;
+	r = lmbt_check_tree(n->right, prev, count, err);
+	if (r < 0) {
+		return -1;
+	}
+
+	if (l - r > 1 || r - l > 1 || n->height != 1 + max(l, r)) {
+		*err = "region tree unbalanced";
+		return -1;
+	}
+
+	if (n->count != *count - before) {
+		*err = "region subtree count wrong";
+		return -1;
+	}
+
+	return n->height;
+}
+
+static char *
+lmbt_check_sorted(struct lmb_region *rgn)
+{
+	char *err = NULL;
+	unsigned long count = 0;
+	unsigned long spare = 0;
+	struct lmb_property *prev = NULL;
+	struct lmb_property *p;
+
+	if (lmbt_check_tree(rgn->root, &prev, &count, &err) < 0) {
+		return err;
+	}
+
+	if (count != rgn->cnt) {
+		return "region count mismatch";
+	}
+
+	for (p = rgn->spare; p != NULL; p = p->right) {
+		spare++;
+	}
+
+	if (count + spare != rgn->max) {
+		return "region nodes lost";
+	}
+
+	if (rgn->cnt != 0 &&
+	    lmb_region_at(rgn, rgn->cnt - 1) != prev) {
+		return "region index wrong";
+	}
+
+	return NULL;
+}
+
+static bool_t
+lmbt_gap_count(phys_addr_t base,
+	       phys_addr_t end,
+	       void *arg)
+{
+	lmbt_gap_sum *sum = arg;
+
+	sum->total += end - base;
+	sum->count++;
+	if (lmb_extents_largest_in(&lmb.free, base, end) != end - base) {
+		sum->unindexed = true;
+		return true;
+	}
+
+	return false;
+}
+
+/*
+ * Every free run in the model must be one extent, and with
+ * the totals equal, that's all the extents there are.
+ */
+static char *
+lmbt_check_model(void)
+{
+	lmbt_gap_sum sum = { 0 };
+
+	model_gaps(lmbt_gap_count, &sum);
+	if (sum.unindexed) {
+		return "free range missing from extents";
+	}
+
+	if (sum.count != lmb_extents_count(&lmb.free)) {
+		return "extent count mismatch";
+	}
+
+	return NULL;
+}
+
+/*
+ * The allocator's own invariants: sorted and coalesced
+ * regions, nothing reserved outside memory and the
+ * allocation table matching what was handed out.
+ */
+static char *
+lmbt_check(void)
+{
+	char *err;
+	unsigned long i;
+	unsigned long tracked = 0;
+	struct lmb_property *p;
+
+	checks++;
+
+	err = lmbt_check_sorted(&lmb.memory);
+	if (err == NULL) {
+		err = lmbt_check_sorted(&lmb.reserved);
+	}
+	if (err != NULL) {
+		return err;
+	}
+
+	for (p = lmb_region_first(&lmb.reserved); p != NULL;
+	     p = lmb_region_next(&lmb.reserved, p)) {
+		if (!lmb_is_known(&lmb, p->base, p->size)) {
+			return "reserved region outside memory";
+		}
+	}
+
+	for (i = 0; i < nr_live; i++) {
+		lmbt_alloc *a = &live[i];
+		const struct lmb_alloc_rec *rec;
+
+		p = lmb_overlaps_region(&lmb.reserved, a->base, a->size);
+		if (p == NULL) {
+			return "allocation not reserved";
+		}
+
+		if (a->base < p->base ||
+		    a->base + a->size > p->base + p->size) {
+			return "allocation not reserved";
+		}
+
+		if (a->reserved) {
+			continue;
+		}
+
+		tracked++;
+		rec = lmb_find_alloc(&lmb, a->base);
+		if (rec == NULL || rec->size != a->size) {
+			return "allocation not tracked";
+		}
+	}
+
+	if (tracked != lmb.allocs.cnt) {
+		return "tracked count mismatch";
+	}
+
+	return NULL;
+}
+
+static char *
+lmbt_alloc_op(void)
+{
+	char *err;
+	size_t size;
+	size_t align;
+	phys_addr_t base;
+	lmb_type_t type;
+	lmb_policy_t policy;
+	phys_addr_t max_addr = LMB_ALLOC_ANYWHERE;
+
+	size = 1 + host_below(host_below(16) == 0 ? MB(1) : 0x2000);
+	align = 1UL << host_below(17);
+	if (host_below(4) == 0) {
+		max_addr = pool + host_below(LMBT_POOL_SIZE);
+	}
+	policy = host_below(4);
+	type = host_below(2) ? LMB_BOOT : LMB_RUNTIME;
+
+	base = lmb_alloc_policy(&lmb, size, align, max_addr, type,
+				lmbt_tag(host_below(4)), policy);
+	size = A_UP(size, align);
+	err = lmbt_tables_sync();
+	if (err != NULL) {
+		return err;
+	}
+
+	if (base == 0) {
+		return model_fits(size, align, max_addr) ?
+			"alloc failed with room left" : NULL;
+	}
+
+	if ((base & (align - 1)) != 0) {
+		return "alloc misaligned";
+	}
+
+	if (max_addr != LMB_ALLOC_ANYWHERE && base + size > max_addr) {
+		return "alloc above max_addr";
+	}
+
+	if (!model_is_free(base, size)) {
+		return "alloc not free";
+	}
+
+	model_mark(base, size, true);
+	live[nr_live].base = base;
+	live[nr_live].size = size;
+	live[nr_live].reserved = false;
+	nr_live++;
+	return NULL;
+}
+
+static char *
+lmbt_free_op(void)
+{
+	long ret;
+	unsigned long i = host_below(nr_live);
+	lmbt_alloc a = live[i];
+
+	if (a.reserved) {
+		ret = lmb_free(&lmb, a.base, a.size, 1);
+	} else {
+		ret = lmb_free_addr(&lmb, a.base);
+	}
+
+	if (ret != 0) {
+		return "free failed";
+	}
+
+	model_mark(a.base, a.size, false);
+	live[i] = live[--nr_live];
+	return lmbt_tables_sync();
+}
+
+/*
+ * Frees the front, the tail or the middle of something, which
+ * leaves the rest allocated (and tracked, as one or two pieces).
+ */
+static char *
+lmbt_trim_op(void)
+{
+	size_t off;
+	size_t len;
+	lmbt_alloc *a = &live[host_below(nr_live)];
+
+	if (a->size < 2) {
+		return NULL;
+	}
+
+	off = host_below(a->size);
+	len = 1 + host_below(a->size - off);
+	if (off == 0 && len == a->size) {
+		len--;
+	}
+
+	if (off != 0 && off + len != a->size) {
+		if (nr_live == LMBT_MAX_LIVE) {
+			return NULL;
+		}
+
+		live[nr_live].base = a->base + off + len;
+		live[nr_live].size = a->size - off - len;
+		live[nr_live].reserved = a->reserved;
+	}
+
+	if (lmb_free(&lmb, a->base + off, len, 1) != 0) {
+		return "partial free failed";
+	}
+
+	model_mark(a->base + off, len, false);
+	if (off == 0) {
+		a->base += len;
+		a->size -= len;
+	} else if (off + len == a->size) {
+		a->size = off;
+	} else {
+		a->size = off;
+		nr_live++;
+	}
+
+	return lmbt_tables_sync();
+}
+
+static char *
+lmbt_reserve_op(void)
+{
+	long ret;
+	char *err;
+	phys_addr_t base = pool + host_below(LMBT_POOL_SIZE);
+	size_t size = 1 + host_below(0x4000);
+	lmb_type_t type = host_below(2) ? LMB_BOOT : LMB_RUNTIME;
+
+	ret = lmb_reserve(&lmb, base, size, type, lmbt_tag(host_below(4)));
+	err = lmbt_tables_sync();
+	if (err != NULL) {
+		return err;
+	}
+
+	if (ret < 0) {
+		return model_is_free(base, size) ?
+			"reserve refused free range" : NULL;
+	}
+
+	if (!model_is_free(base, size)) {
+		return "reserve not free";
+	}
+
+	model_mark(base, size, true);
+	live[nr_live].base = base;
+	live[nr_live].size = size;
+	live[nr_live].reserved = true;
+	nr_live++;
+	return NULL;
+}
+
+static char *
+lmbt_stress(unsigned long ops,
+	    unsigned long *done)
+{
+	char *err = NULL;
+	unsigned long i;
+
+	lmbt_setup();
+	for (i = 0; i < ops && err == NULL; i++) {
+		unsigned long op = host_below(100);
+
+		if (nr_live == 0 ||
+		    (op < 50 && nr_live < LMBT_STRESS_LIVE)) {
+			err = lmbt_alloc_op();
+		} else if (op < 90) {
+			err = lmbt_free_op();
+		} else if (op < 95) {
+			err = lmbt_trim_op();
+		} else if (nr_live < LMBT_STRESS_LIVE) {
+			err = lmbt_reserve_op();
+		}
+
+		if (err == NULL &&
+		    lmb_extents_total(&lmb.free) != model_free) {
+			err = "free total mismatch";
+		}
+
+		if (err == NULL && (i % LMBT_CHECK_INTERVAL) == 0) {
+			err = lmbt_check();
+		}
+
+		if (err == NULL && (i % LMBT_MODEL_INTERVAL) == 0) {
+			err = lmbt_check_model();
+		}
+
+		*done = i;
+	}
+
+	while (nr_live != 0 && err == NULL) {
+		err = lmbt_free_op();
+	}
+
+	if (err == NULL) {
+		err = lmbt_check();
+	}
+
+	if (err == NULL) {
+		err = lmbt_check_model();
+	}
+
+	if (err == NULL && lmb.allocs.cnt != 0) {
+		err = "allocations left after freeing all";
+	}
+
+	return err;
+}
+
+/*
+ * A new chunk is handed out from its start. It must be
+ * one tracked allocation with the cache's tag, where the
+ * model had nothing.
+ */
+static char *
+lmbt_slab_chunk(lmbt_slab *slab,
+		uint8_t *chunk)
+{
+	const struct lmb_alloc_rec *rec;
+
+	rec = lmb_find_alloc(&lmb, UN(chunk));
+	if (rec == NULL || rec->size != slab->cache.chunk_size ||
+	    rec->tag != slab->cache.tag || rec->type != LMB_BOOT) {
+		return "slab chunk not allocated";
+	}
+
+	if (!model_is_free(UN(chunk), rec->size)) {
+		return "slab chunk not free";
+	}
+
+	model_mark(UN(chunk), rec->size, true);
+	return NULL;
+}
+
+static char *
+lmbt_slab_alloc_op(void)
+{
+	char *err;
+	uint8_t *p;
+	lmbt_obj *o;
+	unsigned long chunks;
+	lmbt_slab *slab = &slabs[host_below(LMBT_SLAB_CACHES)];
+	slab_cache *c = &slab->cache;
+
+	chunks = c->nr_chunks;
+	p = slab_alloc(c);
+	err = lmbt_tables_sync();
+	if (err != NULL) {
+		return err;
+	}
+
+	if (p == NULL) {
+		if (c->free != NULL || chunks != c->nr_chunks) {
+			return "slab alloc failed with objects left";
+		}
+
+		return model_fits(c->chunk_size, max(c->align,
+						     (size_t) PAGE_SIZE),
+				  c->max_addr) ?
+			"slab alloc failed with room left" : NULL;
+	}
+
+	if (chunks != c->nr_chunks) {
+		err = lmbt_slab_chunk(slab, p);
+		if (err != NULL) {
+			return err;
+		}
+	}
+
+	if ((UN(p) & (slab->align - 1)) != 0) {
+		return "slab object misaligned";
+	}
+
+	if (c->max_addr != LMB_ALLOC_ANYWHERE &&
+	    UN(p) + slab->size > c->max_addr) {
+		return "slab object above max_addr";
+	}
+
+	if (c->nr_free + slab->live + 1 != c->nr_objs) {
+		return "slab object count mismatch";
+	}
+
+	o = &objs[nr_objs++];
+	o->p = p;
+	o->slab = slab;
+	o->fill = host_rand();
+	memset(p, o->fill, slab->size);
+	slab->live++;
+	return NULL;
+}
+
+/*
+ * Objects never overlap, so anything else writing
+ * to one shows up here.
+ */
+static char *
+lmbt_slab_free_op(void)
+{
+	size_t i;
+	unsigned long n = host_below(nr_objs);
+	lmbt_obj o = objs[n];
+
+	for (i = 0; i < o.slab->size; i++) {
+		if (o.p[i] != o.fill) {
+			return "slab object overwritten";
+		}
+	}
+
+	slab_free(&o.slab->cache, o.p);
+	o.slab->live--;
+	if (o.slab->cache.nr_free + o.slab->live !=
+	    o.slab->cache.nr_objs) {
+		return "slab object count mismatch";
+	}
+
+	objs[n] = objs[--nr_objs];
+	return NULL;
+}
+
+/*
+ * Random allocations and frees from a few slab caches,
+ * which are themselves checked against the model.
+ */
+static char *
+lmbt_slab_stress(unsigned long ops)
+{
+	char *err = NULL;
+	unsigned long i;
+	unsigned long chunks = 0;
+
+	lmbt_setup();
+	nr_objs = 0;
+	for (i = 0; i < LMBT_SLAB_CACHES; i++) {
+		lmbt_slab *slab = &slabs[i];
+
+		slab_cache_init(&slab->cache, slab->size, slab->align,
+				slab->below == 0 ? LMB_ALLOC_ANYWHERE :
+				pool + slab->below, lmbt_tag(i));
+		slab->live = 0;
+	}
+
+	for (i = 0; i < ops && err == NULL; i++) {
+		if (nr_objs == 0 ||
+		    (host_below(3) != 0 && nr_objs < LMBT_SLAB_LIVE)) {
+			err = lmbt_slab_alloc_op();
+		} else {
+			err = lmbt_slab_free_op();
+		}
+
+		if (err == NULL &&
+		    lmb_extents_total(&lmb.free) != model_free) {
+			err = "free total mismatch";
+		}
+	}
+
+	while (nr_objs != 0 && err == NULL) {
+		err = lmbt_slab_free_op();
+	}
+
+	for (i = 0; i < LMBT_SLAB_CACHES; i++) {
+		chunks += slabs[i].cache.nr_chunks;
+	}
+
+	if (err == NULL && chunks != lmb.allocs.cnt) {
+		err = "slab chunk count mismatch";
+	}
+
+	if (err == NULL) {
+		err = lmbt_check_model();
+	}
+
+	return err;
+}
+
+static char *
+lmbt_bench_fill(unsigned long count)
+{
+	size_t size;
+	phys_addr_t base;
+
+	while (nr_live < count) {
+		size = 1 + host_below(PAGE_SIZE / 4);
+		base = lmb_alloc_policy(&lmb, size, 8, LMB_ALLOC_ANYWHERE,
+					LMB_BOOT, lmbt_tag(host_below(2)),
+					LMB_POLICY_TOP_DOWN);
+		if (base == 0) {
+			return "bench alloc failed";
+		}
+
+		live[nr_live].base = base;
+		live[nr_live].size = A_UP(size, 8);
+		live[nr_live].reserved = false;
+		nr_live++;
+	}
+
+	return NULL;
+}
+
+/*
+ * Times freeing a random allocation and allocating
+ * one of the same size again, with a growing number
+ * of allocations outstanding.
+ */
+static char *
+lmbt_bench(void)
+{
+	char *err;
+	uint64_t t;
+	unsigned long i;
+	unsigned long s;
+	unsigned long k;
+	phys_addr_t base;
+	uint64_t alloc_ns;
+	uint64_t free_ns;
+
+	lmbt_setup();
+	for (s = 0; s < LMBT_BENCH_STEPS; s++) {
+		err = lmbt_bench_fill(bench_steps[s]);
+		if (err != NULL) {
+			return err;
+		}
+
+		alloc_ns = 0;
+		free_ns = 0;
+		for (k = 0; k < LMBT_BENCH_ROUNDS; k++) {
+			i = host_below(nr_live);
+
+			t = host_ns();
+			if (lmb_free_addr(&lmb, live[i].base) != 0) {
+				return "bench free failed";
+			}
+			free_ns += host_ns() - t;
+
+			t = host_ns();
+			base = lmb_alloc_policy(&lmb, live[i].size, 8,
+						LMB_ALLOC_ANYWHERE, LMB_BOOT,
+						lmbt_tag(k & 1),
+						LMB_POLICY_TOP_DOWN);
+			alloc_ns += host_ns() - t;
+			if (base == 0) {
+				return "bench alloc failed";
+			}
+			live[i].base = base;
+		}
+
+		printk("lmb: %lu live %lu regions: alloc %lu ns free %lu ns\n",
+		       nr_live, lmb.reserved.cnt,
+		       alloc_ns / LMBT_BENCH_ROUNDS,
+		       free_ns / LMBT_BENCH_ROUNDS);
+	}
+
+	return lmbt_check();
+}
+
+/*
+ * lmb_test <optional: ops> <optional: seed>
+ *
+ * Runs random allocations, reservations and frees, checking
+ * each against the model, then benchmarks the allocator.
+ */
+int
+main(int argc,
+     char **argv)
+{
+	char *err;
+	uint64_t seed = 1;
+	unsigned long done = 0;
+	unsigned long ops = LMBT_DEFAULT_OPS;
+
+	if (argc > 1) {
+		ops = simple_strtoull(argv[1], NULL, 0);
+	}
+
+	if (argc > 2) {
+		seed = simple_strtoull(argv[2], NULL, 0);
+	}
+
+	host_srand(seed);
+	pool = UN(lmbt_pool);
+
+	err = lmbt_stress(ops, &done);
+	if (err != NULL) {
+		printk("lmb: op %lu (seed %lu): %s\n", done, seed, err);
+		return 1;
+	}
+
+	printk("lmb: %lu ops, %lu checks passed\n", ops, checks);
+	err = lmbt_slab_stress(ops / 4);
+	if (err != NULL) {
+		printk("lmb: slab: %s\n", err);
+		return 1;
+	}
+
+	printk("lmb: %lu slab ops passed\n", ops / 4);
+	err = lmbt_bench();
+	if (err != NULL) {
+		printk("lmb: bench: %s\n", err);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,124 @@
+/*
+ * Warm-reboot image cache.
+ *
+ * DRAM is usually preserved across a "fastboot reboot-bootloader",
+ * so the last booted image is kept in a fixed LMB_RUNTIME carveout
+ * and verified again on the next boot. The host can then boot it
+ * again without re-sending it.
+ *
+ * Copyright (C) 2018 Andrei Warkentin <andrey.warkentin@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <lib.h>
+#include <crc32c.h>
+#include <image_cache.h>
+
+#define IMAGE_CACHE_HDR   ((image_cache_hdr *) VP(IMAGE_CACHE_BASE))
+#define IMAGE_CACHE_DATA  VP(IMAGE_CACHE_BASE + PAGE_SIZE)
+#define IMAGE_CACHE_SPACE (IMAGE_CACHE_SIZE - PAGE_SIZE)
+
+static bool_t image_cache_present;
+static bool_t image_cache_valid;
+
+static uint32_t
+image_cache_hdr_crc(const image_cache_hdr *hdr)
+{
+	return crc32c(0, hdr, offsetof(image_cache_hdr, hdr_crc));
+}
+
+void
+image_cache_init(struct lmb *lmb)
+{
+	uint8_t digest[SHA256_DIGEST_SIZE];
+	image_cache_hdr *hdr = IMAGE_CACHE_HDR;
+
+	if (lmb_reserve(lmb, IMAGE_CACHE_BASE, IMAGE_CACHE_SIZE,
+			LMB_RUNTIME, LMB_TAG("ICAC")) < 0) {
+		printk("Image cache: carveout unavailable\n");
+		return;
+	}
+
+	image_cache_present = true;
+
+	if (hdr->magic != IMAGE_CACHE_MAGIC ||
+	    hdr->hdr_crc != image_cache_hdr_crc(hdr) ||
+	    hdr->length > IMAGE_CACHE_SPACE) {
+		printk("Image cache: empty\n");
+		return;
+	}
+
+	sha256(IMAGE_CACHE_DATA, hdr->length, digest);
+	if (memcmp(digest, hdr->sha256, sizeof(digest)) != 0) {
+		printk("Image cache: corrupt\n");
+		hdr->magic = 0;
+		return;
+	}
+
+	image_cache_valid = true;
+	printk("Image cache: 0x%lx bytes last run at 0x%lx\n",
+	       hdr->length, hdr->load_addr);
+}
+
+const image_cache_hdr *
+image_cache_get(void)
+{
+	if (!image_cache_valid) {
+		return NULL;
+	}
+
+	return IMAGE_CACHE_HDR;
+}
+
+const void *
+image_cache_data(void)
+{
+	if (!image_cache_valid) {
+		return NULL;
+	}
+
+	return IMAGE_CACHE_DATA;
+}
+
+void
+image_cache_store(const void *image,
+		  size_t length,
+		  phys_addr_t load_addr)
+{
+	image_cache_hdr *hdr = IMAGE_CACHE_HDR;
+
+	if (!image_cache_present) {
+		return;
+	}
+
+	image_cache_valid = false;
+	hdr->magic = 0;
+
+	if (length > IMAGE_CACHE_SPACE) {
+		return;
+	}
+
+	if (image != IMAGE_CACHE_DATA) {
+		memcpy(IMAGE_CACHE_DATA, image, length);
+	}
+
+	sha256(IMAGE_CACHE_DATA, length, hdr->sha256);
+	hdr->length = length;
+	hdr->load_addr = load_addr;
+	hdr->magic = IMAGE_CACHE_MAGIC;
+	hdr->hdr_crc = image_cache_hdr_crc(hdr);
+	image_cache_valid = true;
+}
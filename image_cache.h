@@ -0,0 +1,60 @@
+/*
+ * Warm-reboot image cache.
+ *
+ * Copyright (C) 2018 Andrei Warkentin <andrey.warkentin@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef IMAGE_CACHE_H
+#define IMAGE_CACHE_H
+
+#include <lmb.h>
+#include <sha256.h>
+
+/*
+ * The carveout must be at the same place on every boot, as
+ * that's how we find it again after a warm reboot. This
+ * is above the 32-bit DMA window, so it does not compete with
+ * download buffers.
+ */
+#define IMAGE_CACHE_BASE 0x100000000UL
+#define IMAGE_CACHE_SIZE MB(64)
+
+#define IMAGE_CACHE_MAGIC 0x4548434143474d49UL /* "IMGCACHE" */
+
+typedef struct image_cache_hdr {
+	uint64_t magic;
+	uint64_t length;
+	/*
+	 * Where the image was last booted from.
+	 */
+	uint64_t load_addr;
+	uint8_t sha256[SHA256_DIGEST_SIZE];
+	/*
+	 * CRC32C over everything above, so a stale or
+	 * partially-overwritten header is never trusted.
+	 */
+	uint32_t hdr_crc;
+} image_cache_hdr;
+
+void image_cache_init(struct lmb *lmb);
+const image_cache_hdr *image_cache_get(void);
+const void *image_cache_data(void);
+void image_cache_store(const void *image,
+		       size_t length,
+		       phys_addr_t load_addr);
+
+#endif /* IMAGE_CACHE_H */
@@ -17,18 +17,108 @@
  * MA 02111-1307 USA
  */
 
-#include <defs.h>
-#include <vsprintf.h>
+#include <lib.h>
 #include <video_fb.h>
 
+/*
+ * Once printk_ring_init gives printk a ring, printk only appends
+ * to it, and printk_flush puts it on the screen. There's one
+ * writer (printk) and one reader (printk_flush), each only moving
+ * its own index, so neither ever waits for the other. The indices
+ * only grow, and head - tail is what's waiting.
+ */
+static char *printk_ring;
+static size_t printk_ring_size;
+static volatile size_t printk_head;
+static volatile size_t printk_tail;
+static bool_t printk_synchronous = true;
+
+void
+printk_ring_init(void *ring,
+		 size_t size)
+{
+	BUG_ON(size < PRINTK_MAX || (size & (size - 1)) != 0);
+
+	printk_ring = ring;
+	printk_ring_size = size;
+	printk_head = 0;
+	printk_tail = 0;
+	printk_synchronous = false;
+}
+
+bool_t
+printk_pending(void)
+{
+	return printk_head != printk_tail;
+}
+
+void
+printk_flush(void)
+{
+	size_t head = printk_head;
+	size_t tail = printk_tail;
+	size_t off;
+	size_t len;
+
+	if (head == tail) {
+		return;
+	}
+
+	while (tail != head) {
+		off = tail & (printk_ring_size - 1);
+		len = min(head - tail, printk_ring_size - off);
+		video_write(printk_ring + off, len);
+		tail += len;
+	}
+
+	printk_tail = tail;
+	video_flush();
+}
+
+void
+printk_sync(void)
+{
+	printk_flush();
+	printk_synchronous = true;
+}
+
+static void
+printk_append(char *s,
+	      size_t len)
+{
+	size_t head = printk_head;
+	size_t off = head & (printk_ring_size - 1);
+	size_t first = min(len, printk_ring_size - off);
+
+	if (len > printk_ring_size - (head - printk_tail)) {
+		/*
+		 * Nothing is dropped, the ring is drawn
+		 * right away instead.
+		 */
+		printk_flush();
+	}
+
+	memcpy(printk_ring + off, s, first);
+	memcpy(printk_ring, s + first, len - first);
+	printk_head = head + len;
+}
+
 void
 printk(char *fmt, ...)
 {
 	va_list list;
-	char buf[512];
+	char buf[PRINTK_MAX];
+	int len;
+
 	va_start(list, fmt);
-	vsnprintf(buf, sizeof(buf), fmt, list);
-	video_puts(buf);
+	len = vscnprintf(buf, sizeof(buf), fmt, list);
 	va_end(list);
-}
 
+	if (printk_synchronous) {
+		video_write(buf, len);
+		video_flush();
+		return;
+	}
+
+	printk_append(buf, len);
+}
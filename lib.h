@@ -26,15 +26,36 @@
 #include <ctype.h>
 #include <vsprintf.h>
 
+/*
+ * Longest message, anything past it is cut off.
+ */
+#define PRINTK_MAX 512
+
 void printk(char *fmt, ...);
 
+/*
+ * printk draws on the screen right away until it's given a ring
+ * (of a power of 2 size, at least PRINTK_MAX), after which it
+ * only appends there and printk_flush does the drawing, e.g.
+ * when there's nothing better to do. printk_sync flushes and
+ * goes back to drawing right away, for when nothing will call
+ * printk_flush anymore, like on a BUG.
+ */
+void printk_ring_init(void *ring,
+		      size_t size);
+bool_t printk_pending(void);
+void printk_flush(void);
+void printk_sync(void);
+
 #define BUG() do {						\
+		printk_sync();					\
 		printk("%s:%u BUG ()\n", __FILE__, __LINE__);	\
 		while (1);					\
 	} while(0);
 
 #define BUG_ON(condition) do {						\
 		if (unlikely(condition)) {				\
+			printk_sync();					\
 			printk("%s:%u BUG (%s)\n", __FILE__, __LINE__, \
 			       S(condition));				\
 			while (1);					\
@@ -43,6 +64,7 @@ void printk(char *fmt, ...);
 
 #define BUG_ON_EX(condition, fmt, ...) do {				\
 		if (unlikely(condition)) {				\
+			printk_sync();					\
 			printk("%s:%u BUG (%s): " fmt "\n", __FILE__, __LINE__, \
 			       S(condition), ## __VA_ARGS__);		\
 			while (1);					\
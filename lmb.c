@@ -22,8 +22,8 @@
 #include <lib.h>
 #include <lmb.h>
 
-static char *
-lmb_type(lmb_type_t type)
+char *
+lmb_type_name(lmb_type_t type)
 {
 	switch(type) {
 	case LMB_FREE:
@@ -43,24 +43,87 @@ void
 lmb_dump_all(struct lmb *lmb)
 {
 	unsigned long i;
+	struct lmb_property *p;
 
-	for (i=0; i < lmb->memory.cnt ;i++) {
+	for (i = 0, p = lmb_region_first(&lmb->memory); p != NULL;
+	     i++, p = lmb_region_next(&lmb->memory, p)) {
 		printk("    memory.reg[0x%lx]   = 0x%016lx-0x%016lx (%.4s, %s)\n", i,
-		       lmb->memory.region[i].base,
-		       lmb->memory.region[i].base +
-		       lmb->memory.region[i].size - 1,
-		       (char *) &lmb->memory.region[i].tag,
-		       lmb_type(lmb->memory.region[i].type));
+		       p->base, p->base + p->size - 1,
+		       (char *) &p->tag, lmb_type_name(p->type));
 	}
 
-	for (i=0; i < lmb->reserved.cnt ;i++) {
+	for (i = 0, p = lmb_region_first(&lmb->reserved); p != NULL;
+	     i++, p = lmb_region_next(&lmb->reserved, p)) {
 		printk("    reserved.reg[0x%lx] = 0x%016lx @ 0x%016lx (%.4s, %s)\n", i,
-		       lmb->reserved.region[i].base,
-		       lmb->reserved.region[i].base +
-		       lmb->reserved.region[i].size - 1,
-		       (char *) &lmb->reserved.region[i].tag,
-		       lmb_type(lmb->reserved.region[i].type));
+		       p->base, p->base + p->size - 1,
+		       (char *) &p->tag, lmb_type_name(p->type));
 	}
+
+	printk("    0x%lx free in 0x%lx extents, largest 0x%lx (%lu%% fragmented)\n",
+	       lmb_extents_total(&lmb->free),
+	       lmb_extents_count(&lmb->free),
+	       lmb_extents_largest(&lmb->free),
+	       lmb_fragmentation(lmb));
+	printk("    0x%lx tracked allocations\n", lmb->allocs.cnt);
+}
+
+static void
+lmb_map_region(struct lmb_region *rgn,
+	       lmb_map_entry *e)
+{
+	struct lmb_property *p;
+
+	for (p = lmb_region_first(rgn); p != NULL;
+	     p = lmb_region_next(rgn, p), e++) {
+		e->base = p->base;
+		e->size = p->size;
+		e->tag = p->tag;
+		e->type = p->type;
+	}
+}
+
+size_t
+lmb_map_size(struct lmb *lmb)
+{
+	return sizeof(lmb_map_hdr) + (lmb->memory.cnt +
+				      lmb->reserved.cnt) *
+		sizeof(lmb_map_entry);
+}
+
+/*
+ * Returns bytes written, or 0 if the buffer is too small.
+ */
+size_t
+lmb_map(struct lmb *lmb,
+	void *buffer,
+	size_t size)
+{
+	lmb_map_hdr *hdr = buffer;
+	size_t needed = lmb_map_size(lmb);
+
+	if (size < needed) {
+		return 0;
+	}
+
+	hdr->magic = LMB_MAP_MAGIC;
+	hdr->entry_size = sizeof(lmb_map_entry);
+	hdr->mem_count = lmb->memory.cnt;
+	hdr->res_count = lmb->reserved.cnt;
+	lmb_map_region(&lmb->memory, (lmb_map_entry *) (hdr + 1));
+	lmb_map_region(&lmb->reserved, (lmb_map_entry *) (hdr + 1) +
+		       lmb->memory.cnt);
+	return needed;
+}
+
+static void
+lmb_stats_update(struct lmb *lmb)
+{
+	struct lmb_stats *stats = &lmb->stats;
+
+	stats->used_max = max(stats->used_max, stats->ram -
+			      lmb_extents_total(&lmb->free));
+	stats->regions_max = max(stats->regions_max, lmb->reserved.cnt);
+	stats->allocs_max = max(stats->allocs_max, lmb->allocs.cnt);
 }
 
 static long
@@ -87,68 +150,372 @@ lmb_addrs_adjacent(phys_addr_t base1,
 	return 0;
 }
 
-static long
-lmb_regions_adjacent(struct lmb_region *rgn,
-		     unsigned long r1,
-		     unsigned long r2)
+static phys_addr_t
+lmb_align_up(phys_addr_t addr,
+	     size_t size)
+{
+	return (addr + size - 1) & ~(size - 1);
+}
+
+static int
+rgn_height(struct lmb_property *n)
 {
-	phys_addr_t base1 = rgn->region[r1].base;
-	size_t size1 = rgn->region[r1].size;
-	phys_addr_t base2 = rgn->region[r2].base;
-	size_t size2 = rgn->region[r2].size;
+	return n == NULL ? 0 : n->height;
+}
 
-	return lmb_addrs_adjacent(base1, size1, base2, size2);
+static unsigned long
+rgn_count(struct lmb_property *n)
+{
+	return n == NULL ? 0 : n->count;
 }
 
 static void
-lmb_remove_region(struct lmb_region *rgn,
-		  unsigned long r)
+rgn_update(struct lmb_property *n)
 {
-	unsigned long i;
+	n->height = 1 + max(rgn_height(n->left), rgn_height(n->right));
+	n->count = 1 + rgn_count(n->left) + rgn_count(n->right);
+}
+
+static struct lmb_property *
+rgn_rotate_right(struct lmb_property *n)
+{
+	struct lmb_property *l = n->left;
+
+	n->left = l->right;
+	l->right = n;
+	rgn_update(n);
+	rgn_update(l);
+	return l;
+}
+
+static struct lmb_property *
+rgn_rotate_left(struct lmb_property *n)
+{
+	struct lmb_property *r = n->right;
+
+	n->right = r->left;
+	r->left = n;
+	rgn_update(n);
+	rgn_update(r);
+	return r;
+}
+
+static struct lmb_property *
+rgn_balance(struct lmb_property *n)
+{
+	int bf;
 
-	for (i = r; i < rgn->cnt - 1; i++) {
-		rgn->region[i].base = rgn->region[i + 1].base;
-		rgn->region[i].size = rgn->region[i + 1].size;
-		rgn->region[i].tag = rgn->region[i + 1].tag;
-		rgn->region[i].type = rgn->region[i + 1].type;
+	rgn_update(n);
+	bf = rgn_height(n->left) - rgn_height(n->right);
+	if (bf > 1) {
+		if (rgn_height(n->left->left) < rgn_height(n->left->right)) {
+			n->left = rgn_rotate_left(n->left);
+		}
+		return rgn_rotate_right(n);
+	} else if (bf < -1) {
+		if (rgn_height(n->right->right) < rgn_height(n->right->left)) {
+			n->right = rgn_rotate_right(n->right);
+		}
+		return rgn_rotate_left(n);
 	}
 
-	rgn->cnt--;
+	return n;
+}
+
+static struct lmb_property *
+rgn_insert(struct lmb_property *n,
+	   struct lmb_property *new)
+{
+	if (n == NULL) {
+		return new;
+	}
+
+	if (new->base < n->base) {
+		n->left = rgn_insert(n->left, new);
+	} else {
+		n->right = rgn_insert(n->right, new);
+	}
+
+	return rgn_balance(n);
+}
+
+static struct lmb_property *
+rgn_remove_min(struct lmb_property *n,
+	       struct lmb_property **min)
+{
+	if (n->left == NULL) {
+		*min = n;
+		return n->right;
+	}
+
+	n->left = rgn_remove_min(n->left, min);
+	return rgn_balance(n);
 }
 
 /*
- * Assumption: base addr of region 1 < base addr of region 2
- * and tag and type are matching
+ * Unlinks the node for base, without moving any other
+ * node's contents.
  */
+static struct lmb_property *
+rgn_remove(struct lmb_property *n,
+	   phys_addr_t base)
+{
+	struct lmb_property *min;
+
+	BUG_ON(n == NULL);
+
+	if (base < n->base) {
+		n->left = rgn_remove(n->left, base);
+	} else if (base > n->base) {
+		n->right = rgn_remove(n->right, base);
+	} else {
+		if (n->right == NULL) {
+			return n->left;
+		}
+
+		n->right = rgn_remove_min(n->right, &min);
+		min->left = n->left;
+		min->right = n->right;
+		n = min;
+	}
+
+	return rgn_balance(n);
+}
+
+/*
+ * The last region with base <= addr, or NULL if there is none.
+ */
+static struct lmb_property *
+lmb_find(struct lmb_region *rgn,
+	 phys_addr_t addr)
+{
+	struct lmb_property *n = rgn->root;
+	struct lmb_property *best = NULL;
+
+	while (n != NULL) {
+		if (n->base <= addr) {
+			best = n;
+			n = n->right;
+		} else {
+			n = n->left;
+		}
+	}
+
+	return best;
+}
+
+/*
+ * The first region with base > addr, or NULL.
+ */
+static struct lmb_property *
+lmb_find_above(struct lmb_region *rgn,
+	       phys_addr_t addr)
+{
+	struct lmb_property *n = rgn->root;
+	struct lmb_property *best = NULL;
+
+	while (n != NULL) {
+		if (n->base > addr) {
+			best = n;
+			n = n->left;
+		} else {
+			n = n->right;
+		}
+	}
+
+	return best;
+}
+
+struct lmb_property *
+lmb_region_first(struct lmb_region *rgn)
+{
+	struct lmb_property *n = rgn->root;
+
+	while (n != NULL && n->left != NULL) {
+		n = n->left;
+	}
+
+	return n;
+}
+
+struct lmb_property *
+lmb_region_next(struct lmb_region *rgn,
+		struct lmb_property *p)
+{
+	return lmb_find_above(rgn, p->base);
+}
+
+struct lmb_property *
+lmb_region_at(struct lmb_region *rgn,
+	      unsigned long i)
+{
+	struct lmb_property *n = rgn->root;
+
+	BUG_ON(i >= rgn->cnt);
+	while (i != rgn_count(n->left)) {
+		if (i < rgn_count(n->left)) {
+			n = n->left;
+		} else {
+			i -= rgn_count(n->left) + 1;
+			n = n->right;
+		}
+	}
+
+	return n;
+}
+
 static void
-lmb_coalesce_regions(struct lmb_region *rgn,
-		     unsigned long r1,
-		     unsigned long r2)
+lmb_insert_region(struct lmb_region *rgn,
+		  phys_addr_t base,
+		  size_t size,
+		  lmb_type_t type,
+		  lmb_tag_t tag)
 {
-	rgn->region[r1].size += rgn->region[r2].size;
+	struct lmb_property *n = rgn->spare;
+
+	BUG_ON(n == NULL);
+	rgn->spare = n->right;
+
+	n->base = base;
+	n->size = size;
+	n->tag = tag;
+	n->type = type;
+	n->left = NULL;
+	n->right = NULL;
+	rgn_update(n);
+	rgn->root = rgn_insert(rgn->root, n);
+	rgn->cnt++;
+}
 
-	lmb_remove_region(rgn, r2);
+static void
+lmb_remove_region(struct lmb_region *rgn,
+		  struct lmb_property *p)
+{
+	rgn->root = rgn_remove(rgn->root, p->base);
+	p->right = rgn->spare;
+	rgn->spare = p;
+	rgn->cnt--;
+}
+
+static bool_t
+lmb_regions_mergeable(struct lmb_property *p1,
+		      struct lmb_property *p2)
+{
+	return lmb_addrs_adjacent(p1->base, p1->size,
+				  p2->base, p2->size) > 0 &&
+		p1->tag == p2->tag && p1->type == p2->type;
+}
+
+static void
+lmb_region_add_nodes(struct lmb_region *rgn,
+		     struct lmb_property *nodes,
+		     unsigned long count)
+{
+	unsigned long i;
+
+	for (i = 0; i < count; i++) {
+		nodes[i].right = rgn->spare;
+		rgn->spare = &nodes[i];
+	}
+
+	rgn->max += count;
+}
+
+static void
+lmb_region_init(struct lmb_region *rgn)
+{
+	rgn->cnt = 0;
+	rgn->max = 0;
+	rgn->root = NULL;
+	rgn->spare = NULL;
+	lmb_region_add_nodes(rgn, rgn->initial, MAX_LMB_REGIONS);
 }
 
 void
 lmb_init(struct lmb *lmb)
 {
-	/*
-	 * Create a dummy zero size LMB which will get coalesced away later.
-	 * This simplifies the lmb_add() code below...
-	 */
-	lmb->memory.region[0].base = 0;
-	lmb->memory.region[0].size = 0;
-	lmb->memory.region[0].type = LMB_INVALID;
-	lmb->memory.region[0].tag = LMB_TAG_NONE;
-	lmb->memory.cnt = 1;
+	lmb_region_init(&lmb->memory);
+	lmb_region_init(&lmb->reserved);
+	lmb_extents_init(&lmb->free);
+
+	lmb->nr_policies = 0;
+	memset(&lmb->stats, 0, sizeof(lmb->stats));
+	lmb->allocs.cnt = 0;
+	lmb->allocs.max = LMB_ALLOCS_INITIAL;
+	lmb->allocs.slot = lmb->allocs.initial;
+	memset(lmb->allocs.initial, 0, sizeof(lmb->allocs.initial));
+}
+
+static unsigned long
+lmb_allocs_hash(struct lmb_allocs *allocs,
+		phys_addr_t base)
+{
+	return (base * 0x9e3779b97f4a7c15UL >> 32) & (allocs->max - 1);
+}
+
+static struct lmb_alloc_rec *
+lmb_allocs_lookup(struct lmb_allocs *allocs,
+		  phys_addr_t base)
+{
+	unsigned long i = lmb_allocs_hash(allocs, base);
+
+	while (allocs->slot[i].size != 0) {
+		if (allocs->slot[i].base == base) {
+			return &allocs->slot[i];
+		}
+		i = (i + 1) & (allocs->max - 1);
+	}
+
+	return NULL;
+}
+
+static void
+lmb_allocs_put(struct lmb_allocs *allocs,
+	       struct lmb_alloc_rec *rec)
+{
+	unsigned long i = lmb_allocs_hash(allocs, rec->base);
+
+	while (allocs->slot[i].size != 0) {
+		i = (i + 1) & (allocs->max - 1);
+	}
+
+	allocs->slot[i] = *rec;
+	allocs->cnt++;
+}
+
+/*
+ * Linear probing with backward-shift deletion, so no
+ * tombstones build up.
+ */
+static void
+lmb_allocs_del(struct lmb_allocs *allocs,
+	       struct lmb_alloc_rec *rec)
+{
+	unsigned long mask = allocs->max - 1;
+	unsigned long hole = rec - allocs->slot;
+	unsigned long i = hole;
+
+	while (1) {
+		unsigned long home;
+
+		i = (i + 1) & mask;
+		if (allocs->slot[i].size == 0) {
+			break;
+		}
+
+		/*
+		 * Entry i may move into the hole only if its home
+		 * slot isn't cyclically within (hole, i].
+		 */
+		home = lmb_allocs_hash(allocs, allocs->slot[i].base);
+		if (((i - home) & mask) >= ((i - hole) & mask)) {
+			allocs->slot[hole] = allocs->slot[i];
+			hole = i;
+		}
+	}
 
-	/* Ditto. */
-	lmb->reserved.region[0].base = 0;
-	lmb->reserved.region[0].size = 0;
-	lmb->reserved.region[0].type = LMB_INVALID;
-	lmb->reserved.region[0].tag = LMB_TAG_NONE;
-	lmb->reserved.cnt = 1;
+	allocs->slot[hole].size = 0;
+	allocs->cnt--;
 }
 
 static long
@@ -158,89 +525,321 @@ lmb_add_region(struct lmb_region *rgn,
 	       lmb_type_t type,
 	       lmb_tag_t tag)
 {
+	struct lmb_property *prev;
+	struct lmb_property *next;
 	unsigned long coalesced = 0;
-	long adjacent, i;
 
-	if ((rgn->cnt == 1) && (rgn->region[0].size == 0)) {
-		rgn->region[0].base = base;
-		rgn->region[0].size = size;
-		rgn->region[0].tag = tag;
-		rgn->region[0].type = type;
+	prev = lmb_find(rgn, base);
+	next = lmb_find_above(rgn, base);
+
+	/*
+	 * Regions never overlap, so only the neighbours
+	 * need to be checked.
+	 */
+	if ((prev != NULL &&
+	     lmb_addrs_overlap(base, size, prev->base, prev->size)) ||
+	    (next != NULL &&
+	     lmb_addrs_overlap(base, size, next->base, next->size))) {
+		return -1;
+	}
+
+	if (prev != NULL &&
+	    prev->base + prev->size == base &&
+	    prev->tag == tag &&
+	    prev->type == type) {
+		prev->size += size;
+		coalesced++;
+	} else if (next != NULL &&
+		   base + size == next->base &&
+		   next->tag == tag &&
+		   next->type == type) {
+		/*
+		 * Still between prev and next, so the
+		 * tree stays ordered.
+		 */
+		next->base -= size;
+		next->size += size;
+		return 1;
+	}
+
+	if (coalesced) {
+		if (next != NULL && lmb_regions_mergeable(prev, next)) {
+			prev->size += next->size;
+			lmb_remove_region(rgn, next);
+			coalesced++;
+		}
+
+		return coalesced;
+	}
+
+	if (rgn->cnt >= rgn->max) {
+		return -1;
+	}
+
+	lmb_insert_region(rgn, base, size, type, tag);
+	return 0;
+}
+
+static phys_addr_t
+lmb_alloc_nogrow(struct lmb *lmb,
+		 size_t size,
+		 size_t align,
+		 phys_addr_t max_addr,
+		 lmb_type_t type,
+		 lmb_tag_t tag,
+		 lmb_policy_t policy)
+{
+	phys_addr_t base;
+	size = lmb_align_up(size, align);
+
+	base = lmb_extents_find(&lmb->free, size, align, max_addr, policy);
+	if (base == 0) {
 		return 0;
 	}
 
-	/* First try and coalesce this LMB with another. */
-	for (i=0; i < rgn->cnt; i++) {
-		phys_addr_t rgnbase = rgn->region[i].base;
-		size_t rgnsize = rgn->region[i].size;
+	if (lmb_add_region(&lmb->reserved, base, size, type, tag) < 0) {
+		return 0;
+	}
+
+	lmb_extents_remove(&lmb->free, base, size);
+	return base;
+}
+
+static long
+lmb_free_nogrow(struct lmb *lmb,
+		phys_addr_t base,
+		size_t size,
+		size_t align)
+{
+	struct lmb_property *p;
+	struct lmb_region *rgn = &(lmb->reserved);
+	phys_addr_t rgnbegin;
+	phys_addr_t rgnend;
+	phys_addr_t end;
+	size = lmb_align_up(size, align);
+	end  = base + size;
+
+	/* Find the region where (base, size) belongs to */
+	p = lmb_find(rgn, base);
+	if (p == NULL) {
+		return -1;
+	}
+
+	rgnbegin = p->base;
+	rgnend = rgnbegin + p->size;
+	if (end > rgnend) {
+		return -1;
+	}
 
-		if (lmb_addrs_overlap(base, size, rgnbase, rgnsize)) {
+	if (p->type == LMB_MMIO) {
+		return -1;
+	}
 
-			/* No overlapping with existing ones. */
+	/* Check to see if we are removing entire region */
+	if ((rgnbegin == base) && (rgnend == end)) {
+		lmb_remove_region(rgn, p);
+	} else if (rgnbegin == base) {
+		/* Region is matching at the front */
+		p->base = end;
+		p->size -= size;
+	} else if (rgnend == end) {
+		/* Region is matching at the end */
+		p->size -= size;
+	} else {
+		/*
+		 * We need to split the entry -  adjust the current one to the
+		 * beginging of the hole and add the region after hole.
+		 */
+		if (rgn->cnt >= rgn->max) {
 			return -1;
 		}
 
-		adjacent = lmb_addrs_adjacent(base,size,rgnbase,rgnsize);
-		if ( adjacent > 0 ) {
-			if (tag == rgn->region[i].tag &&
-			    type == rgn->region[i].type) {
-				rgn->region[i].base -= size;
-				rgn->region[i].size += size;
-				coalesced++;
-			}
-			break;
-		}
-		else if ( adjacent < 0 ) {
-			if (tag == rgn->region[i].tag &&
-			    type == rgn->region[i].type) {
-				rgn->region[i].size += size;
-				coalesced++;
-			}
-			break;
-		}
+		p->size = base - p->base;
+		lmb_insert_region(rgn, end, rgnend - end,
+				  p->type, p->tag);
 	}
 
-	if ((i < rgn->cnt-1) &&
-	    lmb_regions_adjacent(rgn, i, i+1) &&
-	    rgn->region[i].tag == rgn->region[i + 1].tag &&
-	    rgn->region[i].type == rgn->region[i + 1].type) {
-		lmb_coalesce_regions(rgn, i, i+1);
-		coalesced++;
+	lmb_extents_insert(&lmb->free, base, size);
+	return 0;
+}
+
+/*
+ * Enough for any one operation, including growing the
+ * trees and tables: allocating more nodes (or extent nodes,
+ * or a new allocation table) takes a reserved entry, and
+ * freeing the old table may split one.
+ */
+#define LMB_REGION_HEADROOM 6
+
+/*
+ * Node chunks are never given back, as nodes can't be moved.
+ */
+static void
+lmb_region_grow(struct lmb *lmb,
+		struct lmb_region *rgn)
+{
+	phys_addr_t new;
+	unsigned long count = rgn->max;
+
+	if (rgn->cnt + LMB_REGION_HEADROOM <= rgn->max) {
+		return;
 	}
 
-	if (coalesced) {
-		return coalesced;
+	new = lmb_alloc_nogrow(lmb, count * sizeof(struct lmb_property),
+			       sizeof(uint64_t), LMB_ALLOC_ANYWHERE,
+			       LMB_BOOT, LMB_TAG("LMBR"),
+			       LMB_POLICY_KEEP_HUGE);
+	if (new == 0) {
+		/*
+		 * Probably no memory added yet. Keep going
+		 * with what's left.
+		 */
+		return;
 	}
 
-	if (rgn->cnt >= MAX_LMB_REGIONS) {
-		return -1;
+	lmb_region_add_nodes(rgn, VP(new), count);
+}
+
+/*
+ * Growing both region trees and the allocation table can
+ * take up to six extent nodes, and the operation itself up
+ * to two more.
+ */
+#define LMB_EXTENTS_HEADROOM 10
+
+static void
+lmb_extents_grow(struct lmb *lmb)
+{
+	phys_addr_t new;
+	unsigned long count = lmb->free.nr_nodes;
+
+	if (lmb->free.nr_spare >= LMB_EXTENTS_HEADROOM) {
+		return;
 	}
 
-	/* Couldn't coalesce the LMB, so add it to the sorted table. */
-	for (i = rgn->cnt-1; i >= 0; i--) {
-		if (base < rgn->region[i].base) {
-			rgn->region[i+1].base = rgn->region[i].base;
-			rgn->region[i+1].size = rgn->region[i].size;
-			rgn->region[i+1].type = rgn->region[i].type;
-			rgn->region[i+1].tag = rgn->region[i].tag;
-		} else {
-			rgn->region[i+1].base = base;
-			rgn->region[i+1].size = size;
-			rgn->region[i+1].tag = tag;
-			rgn->region[i+1].type = type;
-			break;
+	/*
+	 * Node chunks are never given back, as they can't
+	 * be moved.
+	 */
+	new = lmb_alloc_nogrow(lmb, count * sizeof(struct lmb_extent),
+			       sizeof(uint64_t), LMB_ALLOC_ANYWHERE,
+			       LMB_BOOT, LMB_TAG("LMBX"),
+			       LMB_POLICY_KEEP_HUGE);
+	if (new == 0) {
+		return;
+	}
+
+	lmb_extents_add_nodes(&lmb->free, VP(new), count);
+}
+
+/*
+ * Keeps the table at most 3/4 full.
+ */
+static void
+lmb_allocs_grow(struct lmb *lmb)
+{
+	unsigned long i;
+	phys_addr_t new;
+	struct lmb_allocs *allocs = &lmb->allocs;
+	struct lmb_alloc_rec *old = allocs->slot;
+	unsigned long old_max = allocs->max;
+
+	if ((allocs->cnt + 1) * 4 <= allocs->max * 3) {
+		return;
+	}
+
+	new = lmb_alloc_nogrow(lmb, old_max * 2 *
+			       sizeof(struct lmb_alloc_rec),
+			       sizeof(uint64_t), LMB_ALLOC_ANYWHERE,
+			       LMB_BOOT, LMB_TAG("LMBA"),
+			       LMB_POLICY_KEEP_HUGE);
+	if (new == 0) {
+		return;
+	}
+
+	memset(VP(new), 0, old_max * 2 * sizeof(struct lmb_alloc_rec));
+	allocs->slot = VP(new);
+	allocs->max = old_max * 2;
+	allocs->cnt = 0;
+	for (i = 0; i < old_max; i++) {
+		if (old[i].size != 0) {
+			lmb_allocs_put(allocs, &old[i]);
 		}
 	}
 
-	if (base < rgn->region[0].base) {
-		rgn->region[0].base = base;
-		rgn->region[0].size = size;
-		rgn->region[0].tag = tag;
-		rgn->region[0].type = type;
+	if (old != allocs->initial) {
+		lmb_free_nogrow(lmb, (phys_addr_t) old,
+				old_max * sizeof(struct lmb_alloc_rec),
+				sizeof(uint64_t));
 	}
+}
 
-	rgn->cnt++;
+/*
+ * Called before anything that can add regions or extents.
+ * Extent nodes first, as growing the trees needs some. Then
+ * reserved, as growing memory takes a reserved entry.
+ */
+static void
+lmb_grow(struct lmb *lmb)
+{
+	lmb_extents_grow(lmb);
+	lmb_region_grow(lmb, &lmb->reserved);
+	lmb_region_grow(lmb, &lmb->memory);
+	lmb_allocs_grow(lmb);
+}
+
+/*
+ * How much of the free memory is not in the largest
+ * free extent, in percent.
+ */
+unsigned long
+lmb_fragmentation(struct lmb *lmb)
+{
+	size_t total = lmb_extents_total(&lmb->free);
+
+	if (total == 0) {
+		return 0;
+	}
+
+	return 100 - lmb_extents_largest(&lmb->free) * 100 / total;
+}
+
+static lmb_policy_t
+lmb_tag_policy(struct lmb *lmb,
+	       lmb_tag_t tag)
+{
+	unsigned long i;
+
+	for (i = 0; i < lmb->nr_policies; i++) {
+		if (lmb->policies[i].tag == tag) {
+			return lmb->policies[i].policy;
+		}
+	}
+
+	return LMB_POLICY_TOP_DOWN;
+}
+
+long
+lmb_set_tag_policy(struct lmb *lmb,
+		   lmb_tag_t tag,
+		   lmb_policy_t policy)
+{
+	unsigned long i;
+
+	for (i = 0; i < lmb->nr_policies; i++) {
+		if (lmb->policies[i].tag == tag) {
+			lmb->policies[i].policy = policy;
+			return 0;
+		}
+	}
+
+	if (lmb->nr_policies == LMB_MAX_TAG_POLICIES) {
+		return -1;
+	}
 
+	lmb->policies[lmb->nr_policies].tag = tag;
+	lmb->policies[lmb->nr_policies].policy = policy;
+	lmb->nr_policies++;
 	return 0;
 }
 
@@ -250,9 +849,17 @@ lmb_add(struct lmb *lmb,
 	size_t size,
 	lmb_tag_t tag)
 {
+	long ret;
 	struct lmb_region *_rgn = &(lmb->memory);
 
-	return lmb_add_region(_rgn, base, size, LMB_FREE, tag);
+	lmb_grow(lmb);
+	ret = lmb_add_region(_rgn, base, size, LMB_FREE, tag);
+	if (ret >= 0) {
+		lmb_extents_insert(&lmb->free, base, size);
+		lmb->stats.ram += size;
+	}
+
+	return ret;
 }
 
 long
@@ -264,6 +871,7 @@ lmb_add_mmio(struct lmb *lmb,
 	long ret;
 	struct lmb_region *_rgn = &(lmb->memory);
 
+	lmb_grow(lmb);
 	ret = lmb_add_region(_rgn, base, size, LMB_MMIO, tag);
 	if (ret == 0) {
 		lmb_add_region(&(lmb->reserved), base, size, LMB_MMIO, tag);
@@ -272,18 +880,67 @@ lmb_add_mmio(struct lmb *lmb,
 	return ret;
 }
 
-static phys_addr_t
-lmb_align_down(phys_addr_t addr,
-	       size_t size)
+/*
+ * Some record with memory in [base, base + size), or NULL. Goes
+ * through the whole table, but only lmb_free needs it, for ranges
+ * that aren't exactly one allocation.
+ */
+static struct lmb_alloc_rec *
+lmb_allocs_overlapping(struct lmb_allocs *allocs,
+		       phys_addr_t base,
+		       size_t size)
 {
-	return addr & ~(size - 1);
+	unsigned long i;
+
+	for (i = 0; i < allocs->max; i++) {
+		if (allocs->slot[i].size != 0 &&
+		    lmb_addrs_overlap(allocs->slot[i].base,
+				      allocs->slot[i].size,
+				      base, size)) {
+			return &allocs->slot[i];
+		}
+	}
+
+	return NULL;
 }
 
-static phys_addr_t
-lmb_align_up(phys_addr_t addr,
-	     size_t size)
+/*
+ * Drops [base, base + size) from every record it touches: the
+ * front or the tail of one, the middle of one (splitting it), or
+ * a run of coalesced ones. What's left of each stays tracked, so
+ * no record ever points at memory that was freed.
+ */
+static void
+lmb_allocs_trim(struct lmb_allocs *allocs,
+		phys_addr_t base,
+		size_t size)
 {
-	return (addr + size - 1) & ~(size - 1);
+	struct lmb_alloc_rec *rec;
+	struct lmb_alloc_rec head;
+	struct lmb_alloc_rec tail;
+	phys_addr_t end = base + size;
+
+	while ((rec = lmb_allocs_overlapping(allocs, base, size)) != NULL) {
+		head = *rec;
+		tail = *rec;
+		lmb_allocs_del(allocs, rec);
+
+		if (head.base < base) {
+			head.size = base - head.base;
+			lmb_allocs_put(allocs, &head);
+		}
+
+		/*
+		 * Splitting takes a new entry. Without one, the
+		 * tail can still be freed with lmb_free.
+		 */
+		if (tail.base + tail.size > end &&
+		    allocs->cnt + 1 < allocs->max) {
+			tail.size = tail.base + tail.size - end;
+			tail.base = end;
+			lmb_allocs_put(allocs, &tail);
+		}
+	}
 }
 
 long
@@ -292,61 +949,58 @@ lmb_free(struct lmb *lmb,
 	 size_t size,
 	 size_t align)
 {
-	struct lmb_region *rgn = &(lmb->reserved);
-	phys_addr_t rgnbegin;
-	phys_addr_t rgnend;
-	phys_addr_t end;
-	size = lmb_align_up(size, align);
-	end  = base + size;
-	int i;
-
-	rgnbegin = rgnend = 0; /* supress gcc warnings */
-
-	/* Find the region where (base, size) belongs to */
-	for (i=0; i < rgn->cnt; i++) {
-		rgnbegin = rgn->region[i].base;
-		rgnend = rgnbegin + rgn->region[i].size;
-
-		if ((rgnbegin <= base) && (end <= rgnend))
-			break;
-	}
+	long ret;
+	struct lmb_alloc_rec *rec;
 
-	/* Didn't find the region */
-	if (i == rgn->cnt) {
-		return -1;
+	lmb_grow(lmb);
+	ret = lmb_free_nogrow(lmb, base, size, align);
+	if (ret != 0) {
+		return ret;
 	}
 
-	if (rgn->region[i].type == LMB_MMIO) {
-		return -1;
+	size = lmb_align_up(size, align);
+	rec = lmb_allocs_lookup(&lmb->allocs, base);
+	if (rec != NULL && rec->size == size) {
+		lmb_allocs_del(&lmb->allocs, rec);
+	} else {
+		lmb_allocs_trim(&lmb->allocs, base, size);
 	}
 
-	/* Check to see if we are removing entire region */
-	if ((rgnbegin == base) && (rgnend == end)) {
-		lmb_remove_region(rgn, i);
-		return 0;
-	}
+	lmb->stats.frees++;
+	return 0;
+}
 
-	/* Check to see if region is matching at the front */
-	if (rgnbegin == base) {
-		rgn->region[i].base = end;
-		rgn->region[i].size -= size;
-		return 0;
-	}
+long
+lmb_free_addr(struct lmb *lmb,
+	      phys_addr_t base)
+{
+	long ret;
+	struct lmb_alloc_rec *rec;
 
-	/* Check to see if the region is matching at the end */
-	if (rgnend == end) {
-		rgn->region[i].size -= size;
-		return 0;
+	rec = lmb_allocs_lookup(&lmb->allocs, base);
+	if (rec == NULL) {
+		return -1;
 	}
 
+	lmb_grow(lmb);
 	/*
-	 * We need to split the entry -  adjust the current one to the
-	 * beginging of the hole and add the region after hole.
+	 * lmb_grow may have rehashed.
 	 */
-	rgn->region[i].size = base - rgn->region[i].base;
-	return lmb_add_region(rgn, end, rgnend - end,
-			      rgn->region[i].type,
-			      rgn->region[i].tag);
+	rec = lmb_allocs_lookup(&lmb->allocs, base);
+	ret = lmb_free_nogrow(lmb, base, rec->size, 1);
+	if (ret == 0) {
+		lmb_allocs_del(&lmb->allocs, rec);
+		lmb->stats.frees++;
+	}
+
+	return ret;
+}
+
+const struct lmb_alloc_rec *
+lmb_find_alloc(struct lmb *lmb,
+	       phys_addr_t base)
+{
+	return lmb_allocs_lookup(&lmb->allocs, base);
 }
 
 long
@@ -356,6 +1010,7 @@ lmb_reserve(struct lmb *lmb,
 	    lmb_type_t type,
 	    lmb_tag_t tag)
 {
+	long ret;
 	struct lmb_region *_rgn = &(lmb->reserved);
 
 	if (type != LMB_BOOT &&
@@ -367,25 +1022,39 @@ lmb_reserve(struct lmb *lmb,
 		return -1;
 	}
 
-	return lmb_add_region(_rgn, base, size, type, tag);
+	lmb_grow(lmb);
+	ret = lmb_add_region(_rgn, base, size, type, tag);
+	if (ret >= 0) {
+		lmb_extents_remove(&lmb->free, base, size);
+		lmb_stats_update(lmb);
+	}
+
+	return ret;
 }
 
-long
+struct lmb_property *
 lmb_overlaps_region(struct lmb_region *rgn,
 		    phys_addr_t base,
 		    size_t size)
 {
-	unsigned long i;
+	struct lmb_property *p = lmb_find(rgn, base);
 
-	for (i=0; i < rgn->cnt; i++) {
-		phys_addr_t rgnbase = rgn->region[i].base;
-		size_t rgnsize = rgn->region[i].size;
-		if ( lmb_addrs_overlap(base,size,rgnbase,rgnsize) ) {
-			break;
-		}
+	/*
+	 * Only the region at or before base, or else the
+	 * one right after it, can overlap first.
+	 */
+	if (p != NULL &&
+	    lmb_addrs_overlap(base, size, p->base, p->size)) {
+		return p;
+	}
+
+	p = lmb_find_above(rgn, base);
+	if (p != NULL &&
+	    lmb_addrs_overlap(base, size, p->base, p->size)) {
+		return p;
 	}
 
-	return (i < rgn->cnt) ? i : -1;
+	return NULL;
 }
 
 phys_addr_t
@@ -424,66 +1093,66 @@ __lmb_alloc_base(struct lmb *lmb,
 		 lmb_type_t type,
 		 lmb_tag_t tag)
 {
-	long i, j;
-	phys_addr_t base = 0;
-	phys_addr_t res_base;
-	size = lmb_align_up(size, align);
-
-	for (i = lmb->memory.cnt-1; i >= 0; i--) {
-		phys_addr_t lmbbase = lmb->memory.region[i].base;
-		size_t lmbsize = lmb->memory.region[i].size;
-
-		if (lmbsize < size)
-			continue;
-		if (max_addr == LMB_ALLOC_ANYWHERE)
-			base = lmb_align_down(lmbbase + lmbsize - size, align);
-		else if (lmbbase < max_addr) {
-			base = min(lmbbase + lmbsize, max_addr);
-			base = lmb_align_down(base - size, align);
-		} else {
-			continue;
-		}
+	return lmb_alloc_policy(lmb, size, align, max_addr, type, tag,
+				lmb_tag_policy(lmb, tag));
+}
 
-		while (base && lmbbase <= base) {
-			j = lmb_overlaps_region(&lmb->reserved, base,
-                                                size);
-			if (j < 0) {
+phys_addr_t
+lmb_alloc_policy(struct lmb *lmb,
+		 size_t size,
+		 size_t align,
+		 phys_addr_t max_addr,
+		 lmb_type_t type,
+		 lmb_tag_t tag,
+		 lmb_policy_t policy)
+{
+	phys_addr_t base;
+	struct lmb_alloc_rec rec;
 
-				/* This area isn't reserved, take it */
-				if (lmb_add_region(&lmb->reserved, base,
-						   size,
-						   type,
-						   tag) < 0) {
-					return 0;
-				}
+	if (type == LMB_MMIO) {
+		return 0;
+	}
 
-				return base;
-			}
+	lmb_grow(lmb);
+	base = lmb_alloc_nogrow(lmb, size, align, max_addr, type, tag,
+				policy);
+	if (base == 0) {
+		lmb->stats.failed++;
+		return 0;
+	}
 
-			res_base = lmb->reserved.region[j].base;
-			if (res_base < size) {
-				break;
-			}
+	lmb->stats.allocs++;
+	if (size == 0) {
+		lmb_stats_update(lmb);
+		return base;
+	}
 
-			base = lmb_align_down(res_base - size, align);
-		}
+	rec.base = base;
+	rec.size = lmb_align_up(size, align);
+	rec.align = align;
+	rec.type = type;
+	rec.tag = tag;
+	if (lmb->allocs.cnt + 1 >= lmb->allocs.max) {
+		/*
+		 * Couldn't grow the table. Not fatal, but
+		 * this can only be freed with lmb_free.
+		 */
+		lmb_stats_update(lmb);
+		return base;
 	}
-	return 0;
+
+	lmb_allocs_put(&lmb->allocs, &rec);
+	lmb_stats_update(lmb);
+	return base;
 }
 
 int
 lmb_is_reserved(struct lmb *lmb,
 		phys_addr_t addr)
 {
-	int i;
+	struct lmb_property *p = lmb_find(&lmb->reserved, addr);
 
-	for (i = 0; i < lmb->reserved.cnt; i++) {
-		phys_addr_t upper = lmb->reserved.region[i].base +
-			lmb->reserved.region[i].size - 1;
-		if ((addr >= lmb->reserved.region[i].base) && (addr <= upper))
-			return 1;
-	}
-	return 0;
+	return p != NULL && addr - p->base < p->size;
 }
 
 int
@@ -491,16 +1160,17 @@ lmb_is_known(struct lmb *lmb,
 	     phys_addr_t addr,
 	     size_t size)
 {
-	int i;
+	struct lmb_property *p = lmb_find(&lmb->memory, addr);
+	phys_addr_t upper;
 
-	for (i = 0; i < lmb->memory.cnt; i++) {
-		phys_addr_t upper = lmb->memory.region[i].base +
-			lmb->memory.region[i].size;
-		if ((addr >= lmb->memory.region[i].base) && (addr <= upper - 1) &&
-		    ((addr + size) >= lmb->memory.region[i].base) &&
-		    ((addr + size) <= upper)) {
-			return 1;
-		}
+	if (p == NULL) {
+		return 0;
+	}
+
+	upper = p->base + p->size;
+	if ((addr <= upper - 1) &&
+	    ((addr + size) <= upper)) {
+		return 1;
 	}
 
 	return 0;
@@ -22,6 +22,8 @@
 #ifndef LMB_H
 #define LMB_H
 
+#include <lmb_extents.h>
+
 /* Each lmb property has a tag associated with it. */
 #define _LMB_TAG(a, b, c, d) \
 	((uint32_t) d << 24 | (uint32_t) c << 16 | (uint32_t) b << 8 | a)
@@ -66,16 +68,103 @@ struct lmb_property {
 	 * lmb_add_mmio - not allocated or freed.
 	 */
 #define LMB_MMIO    (4)
+
+	/*
+	 * Tree links, only for lmb.c.
+	 */
+	struct lmb_property *left;
+	struct lmb_property *right;
+	unsigned long count;
+	int height;
 };
 
+/*
+ * Regions are kept in an AVL tree keyed by base, with the
+ * number of regions in each subtree, so that the i-th one can
+ * be found in O(log n) too. Use the accessors below. Nodes
+ * start out as 'initial', and more are added from (doubling)
+ * LMB allocations as the spare ones run low. Nodes never
+ * move, so a struct lmb must not be copied, but a region
+ * stays put while others come and go.
+ */
 struct lmb_region {
 	unsigned long cnt;
-	struct lmb_property region[MAX_LMB_REGIONS+1];
+	/*
+	 * Nodes, in the tree or spare.
+	 */
+	unsigned long max;
+	struct lmb_property *root;
+	/*
+	 * Unused nodes, chained through 'right'.
+	 */
+	struct lmb_property *spare;
+	struct lmb_property initial[MAX_LMB_REGIONS];
+};
+
+/*
+ * What lmb_alloc handed out, so that lmb_free_addr needs
+ * nothing but the base. An open-addressed hash table, which
+ * grows into (doubling) LMB allocations as it fills up.
+ */
+struct lmb_alloc_rec {
+	phys_addr_t base;
+	/*
+	 * Already aligned up. 0 marks an empty slot.
+	 */
+	size_t size;
+	size_t align;
+	lmb_type_t type;
+	lmb_tag_t tag;
+};
+
+#define LMB_ALLOCS_INITIAL 64
+
+struct lmb_allocs {
+	unsigned long cnt;
+	unsigned long max;
+	struct lmb_alloc_rec *slot;
+	struct lmb_alloc_rec initial[LMB_ALLOCS_INITIAL];
+};
+
+/*
+ * Default placement policies for allocations with
+ * a given tag. Everything else is LMB_POLICY_TOP_DOWN.
+ */
+#define LMB_MAX_TAG_POLICIES 8
+
+struct lmb_tag_policy {
+	lmb_tag_t tag;
+	lmb_policy_t policy;
+};
+
+struct lmb_stats {
+	unsigned long allocs;
+	unsigned long frees;
+	unsigned long failed;
+	/*
+	 * Free memory that was ever added.
+	 */
+	size_t ram;
+	/*
+	 * High-water marks.
+	 */
+	size_t used_max;
+	unsigned long regions_max;
+	unsigned long allocs_max;
 };
 
 struct lmb {
 	struct lmb_region memory;
 	struct lmb_region reserved;
+	struct lmb_allocs allocs;
+	struct lmb_tag_policy policies[LMB_MAX_TAG_POLICIES];
+	unsigned long nr_policies;
+	struct lmb_stats stats;
+	/*
+	 * What's in memory but not in reserved, indexed
+	 * for allocation.
+	 */
+	struct lmb_extents free;
 };
 
 extern struct lmb lmb;
@@ -114,6 +203,17 @@ phys_addr_t __lmb_alloc_base(struct lmb *lmb,
 			     phys_addr_t max_addr,
 			     lmb_type_t type,
 			     lmb_tag_t tag);
+phys_addr_t lmb_alloc_policy(struct lmb *lmb,
+			     size_t size,
+			     size_t align,
+			     phys_addr_t max_addr,
+			     lmb_type_t type,
+			     lmb_tag_t tag,
+			     lmb_policy_t policy);
+long lmb_set_tag_policy(struct lmb *lmb,
+			lmb_tag_t tag,
+			lmb_policy_t policy);
+unsigned long lmb_fragmentation(struct lmb *lmb);
 int lmb_is_reserved(struct lmb *lmb, phys_addr_t addr);
 int lmb_is_known(struct lmb *lmb,
 		 phys_addr_t addr,
@@ -122,17 +222,56 @@ long lmb_free(struct lmb *lmb,
 	      phys_addr_t base,
 	      size_t size,
 	      size_t align);
+long lmb_free_addr(struct lmb *lmb,
+		   phys_addr_t base);
+const struct lmb_alloc_rec *lmb_find_alloc(struct lmb *lmb,
+					   phys_addr_t base);
 
 void lmb_dump_all(struct lmb *lmb);
 
-long lmb_overlaps_region(struct lmb_region *rgn,
-			 phys_addr_t base,
-			 size_t size);
+/*
+ * Binary memory map, as sent by "oem memmap": the header,
+ * then mem_count memory entries, then res_count reserved ones.
+ */
+#define LMB_MAP_MAGIC 0x50414d4c /* "LMAP" */
+
+typedef struct lmb_map_hdr {
+	uint32_t magic;
+	uint32_t entry_size;
+	uint32_t mem_count;
+	uint32_t res_count;
+} lmb_map_hdr;
+
+typedef struct lmb_map_entry {
+	uint64_t base;
+	uint64_t size;
+	uint32_t tag;
+	uint32_t type;
+} lmb_map_entry;
+
+size_t lmb_map_size(struct lmb *lmb);
+size_t lmb_map(struct lmb *lmb,
+	       void *buffer,
+	       size_t size);
+char *lmb_type_name(lmb_type_t type);
+
+struct lmb_property *lmb_overlaps_region(struct lmb_region *rgn,
+					 phys_addr_t base,
+					 size_t size);
+
+/*
+ * In order of base, each O(log n).
+ */
+struct lmb_property *lmb_region_first(struct lmb_region *rgn);
+struct lmb_property *lmb_region_next(struct lmb_region *rgn,
+				     struct lmb_property *p);
+struct lmb_property *lmb_region_at(struct lmb_region *rgn,
+				   unsigned long i);
 
 static inline size_t
 lmb_size_bytes(struct lmb_region *type, unsigned long region_nr)
 {
-	return type->region[region_nr].size;
+	return lmb_region_at(type, region_nr)->size;
 }
 
 #endif /* LMB_H */
@@ -0,0 +1,565 @@
+/*
+ * Free extent index for logical memory blocks.
+ *
+ * Copyright (C) 2018 Andrei Warkentin <andrey.warkentin@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <lib.h>
+#include <lmb.h>
+#include <lmb_extents.h>
+
+static int
+ext_height(struct lmb_extent *n)
+{
+	return n == NULL ? 0 : n->height;
+}
+
+static size_t
+ext_max(struct lmb_extent *n)
+{
+	return n == NULL ? 0 : n->max_size;
+}
+
+static void
+ext_update(struct lmb_extent *n)
+{
+	n->height = 1 + max(ext_height(n->left), ext_height(n->right));
+	n->max_size = max(n->size, max(ext_max(n->left),
+				       ext_max(n->right)));
+}
+
+static struct lmb_extent *
+ext_rotate_right(struct lmb_extent *n)
+{
+	struct lmb_extent *l = n->left;
+
+	n->left = l->right;
+	l->right = n;
+	ext_update(n);
+	ext_update(l);
+	return l;
+}
+
+static struct lmb_extent *
+ext_rotate_left(struct lmb_extent *n)
+{
+	struct lmb_extent *r = n->right;
+
+	n->right = r->left;
+	r->left = n;
+	ext_update(n);
+	ext_update(r);
+	return r;
+}
+
+static struct lmb_extent *
+ext_balance(struct lmb_extent *n)
+{
+	int bf;
+
+	ext_update(n);
+	bf = ext_height(n->left) - ext_height(n->right);
+	if (bf > 1) {
+		if (ext_height(n->left->left) < ext_height(n->left->right)) {
+			n->left = ext_rotate_left(n->left);
+		}
+		return ext_rotate_right(n);
+	} else if (bf < -1) {
+		if (ext_height(n->right->right) < ext_height(n->right->left)) {
+			n->right = ext_rotate_right(n->right);
+		}
+		return ext_rotate_left(n);
+	}
+
+	return n;
+}
+
+static struct lmb_extent *
+ext_insert(struct lmb_extent *n,
+	   struct lmb_extent *new)
+{
+	if (n == NULL) {
+		return new;
+	}
+
+	if (new->base < n->base) {
+		n->left = ext_insert(n->left, new);
+	} else {
+		n->right = ext_insert(n->right, new);
+	}
+
+	return ext_balance(n);
+}
+
+static struct lmb_extent *
+ext_remove_min(struct lmb_extent *n,
+	       struct lmb_extent **min)
+{
+	if (n->left == NULL) {
+		*min = n;
+		return n->right;
+	}
+
+	n->left = ext_remove_min(n->left, min);
+	return ext_balance(n);
+}
+
+static struct lmb_extent *
+ext_remove(struct lmb_extent *n,
+	   phys_addr_t base,
+	   struct lmb_extent **removed)
+{
+	struct lmb_extent *min;
+
+	BUG_ON(n == NULL);
+
+	if (base < n->base) {
+		n->left = ext_remove(n->left, base, removed);
+	} else if (base > n->base) {
+		n->right = ext_remove(n->right, base, removed);
+	} else {
+		*removed = n;
+		if (n->right == NULL) {
+			return n->left;
+		}
+
+		n->right = ext_remove_min(n->right, &min);
+		min->left = n->left;
+		min->right = n->right;
+		n = min;
+	}
+
+	return ext_balance(n);
+}
+
+/*
+ * Greatest base <= addr.
+ */
+static struct lmb_extent *
+ext_find_le(struct lmb_extent *n,
+	    phys_addr_t addr)
+{
+	struct lmb_extent *best = NULL;
+
+	while (n != NULL) {
+		if (n->base <= addr) {
+			best = n;
+			n = n->right;
+		} else {
+			n = n->left;
+		}
+	}
+
+	return best;
+}
+
+/*
+ * Smallest base >= addr.
+ */
+static struct lmb_extent *
+ext_find_ge(struct lmb_extent *n,
+	    phys_addr_t addr)
+{
+	struct lmb_extent *best = NULL;
+
+	while (n != NULL) {
+		if (n->base >= addr) {
+			best = n;
+			n = n->left;
+		} else {
+			n = n->right;
+		}
+	}
+
+	return best;
+}
+
+static void
+ext_put(struct lmb_extents *ext,
+	struct lmb_extent *n)
+{
+	n->right = ext->spare;
+	ext->spare = n;
+	ext->nr_spare++;
+}
+
+static void
+ext_add(struct lmb_extents *ext,
+	phys_addr_t base,
+	size_t size)
+{
+	struct lmb_extent *n = ext->spare;
+
+	/*
+	 * lmb_grow keeps enough spare nodes around.
+	 */
+	BUG_ON(n == NULL);
+	ext->spare = n->right;
+	ext->nr_spare--;
+
+	n->base = base;
+	n->size = size;
+	n->left = NULL;
+	n->right = NULL;
+	ext_update(n);
+	ext->root = ext_insert(ext->root, n);
+}
+
+static void
+ext_del(struct lmb_extents *ext,
+	phys_addr_t base)
+{
+	struct lmb_extent *removed = NULL;
+
+	ext->root = ext_remove(ext->root, base, &removed);
+	ext_put(ext, removed);
+}
+
+void
+lmb_extents_init(struct lmb_extents *ext)
+{
+	ext->root = NULL;
+	ext->spare = NULL;
+	ext->nr_spare = 0;
+	ext->nr_nodes = 0;
+	ext->total = 0;
+	lmb_extents_add_nodes(ext, ext->initial, LMB_EXTENTS_INITIAL);
+}
+
+void
+lmb_extents_add_nodes(struct lmb_extents *ext,
+		      struct lmb_extent *nodes,
+		      unsigned long count)
+{
+	unsigned long i;
+
+	for (i = 0; i < count; i++) {
+		ext_put(ext, &nodes[i]);
+	}
+
+	ext->nr_nodes += count;
+}
+
+/*
+ * Marks [base, base + size) free, merging with the
+ * neighbouring extents.
+ */
+void
+lmb_extents_insert(struct lmb_extents *ext,
+		   phys_addr_t base,
+		   size_t size)
+{
+	struct lmb_extent *n;
+
+	if (size == 0) {
+		return;
+	}
+
+	ext->total += size;
+	n = ext_find_le(ext->root, base);
+	BUG_ON(n != NULL && n->base + n->size > base);
+	if (n != NULL && n->base + n->size == base) {
+		base = n->base;
+		size += n->size;
+		ext_del(ext, n->base);
+	}
+
+	n = ext_find_ge(ext->root, base + size);
+	if (n != NULL && n->base == base + size) {
+		size += n->size;
+		ext_del(ext, n->base);
+	}
+
+	ext_add(ext, base, size);
+}
+
+/*
+ * Marks [base, base + size) used. The range must be
+ * entirely free.
+ */
+void
+lmb_extents_remove(struct lmb_extents *ext,
+		   phys_addr_t base,
+		   size_t size)
+{
+	phys_addr_t n_base;
+	phys_addr_t n_end;
+	struct lmb_extent *n;
+
+	if (size == 0) {
+		return;
+	}
+
+	n = ext_find_le(ext->root, base);
+	BUG_ON(n == NULL || n->base + n->size < base + size);
+	ext->total -= size;
+
+	n_base = n->base;
+	n_end = n->base + n->size;
+	ext_del(ext, n_base);
+	if (n_base < base) {
+		ext_add(ext, n_base, base - n_base);
+	}
+
+	if (base + size < n_end) {
+		ext_add(ext, base + size, n_end - (base + size));
+	}
+}
+
+/*
+ * Highest aligned base in n below max_addr, or 0.
+ */
+static phys_addr_t
+ext_fit_top(struct lmb_extent *n,
+	    size_t size,
+	    size_t align,
+	    phys_addr_t max_addr)
+{
+	phys_addr_t top = n->base + n->size;
+	phys_addr_t base;
+
+	if (max_addr != LMB_ALLOC_ANYWHERE) {
+		top = min(top, max_addr);
+	}
+
+	if (top < n->base || top - n->base < size) {
+		return 0;
+	}
+
+	base = (top - size) & ~(align - 1);
+	if (base < n->base) {
+		return 0;
+	}
+
+	return base;
+}
+
+/*
+ * Lowest aligned (non-zero) base in n below max_addr, or 0.
+ */
+static phys_addr_t
+ext_fit_bottom(struct lmb_extent *n,
+	       size_t size,
+	       size_t align,
+	       phys_addr_t max_addr)
+{
+	phys_addr_t top = n->base + n->size;
+	phys_addr_t base = A_UP(n->base, align);
+
+	if (max_addr != LMB_ALLOC_ANYWHERE) {
+		top = min(top, max_addr);
+	}
+
+	if (base == 0) {
+		base = align;
+	}
+
+	if (base < n->base || base >= top || top - base < size) {
+		return 0;
+	}
+
+	return base;
+}
+
+static bool_t
+ext_has_huge(struct lmb_extent *n)
+{
+	phys_addr_t huge = A_UP(n->base, LMB_HUGE_SIZE);
+
+	return huge >= n->base &&
+		huge + LMB_HUGE_SIZE <= n->base + n->size;
+}
+
+/*
+ * Subtrees that are entirely above max_addr, or that have no
+ * extent of at least 'size' bytes, are never visited.
+ */
+static phys_addr_t
+ext_find_top(struct lmb_extent *n,
+	     size_t size,
+	     size_t align,
+	     phys_addr_t max_addr)
+{
+	phys_addr_t base;
+
+	if (n == NULL || n->max_size < size) {
+		return 0;
+	}
+
+	if (max_addr == LMB_ALLOC_ANYWHERE || n->base < max_addr) {
+		base = ext_find_top(n->right, size, align, max_addr);
+		if (base != 0) {
+			return base;
+		}
+
+		base = ext_fit_top(n, size, align, max_addr);
+		if (base != 0) {
+			return base;
+		}
+	}
+
+	return ext_find_top(n->left, size, align, max_addr);
+}
+
+static phys_addr_t
+ext_find_bottom(struct lmb_extent *n,
+		size_t size,
+		size_t align,
+		phys_addr_t max_addr)
+{
+	phys_addr_t base;
+
+	if (n == NULL || n->max_size < size) {
+		return 0;
+	}
+
+	base = ext_find_bottom(n->left, size, align, max_addr);
+	if (base != 0) {
+		return base;
+	}
+
+	if (max_addr != LMB_ALLOC_ANYWHERE && n->base >= max_addr) {
+		return 0;
+	}
+
+	base = ext_fit_bottom(n, size, align, max_addr);
+	if (base != 0) {
+		return base;
+	}
+
+	return ext_find_bottom(n->right, size, align, max_addr);
+}
+
+typedef struct ext_best {
+	size_t size;
+	size_t align;
+	phys_addr_t max_addr;
+	bool_t no_huge;
+	phys_addr_t base;
+	size_t extent_size;
+} ext_best;
+
+static void
+ext_find_best(struct lmb_extent *n,
+	      ext_best *best)
+{
+	phys_addr_t base;
+
+	if (n == NULL || n->max_size < best->size) {
+		return;
+	}
+
+	ext_find_best(n->left, best);
+	if (best->max_addr != LMB_ALLOC_ANYWHERE &&
+	    n->base >= best->max_addr) {
+		return;
+	}
+
+	/*
+	 * Ties go to the higher extent, as visited later.
+	 */
+	if (n->size >= best->size &&
+	    (best->base == 0 || n->size <= best->extent_size) &&
+	    (!best->no_huge || !ext_has_huge(n))) {
+		base = ext_fit_top(n, best->size, best->align,
+				   best->max_addr);
+		if (base != 0) {
+			best->base = base;
+			best->extent_size = n->size;
+		}
+	}
+
+	ext_find_best(n->right, best);
+}
+
+phys_addr_t
+lmb_extents_find(struct lmb_extents *ext,
+		 size_t size,
+		 size_t align,
+		 phys_addr_t max_addr,
+		 lmb_policy_t policy)
+{
+	ext_best best;
+
+	if (policy == LMB_POLICY_KEEP_HUGE &&
+	    (size >= LMB_HUGE_SIZE || align >= LMB_HUGE_SIZE)) {
+		policy = LMB_POLICY_TOP_DOWN;
+	}
+
+	switch (policy) {
+	case LMB_POLICY_BOTTOM_UP:
+		return ext_find_bottom(ext->root, size, align, max_addr);
+	case LMB_POLICY_BEST_FIT:
+	case LMB_POLICY_KEEP_HUGE:
+		best.size = size;
+		best.align = align;
+		best.max_addr = max_addr;
+		best.base = 0;
+		best.extent_size = 0;
+		best.no_huge = policy == LMB_POLICY_KEEP_HUGE;
+		ext_find_best(ext->root, &best);
+		if (best.base == 0 && best.no_huge) {
+			best.no_huge = false;
+			ext_find_best(ext->root, &best);
+		}
+		return best.base;
+	}
+
+	return ext_find_top(ext->root, size, align, max_addr);
+}
+
+static void
+ext_largest_in(struct lmb_extent *n,
+	       phys_addr_t lo,
+	       phys_addr_t hi,
+	       size_t *largest)
+{
+	phys_addr_t b;
+	phys_addr_t e;
+
+	if (n == NULL || n->max_size <= *largest) {
+		return;
+	}
+
+	if (n->base < hi) {
+		ext_largest_in(n->right, lo, hi, largest);
+	}
+
+	b = max(n->base, lo);
+	e = min(n->base + n->size, hi);
+	if (b < e && e - b > *largest) {
+		*largest = e - b;
+	}
+
+	if (n->base > lo) {
+		ext_largest_in(n->left, lo, hi, largest);
+	}
+}
+
+/*
+ * Largest free piece within [lo, hi).
+ */
+size_t
+lmb_extents_largest_in(struct lmb_extents *ext,
+		       phys_addr_t lo,
+		       phys_addr_t hi)
+{
+	size_t largest = 0;
+
+	ext_largest_in(ext->root, lo, hi, &largest);
+	return largest;
+}
@@ -0,0 +1,116 @@
+/*
+ * Free extent index for logical memory blocks.
+ *
+ * Copyright (C) 2018 Andrei Warkentin <andrey.warkentin@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef LMB_EXTENTS_H
+#define LMB_EXTENTS_H
+
+#include <defs.h>
+
+/*
+ * An AVL tree of the free (added but not reserved) ranges,
+ * keyed by base and augmented with the largest extent size in
+ * each subtree, so that searches can skip subtrees that can't
+ * possibly fit.
+ */
+struct lmb_extent {
+	phys_addr_t base;
+	size_t size;
+	size_t max_size;
+	struct lmb_extent *left;
+	struct lmb_extent *right;
+	int height;
+};
+
+#define LMB_EXTENTS_INITIAL 64
+
+/*
+ * Placement policies.
+ *
+ * TOP_DOWN:  highest fit (the default).
+ * BOTTOM_UP: lowest fit.
+ * BEST_FIT:  fit in the smallest extent that can hold it,
+ *            highest in that extent.
+ * KEEP_HUGE: like BEST_FIT, but first only looks at extents
+ *            that don't contain a whole LMB_HUGE_SIZE-aligned
+ *            LMB_HUGE_SIZE block, so those stay available.
+ *            Allocations that are themselves huge are TOP_DOWN.
+ *
+ * BEST_FIT and KEEP_HUGE visit every extent large enough,
+ * rather than a single path down the tree.
+ */
+typedef uint32_t lmb_policy_t;
+#define LMB_POLICY_TOP_DOWN  0
+#define LMB_POLICY_BOTTOM_UP 1
+#define LMB_POLICY_BEST_FIT  2
+#define LMB_POLICY_KEEP_HUGE 3
+
+#define LMB_HUGE_SIZE MB(2)
+
+struct lmb_extents {
+	struct lmb_extent *root;
+	/*
+	 * Unused nodes, chained through 'right'.
+	 */
+	struct lmb_extent *spare;
+	unsigned long nr_spare;
+	unsigned long nr_nodes;
+	size_t total;
+	struct lmb_extent initial[LMB_EXTENTS_INITIAL];
+};
+
+void lmb_extents_init(struct lmb_extents *ext);
+void lmb_extents_add_nodes(struct lmb_extents *ext,
+			   struct lmb_extent *nodes,
+			   unsigned long count);
+void lmb_extents_insert(struct lmb_extents *ext,
+			phys_addr_t base,
+			size_t size);
+void lmb_extents_remove(struct lmb_extents *ext,
+			phys_addr_t base,
+			size_t size);
+phys_addr_t lmb_extents_find(struct lmb_extents *ext,
+			     size_t size,
+			     size_t align,
+			     phys_addr_t max_addr,
+			     lmb_policy_t policy);
+
+size_t lmb_extents_largest_in(struct lmb_extents *ext,
+			      phys_addr_t lo,
+			      phys_addr_t hi);
+
+static inline unsigned long
+lmb_extents_count(struct lmb_extents *ext)
+{
+	return ext->nr_nodes - ext->nr_spare;
+}
+
+static inline size_t
+lmb_extents_total(struct lmb_extents *ext)
+{
+	return ext->total;
+}
+
+static inline size_t
+lmb_extents_largest(struct lmb_extents *ext)
+{
+	return ext->root == NULL ? 0 : ext->root->max_size;
+}
+
+#endif /* LMB_EXTENTS_H */
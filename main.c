@@ -22,63 +22,27 @@
 #include <video_fb.h>
 #include <usbd.h>
 #include <lmb.h>
+#include <image_cache.h>
+#include <fdt_index.h>
+#include <fdt_scan.h>
+#include <cmdline.h>
 
 extern void fb_launch(void *fdt);
 
 struct lmb lmb;
 
-static uint64_t
-memparse(const char *ptr, char **retptr)
-{
-	/* local pointer to end of parsed string */
-	char *endptr;
-
-	uint64_t ret = simple_strtoull(ptr, &endptr, 0);
-
-	switch (*endptr) {
-	case 'G':
-	case 'g':
-		ret <<= 10;
-	case 'M':
-	case 'm':
-		ret <<= 10;
-	case 'K':
-	case 'k':
-		ret <<= 10;
-	endptr++;
-	default:
-		break;
-	}
-
-	if (retptr) {
-		*retptr = endptr;
-	}
-
-	return ret;
-}
-
-static int
-parse_memloc(const char *arg,
-	     uint64_t *psize,
-	     uint64_t *ploc)
-{
-	char *at;
-	unsigned long long size;
-
-	size = memparse(arg, &at);
-	if (*at != '@') {
-		/*
-		 * Treat a single location as a page at that address.
-		 */
-		*ploc = size;
-		*psize = PAGE_SIZE;
-		return 0;
-	}
+/*
+ * The index is needed to find memory, so it can't
+ * live in LMB memory.
+ */
+#define BOOT_FDT_INDEX_SIZE 0x20000
+static uint8_t boot_fdt_index_mem[BOOT_FDT_INDEX_SIZE];
+static arena boot_fdt_arena;
+fdt_index boot_fdt_index;
+static fdt_scan boot_fdt_scan;
+static cmdline boot_cmdline;
 
-	*ploc = memparse(at + 1, NULL);
-	*psize = size;
-	return 0;
-}
+#define PRINTK_RING_SIZE 0x10000
 
 static void
 arch_dump(void)
@@ -116,73 +80,40 @@ arch_dump(void)
 }
 
 static void
-dump_cmdline(const char *s)
+dump_cmdline(cmdline *c)
 {
-	const char *n = s;
+	unsigned long i;
+	cmdline_param *p;
 
-	if (s == NULL) {
+	if (c->nr_params == 0) {
 		printk("No cmdline\n");
 		return;
 	}
 
-	printk("Cmdline: ");
+	printk("Cmdline:");
 	/*
-	 * Dump is word by word because printk buffer has a maximum size.
+	 * Dump is param by param because printk buffer has a maximum size.
 	 */
-	while ((n = strchr (s, ' ')) != NULL) {
-		printk("%.*s", n - s + 1, s);
-		s = n + 1;
-	}
-
-	printk("%s\n", s);
-}
-
-static bool_t
-parse_range(const char *cmdline,
-	    const char *range_name,
-	    phys_addr_t *base,
-	    size_t *size)
-{
-	const char *param;
-	phys_addr_t b;
-	size_t s;
-
-	if (cmdline == NULL) {
-		return false;
-	}
-
-	param = strstr(cmdline, range_name);
-	if (param == NULL) {
-		return false;
-	}
-
-	if (parse_memloc(param + strlen(range_name), &s, &b) != 0) {
-		return false;
-	}
-
-	if (base != NULL) {
-		*base = b;
+	for (i = 0; i < c->nr_params; i++) {
+		p = &c->params[i];
+		printk(" %s%s%s", p->key, p->val == NULL ? "" : "=",
+		       p->val == NULL ? "" : p->val);
 	}
 
-	if (size != NULL) {
-		*size = s;
-	}
-
-	return true;
+	printk("\n");
 }
 
 static bool_t
-parse_and_reserve_range(const char *cmdline,
-			const char *range_name,
+parse_and_reserve_range(const char *range_name,
 			lmb_type_t type,
 			lmb_tag_t tag,
 			phys_addr_t *base,
-			size_t *size)
+			uint64_t *size)
 {
 	phys_addr_t b;
-	size_t s;
+	uint64_t s;
 
-	if (parse_range(cmdline, range_name, &b, &s)) {
+	if (cmdline_memloc(&boot_cmdline, range_name, &b, &s)) {
 		lmb_reserve(&lmb, b, s, type, tag);
 
 		if (base != NULL) {
@@ -199,40 +130,31 @@ parse_and_reserve_range(const char *cmdline,
 	return false;
 }
 
-static const char *
-fdt_get_cmdline(void *fdt)
-{
-	int node;
-
-	if (fdt_check_header(fdt) < 0) {
-		return NULL;
-	}
-
-	node = fdt_path_offset(fdt, "/chosen");
-	if (node < 0) {
-		return NULL;
-	}
-
-	return fdt_getprop(fdt, node, "bootargs", NULL);
-}
-
 void
 main(void *fdt, uint32_t el)
 {
-	int node;
-	int resv_count;
-	phys_addr_t base;
-	uint64_t size;
+	int scan_ret;
 	phys_addr_t fb_base;
 	uint64_t fb_size;
 	extern void *image_start;
 	extern void *image_end;
-	const char *cmdline = NULL;
+	int index_ret;
+	int cmdline_ret = 0;
+	phys_addr_t printk_mem;
+
+	arena_init_buffer(&boot_fdt_arena, boot_fdt_index_mem,
+			  sizeof(boot_fdt_index_mem));
+	index_ret = fdt_index_build(&boot_fdt_index, fdt, &boot_fdt_arena);
+	scan_ret = fdt_scan_boot(fdt, &boot_fdt_scan);
+
+	cmdline_init(&boot_cmdline);
+	if (boot_fdt_scan.cmdline != NULL) {
+		cmdline_ret = cmdline_append(&boot_cmdline,
+					     boot_fdt_scan.cmdline);
+	}
 
-	cmdline = fdt_get_cmdline(fdt);
-	if (cmdline == NULL ||
-	    !parse_range(cmdline, "tegra_fbmem=", &fb_base,
-			 &fb_size)) {
+	if (!cmdline_memloc(&boot_cmdline, "tegra_fbmem", &fb_base,
+			    &fb_size)) {
 		/*
 		 * The 1.3 firmware default.
 		 *
@@ -247,56 +169,56 @@ main(void *fdt, uint32_t el)
 	video_init(VP(fb_base));
 	printk("ShieldTV Loader (https://github.com/andreiw/shieldTV_loader) - ");
 	arch_dump();
+	if (index_ret != 0) {
+		printk("FDT index: couldn't build, lookups will be slow\n");
+	}
+	BUG_ON_EX(scan_ret != 0, "FDT header is bad");
+	if (boot_fdt_scan.partial) {
+		printk("FDT: structure damaged, only its start was used\n");
+	}
+	if (boot_fdt_scan.dropped != 0) {
+		printk("FDT: %lu ranges or subtrees ignored\n",
+		       boot_fdt_scan.dropped);
+	}
 
 	lmb_init(&lmb);
 
-	dump_cmdline(cmdline);
-
-	for (node = fdt_node_offset_by_dtype(fdt, -1, "memory");
-	     node != -1;
-	     node = fdt_node_offset_by_dtype(fdt, node, "memory")) {
-		int prop_len;
-		const uint32_t *prop = fdt_getprop(fdt, node, "reg", &prop_len);
-
-		BUG_ON_EX(prop == NULL, "node %d has no reg property", node);
-		while (prop_len != 0) {
-			base = fdt32_to_cpu(*(prop + 1)) |
-				((uint64_t) fdt32_to_cpu(*prop)) << 32;
-			prop += 2;
-			size = fdt32_to_cpu(*(prop + 1)) |
-				((uint64_t) fdt32_to_cpu(*prop)) << 32;
-			prop += 2;
-			lmb_add(&lmb, base, size, LMB_TAG("RAMR"));
-			prop_len -= 16;
-		}
+	dump_cmdline(&boot_cmdline);
+	if (cmdline_ret != 0) {
+		printk("Cmdline: too long, the rest is ignored\n");
 	}
 
+	/*
+	 * RAM, /reserved-memory, /memreserve/ and the initrd.
+	 */
+	fdt_scan_to_lmb(&boot_fdt_scan, &lmb);
+
 	/*
 	 * Not seen on the shield with my firmware version (2.1),
 	 * but just in case.
 	 */
-	parse_and_reserve_range(cmdline, "tsec=", LMB_RUNTIME,
+	parse_and_reserve_range("tsec", LMB_RUNTIME,
 				LMB_TAG("TSEC"), NULL, NULL);
 
 	/*
 	 * Not seen on the shield with my firmware version (2.1), but
 	 * just in case.
 	 */
-	parse_and_reserve_range(cmdline, "vpr=", LMB_RUNTIME,
+	parse_and_reserve_range("vpr", LMB_RUNTIME,
 				LMB_TAG("VPRR"), NULL, NULL);
 
 	/*
 	 * On my shield, above reported available memory ranges, but
 	 * just in case.
 	 */
-	parse_and_reserve_range(cmdline, "lp0_vec=", LMB_RUNTIME,
+	parse_and_reserve_range("lp0_vec", LMB_RUNTIME,
 				LMB_TAG("LP0V"), NULL, NULL);
 
 	/*
 	 * On my shield, above reported available memory ranges, but
 	 * just in case.
 	 */
-	parse_and_reserve_range(cmdline, "nvdumper_reserved=", LMB_RUNTIME,
+	parse_and_reserve_range("nvdumper_reserved", LMB_RUNTIME,
 				LMB_TAG("NVDR"), NULL, NULL);
 
 	lmb_reserve(&lmb, fb_base, fb_size,
@@ -309,13 +231,16 @@ main(void *fdt, uint32_t el)
 		    UN(&image_end) - UN(&image_start), LMB_BOOT,
 		    LMB_TAG("LDRS"));
 
-	resv_count = fdt_num_mem_rsv(fdt);
-	for (node = 0; node < resv_count; node++) {
-		phys_addr_t base;
-		size_t size;
+	image_cache_init(&lmb);
 
-		fdt_get_mem_rsv(fdt, node, &base, &size);
-		lmb_reserve(&lmb, base, size, LMB_BOOT, LMB_TAG("RESV"));
+	/*
+	 * From here on, printk output is drawn by the fastboot
+	 * loop when there's no USB traffic to handle.
+	 */
+	printk_mem = lmb_alloc(&lmb, PRINTK_RING_SIZE, PAGE_SIZE,
+			       LMB_BOOT, LMB_TAG("PRNK"));
+	if (printk_mem != 0) {
+		printk_ring_init(VP(printk_mem), PRINTK_RING_SIZE);
 	}
 
 	fb_launch(fdt);
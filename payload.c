@@ -0,0 +1,976 @@
+/*
+ * Preparing downloaded images for execution.
+ *
+ * Copyright (C) 2018 Andrei Warkentin <andrey.warkentin@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <lib.h>
+#include <libfdt.h>
+#include <bootimg.h>
+#include <elf.h>
+#include <payload.h>
+#include <cmdline.h>
+
+/*
+ * arm64 kernels want to live at a 2MB-aligned base.
+ */
+#define PAYLOAD_KERNEL_ALIGN MB(2)
+
+/*
+ * Room for growing /chosen and adding /reserved-memory
+ * in the FDT copy.
+ */
+#define PAYLOAD_FDT_SLACK 0x10000
+
+/*
+ * See Documentation/arm64/booting.txt. start.S emits
+ * the same header.
+ */
+#define ARM64_IMAGE_MAGIC 0x644d5241 /* "ARM\x64" */
+#define ARM64_IMAGE_FLAG_ANYWHERE BIT(3)
+
+typedef struct arm64_image {
+	uint32_t code0;
+	uint32_t code1;
+	uint64_t text_offset;
+	uint64_t image_size;
+	uint64_t flags;
+	uint64_t res2;
+	uint64_t res3;
+	uint64_t res4;
+	uint32_t magic;
+	uint32_t res5;
+} arm64_image;
+
+static char payload_bootargs[CMDLINE_SIZE];
+static cmdline payload_cmdline;
+
+static void *
+payload_alloc_mem(payload *p,
+		  size_t size,
+		  size_t align,
+		  uint32_t tag,
+		  lmb_policy_t policy)
+{
+	phys_addr_t base;
+	payload_alloc *a;
+
+	if (p->nr_allocs == PAYLOAD_MAX_ALLOCS) {
+		return NULL;
+	}
+
+	/*
+	 * Below 4GB, so that the kernel can find everything
+	 * before it has its own view of memory.
+	 */
+	base = lmb_alloc_policy(&lmb, size, align, LMB_ALLOC_32BIT,
+				LMB_BOOT, tag, policy);
+	if (base == 0) {
+		return NULL;
+	}
+
+	a = &p->allocs[p->nr_allocs++];
+	a->base = base;
+	a->size = size;
+	a->align = align;
+	return VP(base);
+}
+
+/*
+ * For images that must live at a fixed address.
+ */
+static void *
+payload_reserve_mem(payload *p,
+		    phys_addr_t base,
+		    size_t size,
+		    uint32_t tag)
+{
+	payload_alloc *a;
+
+	if (p->nr_allocs == PAYLOAD_MAX_ALLOCS) {
+		return NULL;
+	}
+
+	/*
+	 * We must not scribble over anything, including the
+	 * download buffer itself. lmb_reserve already fails on
+	 * an overlap (lmb_add_region returns -1), the explicit
+	 * check just says so.
+	 */
+	if (lmb_overlaps_region(&lmb.reserved, base, size) != NULL ||
+	    lmb_reserve(&lmb, base, size, LMB_BOOT, tag) < 0) {
+		return NULL;
+	}
+
+	a = &p->allocs[p->nr_allocs++];
+	a->base = base;
+	a->size = size;
+	a->align = 1;
+	return VP(base);
+}
+
+/*
+ * Places a kernel at a 2MB-aligned base. An arm64 Image gets
+ * text_offset and the full image_size (i.e. including BSS) honoured,
+ * so it doesn't have to relocate itself.
+ */
+static void *
+payload_place_kernel(payload *p,
+		     void *kernel,
+		     size_t size)
+{
+	void *base;
+	uint64_t text_offset = 0;
+	uint64_t image_size = size;
+	arm64_image *hdr = kernel;
+	lmb_policy_t policy = LMB_POLICY_TOP_DOWN;
+
+	if (size >= sizeof(arm64_image) &&
+	    le32_to_cpu(hdr->magic) == ARM64_IMAGE_MAGIC) {
+		text_offset = le64_to_cpu(hdr->text_offset);
+		/*
+		 * Pre-3.17 kernels leave image_size as 0.
+		 */
+		if (hdr->image_size != 0) {
+			image_size = max(le64_to_cpu(hdr->image_size),
+					 (uint64_t) size);
+		}
+
+		if (text_offset >= PAYLOAD_KERNEL_ALIGN ||
+		    (text_offset & (PAGE_SIZE - 1)) != 0) {
+			printk("Image: bad text_offset 0x%lx\n", text_offset);
+			return NULL;
+		}
+
+		/*
+		 * Without the flag (i.e. before 4.6), the kernel
+		 * can't use any RAM below where it's loaded, so
+		 * it goes as low as possible.
+		 */
+		if ((le64_to_cpu(hdr->flags) &
+		     ARM64_IMAGE_FLAG_ANYWHERE) == 0) {
+			policy = LMB_POLICY_BOTTOM_UP;
+		}
+	}
+
+	base = payload_alloc_mem(p, text_offset + image_size,
+				 PAYLOAD_KERNEL_ALIGN, LMB_TAG("KERN"),
+				 policy);
+	if (base == NULL) {
+		printk("Image: out of memory\n");
+		return NULL;
+	}
+
+	memcpy(base + text_offset, kernel, size);
+	return base + text_offset;
+}
+
+void
+payload_release(payload *p)
+{
+	while (p->nr_allocs != 0) {
+		payload_alloc *a = &p->allocs[--p->nr_allocs];
+		lmb_free(&lmb, a->base, a->size, a->align);
+	}
+
+	p->entry = NULL;
+	p->fdt = NULL;
+}
+
+/*
+ * The payload gets a copy of the FDT with room to grow, so
+ * that the original (or the one in the download buffer) is
+ * left alone.
+ */
+static void *
+payload_fdt_copy(payload *p,
+		 void *fdt)
+{
+	int ret;
+	void *copy;
+	size_t size;
+
+	if (fdt_check_header(fdt) != 0) {
+		printk("FDT: bad header\n");
+		return NULL;
+	}
+
+	size = fdt_totalsize(fdt) + PAYLOAD_FDT_SLACK;
+	copy = payload_alloc_mem(p, size, PAGE_SIZE, LMB_TAG("PFDT"),
+				 LMB_POLICY_TOP_DOWN);
+	if (copy == NULL) {
+		printk("FDT: out of memory\n");
+		return NULL;
+	}
+
+	ret = fdt_open_into(fdt, copy, size);
+	if (ret != 0) {
+		printk("FDT: fdt_open_into: %s\n", fdt_strerror(ret));
+		return NULL;
+	}
+
+	return copy;
+}
+
+static int
+payload_fdt_chosen(payload *p,
+		   void *fdt,
+		   boot_img *img,
+		   void *ramdisk)
+{
+	int len;
+	int extra_len;
+	int chosen;
+	const char *args;
+
+	chosen = fdt_path_offset(fdt, "/chosen");
+	if (chosen < 0) {
+		chosen = fdt_add_subnode(fdt, 0, "chosen");
+		if (chosen < 0) {
+			return -1;
+		}
+	}
+
+	if (ramdisk != NULL) {
+		if (fdt_setprop_u64(fdt, chosen, "linux,initrd-start",
+				    (uint64_t) ramdisk) != 0 ||
+		    fdt_setprop_u64(fdt, chosen, "linux,initrd-end",
+				    (uint64_t) ramdisk +
+				    img->ramdisk_size) != 0) {
+			return -1;
+		}
+	}
+
+	cmdline_init(&payload_cmdline);
+	args = fdt_getprop(fdt, chosen, "bootargs", &len);
+	if (args != NULL && len > 0 && args[len - 1] == '\0' &&
+	    cmdline_append(&payload_cmdline, args) != 0) {
+		return -1;
+	}
+
+	/*
+	 * The header fields need not be NUL-terminated, and
+	 * extra_cmdline carries on where cmdline stops.
+	 */
+	C_ASSERT(sizeof(payload_bootargs) > BOOT_ARGS_SIZE +
+		 BOOT_EXTRA_ARGS_SIZE);
+	len = strnlen((char *) img->cmdline, BOOT_ARGS_SIZE);
+	if (len != 0) {
+		memcpy(payload_bootargs, img->cmdline, len);
+		extra_len = strnlen((char *) img->extra_cmdline,
+				    BOOT_EXTRA_ARGS_SIZE);
+		memcpy(payload_bootargs + len, img->extra_cmdline, extra_len);
+		payload_bootargs[len + extra_len] = '\0';
+		if (cmdline_append(&payload_cmdline, payload_bootargs) != 0) {
+			return -1;
+		}
+	}
+
+	if (cmdline_write(&payload_cmdline, payload_bootargs,
+			  sizeof(payload_bootargs)) < 0) {
+		return -1;
+	}
+
+	if (fdt_setprop_string(fdt, chosen, "bootargs",
+			       payload_bootargs) != 0) {
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * own_fdt is set if the payload gets (a copy of) the FDT
+ * we were started with, rather than one from the image.
+ */
+static int
+payload_prepare_bootimg(payload *p,
+			void *image,
+			size_t size,
+			void *fdt,
+			bool_t *own_fdt)
+{
+	void *kernel;
+	void *fdt_copy;
+	void *fdt_src;
+	uint64_t fdt_size = 0;
+	void *ramdisk = NULL;
+	boot_img *img = image;
+	uint64_t page = img->page_size;
+	uint64_t kernel_off;
+	uint64_t ramdisk_off;
+	uint64_t second_off;
+	uint64_t dtbo_off;
+	uint64_t dtb_off;
+	uint64_t end;
+
+	if (size < sizeof(boot_img) ||
+	    page < sizeof(boot_img) ||
+	    (page & (page - 1)) != 0 ||
+	    img->header_version > 2 ||
+	    img->kernel_size == 0) {
+		printk("Boot image: bad header\n");
+		return -1;
+	}
+
+	kernel_off = page;
+	ramdisk_off = kernel_off + A_UP(img->kernel_size, page);
+	second_off = ramdisk_off + A_UP(img->ramdisk_size, page);
+	dtbo_off = second_off + A_UP(img->second_size, page);
+	dtb_off = dtbo_off;
+	end = second_off + img->second_size;
+	if (img->header_version >= 1) {
+		dtb_off += A_UP(img->recovery_dtbo_size, page);
+		end = dtbo_off + img->recovery_dtbo_size;
+	}
+	if (img->header_version >= 2) {
+		end = dtb_off + img->dtb_size;
+	}
+
+	if (end > size) {
+		printk("Boot image: truncated (0x%lx > 0x%lx)\n", end, size);
+		return -1;
+	}
+
+	kernel = payload_place_kernel(p, image + kernel_off,
+				      img->kernel_size);
+	if (kernel == NULL) {
+		goto err;
+	}
+
+	if (img->ramdisk_size != 0) {
+		ramdisk = payload_alloc_mem(p, img->ramdisk_size,
+					    PAGE_SIZE, LMB_TAG("RDSK"),
+					    LMB_POLICY_TOP_DOWN);
+		if (ramdisk == NULL) {
+			goto oom;
+		}
+		memcpy(ramdisk, image + ramdisk_off, img->ramdisk_size);
+	}
+
+	/*
+	 * A v2 header carries the DTB explicitly. Older images
+	 * often smuggle it in as the second stage. Otherwise, the
+	 * firmware-provided FDT gets handed down.
+	 */
+	fdt_src = fdt;
+	if (img->header_version >= 2 && img->dtb_size != 0) {
+		fdt_src = image + dtb_off;
+		fdt_size = img->dtb_size;
+	} else if (img->second_size >= sizeof(struct fdt_header) &&
+		   fdt_check_header(image + second_off) == 0) {
+		fdt_src = image + second_off;
+		fdt_size = img->second_size;
+	}
+
+	/*
+	 * Copying it reads totalsize bytes, which must not
+	 * run past its section (or the download).
+	 */
+	if (fdt_src != fdt &&
+	    (fdt_size < sizeof(struct fdt_header) ||
+	     fdt_check_header(fdt_src) != 0 ||
+	     fdt_totalsize(fdt_src) > fdt_size)) {
+		printk("Boot image: bad FDT\n");
+		goto err;
+	}
+
+	fdt_copy = payload_fdt_copy(p, fdt_src);
+	if (fdt_copy == NULL) {
+		goto err;
+	}
+	*own_fdt = fdt_src == fdt;
+
+	if (payload_fdt_chosen(p, fdt_copy, img, ramdisk) != 0) {
+		printk("Boot image: could not update /chosen\n");
+		goto err;
+	}
+
+	printk("Boot image v%u: kernel %p ramdisk %p-%p fdt %p\n",
+	       img->header_version, kernel, ramdisk,
+	       ramdisk + img->ramdisk_size, fdt_copy);
+	p->entry = kernel;
+	p->fdt = fdt_copy;
+	return 0;
+oom:
+	printk("Boot image: out of memory\n");
+err:
+	payload_release(p);
+	return -1;
+}
+
+/*
+ * Whether [addr, addr + size) is within the loaded image
+ * (by link address), and suitably aligned for 64-bit loads.
+ */
+static bool_t
+payload_elf_inside(uint64_t addr,
+		   uint64_t size,
+		   uint64_t lo,
+		   uint64_t hi)
+{
+	return addr >= lo && addr <= hi && size <= hi - addr &&
+		(addr & (sizeof(uint64_t) - 1)) == 0;
+}
+
+/*
+ * Everything the dynamic section points to is checked against
+ * the loaded image, so a malformed ELF fails here rather than
+ * have us read (or write) arbitrary memory.
+ */
+static int
+payload_elf_relocate(Elf64_Ehdr *ehdr,
+		     Elf64_Phdr *phdrs,
+		     uint64_t lo,
+		     uint64_t hi,
+		     uint64_t bias)
+{
+	unsigned i;
+	uint64_t nr_dyn = 0;
+	Elf64_Dyn *dyn = NULL;
+	uint64_t rela_addr = 0;
+	Elf64_Rela *rela;
+	uint64_t relasz = 0;
+	uint64_t relaent = sizeof(Elf64_Rela);
+
+	for (i = 0; i < ehdr->e_phnum; i++) {
+		if (phdrs[i].p_type == PT_DYNAMIC) {
+			if (!payload_elf_inside(phdrs[i].p_vaddr,
+						phdrs[i].p_memsz, lo, hi)) {
+				return -1;
+			}
+
+			dyn = VP(phdrs[i].p_vaddr + bias);
+			nr_dyn = phdrs[i].p_memsz / sizeof(Elf64_Dyn);
+			break;
+		}
+	}
+
+	if (dyn == NULL) {
+		return 0;
+	}
+
+	for (; nr_dyn != 0 && dyn->d_tag != DT_NULL; nr_dyn--, dyn++) {
+		if (dyn->d_tag == DT_RELA) {
+			rela_addr = dyn->d_val;
+		} else if (dyn->d_tag == DT_RELASZ) {
+			relasz = dyn->d_val;
+		} else if (dyn->d_tag == DT_RELAENT) {
+			relaent = dyn->d_val;
+		}
+	}
+
+	/*
+	 * No DT_NULL within PT_DYNAMIC.
+	 */
+	if (nr_dyn == 0) {
+		return -1;
+	}
+
+	if (rela_addr == 0) {
+		return 0;
+	}
+
+	if (relaent < sizeof(Elf64_Rela) ||
+	    (relaent & (sizeof(uint64_t) - 1)) != 0 ||
+	    !payload_elf_inside(rela_addr, relasz, lo, hi)) {
+		return -1;
+	}
+
+	/*
+	 * Same as reloc_loop in start.S.
+	 */
+	rela = VP(rela_addr + bias);
+	for (; relasz >= relaent; relasz -= relaent,
+		     rela = VP(rela) + relaent) {
+		if (ELF64_R_TYPE(rela->r_info) != R_AARCH64_RELATIVE) {
+			continue;
+		}
+
+		if (!payload_elf_inside(rela->r_offset, sizeof(uint64_t),
+					lo, hi)) {
+			return -1;
+		}
+
+		*(uint64_t *) VP(rela->r_offset + bias) =
+			rela->r_addend + bias;
+	}
+
+	return 0;
+}
+
+/*
+ * e_entry is a virtual address, so it's translated through
+ * the PT_LOAD that contains it. Returns NULL if none does.
+ */
+static void *
+payload_elf_entry(Elf64_Ehdr *ehdr,
+		  Elf64_Phdr *phdrs,
+		  uint64_t bias)
+{
+	unsigned i;
+	uint64_t off;
+
+	for (i = 0; i < ehdr->e_phnum; i++) {
+		Elf64_Phdr *ph = &phdrs[i];
+
+		if (ph->p_type != PT_LOAD ||
+		    ehdr->e_entry < ph->p_vaddr) {
+			continue;
+		}
+
+		off = ehdr->e_entry - ph->p_vaddr;
+		if (off >= ph->p_memsz) {
+			continue;
+		}
+
+		if (ehdr->e_type == ET_EXEC) {
+			return VP(ph->p_paddr + off);
+		}
+
+		return VP(ehdr->e_entry + bias);
+	}
+
+	return NULL;
+}
+
+/*
+ * ET_EXEC segments go exactly where they were linked.
+ * ET_DYN images get one allocation spanning all segments,
+ * and R_AARCH64_RELATIVE relocations are applied for the
+ * resulting bias. Either way each segment is copied once
+ * straight out of the download buffer.
+ */
+static int
+payload_prepare_elf(payload *p,
+		    void *image,
+		    size_t size,
+		    void *fdt)
+{
+	unsigned i;
+	void *base;
+	Elf64_Phdr *phdrs;
+	uint64_t bias = 0;
+	uint64_t reserved_end = 0;
+	uint64_t loaded_end = 0;
+	Elf64_Ehdr *ehdr = image;
+	uint64_t lo = ULONG_MAX;
+	uint64_t hi = 0;
+	uint64_t align = PAGE_SIZE;
+
+	if (size < sizeof(Elf64_Ehdr) ||
+	    ehdr->e_ident[EI_CLASS] != ELFCLASS64 ||
+	    ehdr->e_ident[EI_DATA] != ELFDATA2LSB ||
+	    ehdr->e_machine != EM_AARCH64 ||
+	    (ehdr->e_type != ET_EXEC && ehdr->e_type != ET_DYN) ||
+	    ehdr->e_phentsize != sizeof(Elf64_Phdr) ||
+	    ehdr->e_phoff > size ||
+	    ehdr->e_phnum > (size - ehdr->e_phoff) / sizeof(Elf64_Phdr)) {
+		printk("ELF: bad header\n");
+		return -1;
+	}
+
+	phdrs = image + ehdr->e_phoff;
+	for (i = 0; i < ehdr->e_phnum; i++) {
+		Elf64_Phdr *ph = &phdrs[i];
+
+		if (ph->p_type != PT_LOAD || ph->p_memsz == 0) {
+			continue;
+		}
+
+		if (ph->p_filesz > ph->p_memsz ||
+		    ph->p_offset > size ||
+		    ph->p_filesz > size - ph->p_offset) {
+			printk("ELF: bad segment %u\n", i);
+			return -1;
+		}
+
+		lo = min(lo, A_DOWN(ph->p_vaddr, PAGE_SIZE));
+		hi = max(hi, A_UP(ph->p_vaddr + ph->p_memsz, PAGE_SIZE));
+		if (ph->p_align > align) {
+			align = ph->p_align;
+		}
+	}
+
+	if (hi == 0) {
+		printk("ELF: nothing to load\n");
+		return -1;
+	}
+
+	if (ehdr->e_type == ET_DYN) {
+		base = payload_alloc_mem(p, hi - lo, min(align, MB(2)),
+					 LMB_TAG("ELFD"), LMB_POLICY_TOP_DOWN);
+		if (base == NULL) {
+			printk("ELF: out of memory\n");
+			return -1;
+		}
+		bias = (uint64_t) base - lo;
+	}
+
+	for (i = 0; i < ehdr->e_phnum; i++) {
+		Elf64_Phdr *ph = &phdrs[i];
+		uint64_t dest;
+
+		if (ph->p_type != PT_LOAD || ph->p_memsz == 0) {
+			continue;
+		}
+
+		if (ehdr->e_type == ET_EXEC) {
+			uint64_t seg_lo = A_DOWN(ph->p_paddr, PAGE_SIZE);
+			uint64_t seg_hi = A_UP(ph->p_paddr + ph->p_memsz,
+					       PAGE_SIZE);
+
+			/*
+			 * PT_LOADs are sorted, but adjacent ones may
+			 * share a page.
+			 */
+			if (ph->p_paddr < loaded_end) {
+				printk("ELF: overlapping segment %u\n", i);
+				goto err;
+			}
+			loaded_end = ph->p_paddr + ph->p_memsz;
+			seg_lo = max(seg_lo, reserved_end);
+			if (seg_hi > seg_lo &&
+			    payload_reserve_mem(p, seg_lo, seg_hi - seg_lo,
+						LMB_TAG("ELFS")) == NULL) {
+				printk("ELF: can't place segment %u at 0x%lx\n",
+				       i, ph->p_paddr);
+				goto err;
+			}
+			reserved_end = max(reserved_end, seg_hi);
+			dest = ph->p_paddr;
+		} else {
+			dest = ph->p_vaddr + bias;
+		}
+
+		memcpy(VP(dest), image + ph->p_offset, ph->p_filesz);
+		memset(VP(dest + ph->p_filesz), 0,
+		       ph->p_memsz - ph->p_filesz);
+	}
+
+	if (ehdr->e_type == ET_DYN &&
+	    payload_elf_relocate(ehdr, phdrs, lo, hi, bias) != 0) {
+		printk("ELF: bad relocations\n");
+		goto err;
+	}
+
+	p->entry = payload_elf_entry(ehdr, phdrs, bias);
+	if (p->entry == NULL) {
+		printk("ELF: entry 0x%lx is not in a segment\n",
+		       ehdr->e_entry);
+		goto err;
+	}
+
+	printk("ELF: entry %p\n", p->entry);
+	p->fdt = fdt;
+	return 0;
+err:
+	payload_release(p);
+	return -1;
+}
+
+/*
+ * What the payload must keep its hands off: everything
+ * LMB_RUNTIME (firmware carveouts, the framebuffer, the image
+ * cache), and the firmware's own /memreserve/ entries, which
+ * a DTB from a boot image wouldn't carry. The firmware's
+ * /reserved-memory nodes only need repeating in such a DTB.
+ */
+static bool_t
+payload_region_kept(struct lmb_property *r,
+		    bool_t own_fdt)
+{
+	if (r->tag == LMB_TAG("RMEM") || r->tag == LMB_TAG("RMNM")) {
+		return !own_fdt;
+	}
+
+	return r->type == LMB_RUNTIME ||
+		(r->type == LMB_BOOT && r->tag == LMB_TAG("RESV"));
+}
+
+static bool_t
+payload_fdt_has_rsv(void *fdt,
+		    phys_addr_t base,
+		    size_t size)
+{
+	int i;
+	uint64_t b;
+	uint64_t s;
+	int count = fdt_num_mem_rsv(fdt);
+
+	for (i = 0; i < count; i++) {
+		if (fdt_get_mem_rsv(fdt, i, &b, &s) == 0 &&
+		    b == base && s == size) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * 'def' is the devicetree spec default: 2 for
+ * #address-cells, 1 for #size-cells.
+ */
+static int
+payload_fdt_cells(void *fdt,
+		  int node,
+		  const char *name,
+		  int def)
+{
+	int len;
+	const uint32_t *cells = fdt_getprop(fdt, node, name, &len);
+
+	if (cells == NULL || len != sizeof(uint32_t)) {
+		return def;
+	}
+
+	return fdt32_to_cpu(*cells);
+}
+
+/*
+ * Returns the /reserved-memory node, creating it if needed.
+ */
+static int
+payload_fdt_resmem(void *fdt)
+{
+	int node;
+	uint32_t two = cpu_to_fdt32(2);
+
+	node = fdt_path_offset(fdt, "/reserved-memory");
+	if (node >= 0) {
+		return node;
+	}
+
+	node = fdt_add_subnode(fdt, 0, "reserved-memory");
+	if (node < 0 ||
+	    fdt_setprop(fdt, node, "#address-cells", &two,
+			sizeof(two)) != 0 ||
+	    fdt_setprop(fdt, node, "#size-cells", &two,
+			sizeof(two)) != 0 ||
+	    fdt_setprop(fdt, node, "ranges", NULL, 0) != 0) {
+		return -1;
+	}
+
+	return node;
+}
+
+static int
+payload_fdt_resmem_add(void *fdt,
+		       int parent,
+		       struct lmb_property *r)
+{
+	int i;
+	int n = 0;
+	int node;
+	char name[32];
+	char tag[sizeof(lmb_tag_t) + 1];
+	uint32_t reg[4];
+	int acells = payload_fdt_cells(fdt, parent, "#address-cells", 2);
+	int scells = payload_fdt_cells(fdt, parent, "#size-cells", 1);
+
+	if (acells < 1 || acells > 2 || scells < 1 || scells > 2 ||
+	    (acells == 1 && r->base + r->size - 1 > UINT32_MAX) ||
+	    (scells == 1 && r->size > UINT32_MAX)) {
+		printk("FDT: can't describe 0x%lx-0x%lx\n",
+		       r->base, r->base + r->size - 1);
+		return 0;
+	}
+
+	/*
+	 * Node names are the tag, lowercased, with anything
+	 * that's not allowed in a node name turned into '_'.
+	 */
+	memcpy(tag, &r->tag, sizeof(lmb_tag_t));
+	tag[sizeof(lmb_tag_t)] = '\0';
+	for (i = 0; tag[i] != '\0'; i++) {
+		tag[i] = isalnum(tag[i]) ? tolower(tag[i]) : '_';
+	}
+	scnprintf(name, sizeof(name), "%s@%lx", tag, r->base);
+
+	node = fdt_add_subnode(fdt, parent, name);
+	if (node == -FDT_ERR_EXISTS) {
+		return 0;
+	} else if (node < 0) {
+		return -1;
+	}
+
+	if (acells == 2) {
+		reg[n++] = cpu_to_fdt32(r->base >> 32);
+	}
+	reg[n++] = cpu_to_fdt32(r->base);
+	if (scells == 2) {
+		reg[n++] = cpu_to_fdt32(r->size >> 32);
+	}
+	reg[n++] = cpu_to_fdt32(r->size);
+
+	if (fdt_setprop(fdt, node, "reg", reg, n * sizeof(uint32_t)) != 0) {
+		return -1;
+	}
+
+	if (r->type == LMB_RUNTIME && r->tag != LMB_TAG("RMEM") &&
+	    fdt_setprop(fdt, node, "no-map", NULL, 0) != 0) {
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Describes what the payload must preserve as /memreserve/
+ * entries (for everything) and /reserved-memory nodes (for
+ * anything that understands them), named after the LMB tag.
+ */
+static int
+payload_fdt_reserve(payload *p,
+		    bool_t own_fdt)
+{
+	int node;
+	struct lmb_property *r;
+	void *fdt = p->fdt;
+
+	node = payload_fdt_resmem(fdt);
+	if (node < 0) {
+		return -1;
+	}
+
+	for (r = lmb_region_first(&lmb.reserved); r != NULL;
+	     r = lmb_region_next(&lmb.reserved, r)) {
+		if (!payload_region_kept(r, own_fdt)) {
+			continue;
+		}
+
+		if (!payload_fdt_has_rsv(fdt, r->base, r->size) &&
+		    fdt_add_mem_rsv(fdt, r->base, r->size) != 0) {
+			return -1;
+		}
+
+		/*
+		 * Adding the reservation moves the node.
+		 */
+		node = fdt_path_offset(fdt, "/reserved-memory");
+		if (node < 0 ||
+		    payload_fdt_resmem_add(fdt, node, r) != 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int
+payload_prepare_image(payload *p,
+		      void *image,
+		      size_t size,
+		      void *fdt,
+		      bool_t *own_fdt)
+{
+	*own_fdt = true;
+	if (size >= BOOT_MAGIC_SIZE &&
+	    !memcmp(image, BOOT_MAGIC, BOOT_MAGIC_SIZE)) {
+		return payload_prepare_bootimg(p, image, size, fdt,
+					       own_fdt);
+	}
+
+	if (size >= SELFMAG &&
+	    !memcmp(image, ELFMAG, SELFMAG)) {
+		return payload_prepare_elf(p, image, size, fdt);
+	}
+
+	p->fdt = fdt;
+	if (size >= sizeof(arm64_image) &&
+	    le32_to_cpu(((arm64_image *) image)->magic) ==
+	    ARM64_IMAGE_MAGIC) {
+		p->entry = payload_place_kernel(p, image, size);
+		if (p->entry == NULL) {
+			payload_release(p);
+			return -1;
+		}
+
+		return 0;
+	}
+
+	/*
+	 * Raw binary, run in place.
+	 */
+	p->entry = image;
+	return 0;
+}
+
+int
+payload_prepare(payload *p,
+		void *image,
+		size_t size,
+		void *fdt)
+{
+	void *copy;
+	bool_t own_fdt;
+
+	p->nr_allocs = 0;
+	p->fdt = NULL;
+	if (payload_prepare_image(p, image, size, fdt, &own_fdt) != 0) {
+		return -1;
+	}
+
+	if (p->fdt == NULL) {
+		return 0;
+	}
+
+	/*
+	 * Boot images already come with their own copy. Made
+	 * after everything else is placed, so an ELF linked at
+	 * a fixed address doesn't run into it.
+	 */
+	if (p->fdt == fdt) {
+		copy = payload_fdt_copy(p, fdt);
+		if (copy == NULL) {
+			goto err;
+		}
+		p->fdt = copy;
+	}
+
+	if (payload_fdt_reserve(p, own_fdt) != 0) {
+		printk("FDT: no room for reservations\n");
+		goto err;
+	}
+
+	return 0;
+err:
+	payload_release(p);
+	return -1;
+}
+
+void
+payload_enter(payload *p)
+{
+	void (*entry)(void *fdt, uint64_t x1,
+		      uint64_t x2, uint64_t x3) = p->entry;
+
+	/*
+	 * Code was just copied into place.
+	 */
+	DSB_ISH();
+	IC_IALLU();
+	DSB_ISH();
+	ISB();
+
+	/*
+	 * arm64 boot protocol: x0 = FDT, x1-x3 = 0.
+	 */
+	entry(p->fdt, 0, 0, 0);
+	BUG();
+}
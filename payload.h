@@ -0,0 +1,52 @@
+/*
+ * Preparing downloaded images for execution.
+ *
+ * Copyright (C) 2018 Andrei Warkentin <andrey.warkentin@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef PAYLOAD_H
+#define PAYLOAD_H
+
+#include <lmb.h>
+
+#define PAYLOAD_MAX_ALLOCS 8
+
+typedef struct payload_alloc {
+	phys_addr_t base;
+	size_t size;
+	size_t align;
+} payload_alloc;
+
+typedef struct payload {
+	void *entry;
+	void *fdt;
+	/*
+	 * LMB allocations backing the kernel, ramdisk, ELF
+	 * segments and FDT copy, released by payload_release.
+	 */
+	payload_alloc allocs[PAYLOAD_MAX_ALLOCS];
+	unsigned nr_allocs;
+} payload;
+
+int payload_prepare(payload *p,
+		    void *image,
+		    size_t size,
+		    void *fdt);
+void payload_release(payload *p);
+void payload_enter(payload *p) __noreturn;
+
+#endif /* PAYLOAD_H */
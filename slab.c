@@ -0,0 +1,113 @@
+/*
+ * Fixed-size object caches on top of LMB.
+ *
+ * Copyright (C) 2018 Andrei Warkentin <andrey.warkentin@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <lib.h>
+#include <slab.h>
+
+/*
+ * Chunks hold at least this many objects.
+ */
+#define SLAB_MIN_OBJS 8
+
+void
+slab_cache_init(slab_cache *cache,
+		size_t size,
+		size_t align,
+		phys_addr_t max_addr,
+		lmb_tag_t tag)
+{
+	BUG_ON(align == 0 || (align & (align - 1)) != 0);
+
+	align = max(align, sizeof(void *));
+	cache->stride = A_UP(max(size, sizeof(void *)), align);
+	cache->align = align;
+	cache->chunk_size = A_UP(max((size_t) SLAB_CHUNK_SIZE,
+				     cache->stride * SLAB_MIN_OBJS),
+				 PAGE_SIZE);
+	cache->max_addr = max_addr;
+	cache->tag = tag;
+	cache->free = NULL;
+	cache->nr_free = 0;
+	cache->nr_objs = 0;
+	cache->nr_chunks = 0;
+}
+
+static bool_t
+slab_grow(slab_cache *cache)
+{
+	size_t i;
+	uint8_t *chunk;
+	size_t count = cache->chunk_size / cache->stride;
+
+	chunk = VP(lmb_alloc_policy(&lmb, cache->chunk_size,
+				    max(cache->align, (size_t) PAGE_SIZE),
+				    cache->max_addr, LMB_BOOT, cache->tag,
+				    LMB_POLICY_KEEP_HUGE));
+	if (chunk == NULL) {
+		return false;
+	}
+
+	/*
+	 * Pushed in reverse, so objects are handed out
+	 * in address order.
+	 */
+	for (i = count; i != 0; i--) {
+		void **obj = (void **) (chunk + (i - 1) * cache->stride);
+
+		*obj = cache->free;
+		cache->free = obj;
+	}
+
+	cache->nr_free += count;
+	cache->nr_objs += count;
+	cache->nr_chunks++;
+	return true;
+}
+
+void *
+slab_alloc(slab_cache *cache)
+{
+	void **obj;
+
+	if (cache->free == NULL && !slab_grow(cache)) {
+		return NULL;
+	}
+
+	obj = cache->free;
+	cache->free = *obj;
+	cache->nr_free--;
+	return obj;
+}
+
+void
+slab_free(slab_cache *cache,
+	  void *obj)
+{
+	if (obj == NULL) {
+		return;
+	}
+
+	BUG_ON((UN(obj) & (cache->align - 1)) != 0);
+	BUG_ON(cache->nr_free == cache->nr_objs);
+
+	*(void **) obj = cache->free;
+	cache->free = obj;
+	cache->nr_free++;
+}
@@ -0,0 +1,63 @@
+/*
+ * Fixed-size object caches on top of LMB.
+ *
+ * Copyright (C) 2018 Andrei Warkentin <andrey.warkentin@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <lmb.h>
+
+/*
+ * Objects are carved out of chunks of at least this size,
+ * so a cache costs one reserved region per chunk rather than
+ * per object. Chunks are never returned to LMB.
+ */
+#define SLAB_CHUNK_SIZE 0x10000
+
+typedef struct slab_cache {
+	/*
+	 * Object size rounded up to the alignment.
+	 */
+	size_t stride;
+	size_t align;
+	size_t chunk_size;
+	/*
+	 * LMB_ALLOC_32BIT for objects that are DMA'd to or from.
+	 */
+	phys_addr_t max_addr;
+	lmb_tag_t tag;
+	/*
+	 * Free objects, linked through their first word.
+	 */
+	void *free;
+	unsigned long nr_free;
+	unsigned long nr_objs;
+	unsigned long nr_chunks;
+} slab_cache;
+
+void slab_cache_init(slab_cache *cache,
+		     size_t size,
+		     size_t align,
+		     phys_addr_t max_addr,
+		     lmb_tag_t tag);
+void *slab_alloc(slab_cache *cache);
+void slab_free(slab_cache *cache,
+	       void *obj);
+
+#endif /* SLAB_H */
@@ -497,6 +497,15 @@ char *strsep(char **s, const char *ct)
 }
 #endif
 
+/*
+ * memset() goes a word at a time once the destination is aligned,
+ * and memcpy() and memmove() do when source and destination are
+ * equally misaligned. Anything else is left to the byte loops, as
+ * -mstrict-align rules out unaligned words.
+ */
+#define MEM_WORD sizeof(unsigned long)
+#define MEM_WORD_OFFSET(x) ((unsigned long) (x) & (MEM_WORD - 1))
+
 #ifndef __HAVE_ARCH_MEMSET
 /**
  * memset - Fill a region of memory with the given value
@@ -509,6 +518,16 @@ char *strsep(char **s, const char *ct)
 void *memset(void *s, int c, size_t count)
 {
 	char *xs = s;
+	unsigned long word = (unsigned char) c * (~0UL / 0xff);
+
+	while (count && MEM_WORD_OFFSET(xs)) {
+		*xs++ = c;
+		count--;
+	}
+	for (; count >= MEM_WORD; count -= MEM_WORD) {
+		*(unsigned long *) xs = word;
+		xs += MEM_WORD;
+	}
 
 	while (count--)
 		*xs++ = c;
@@ -531,6 +550,18 @@ void *memcpy(void *dest, const void *src, size_t count)
 	char *tmp = dest;
 	const char *s = src;
 
+	if (!MEM_WORD_OFFSET((unsigned long) tmp ^ (unsigned long) s)) {
+		while (count && MEM_WORD_OFFSET(tmp)) {
+			*tmp++ = *s++;
+			count--;
+		}
+		for (; count >= MEM_WORD; count -= MEM_WORD) {
+			*(unsigned long *) tmp = *(const unsigned long *) s;
+			tmp += MEM_WORD;
+			s += MEM_WORD;
+		}
+	}
+
 	while (count--)
 		*tmp++ = *s++;
 	return dest;
@@ -551,9 +582,21 @@ void *memmove(void *dest, const void *src, size_t count)
 	char *tmp;
 	const char *s;
 
+	bool_t words = !MEM_WORD_OFFSET((unsigned long) dest ^
+					(unsigned long) src);
+
 	if (dest <= src) {
 		tmp = dest;
 		s = src;
+		while (words && count && MEM_WORD_OFFSET(tmp)) {
+			*tmp++ = *s++;
+			count--;
+		}
+		for (; words && count >= MEM_WORD; count -= MEM_WORD) {
+			*(unsigned long *) tmp = *(const unsigned long *) s;
+			tmp += MEM_WORD;
+			s += MEM_WORD;
+		}
 		while (count--)
 			*tmp++ = *s++;
 	} else {
@@ -561,6 +604,15 @@ void *memmove(void *dest, const void *src, size_t count)
 		tmp += count;
 		s = src;
 		s += count;
+		while (words && count && MEM_WORD_OFFSET(tmp)) {
+			*--tmp = *--s;
+			count--;
+		}
+		for (; words && count >= MEM_WORD; count -= MEM_WORD) {
+			tmp -= MEM_WORD;
+			s -= MEM_WORD;
+			*(unsigned long *) tmp = *(const unsigned long *) s;
+		}
 		while (count--)
 			*--tmp = *--s;
 	}
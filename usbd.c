@@ -47,6 +47,7 @@
 
 #include <lib.h>
 #include <usbd.h>
+#include <slab.h>
 
 #define MAX_DMA_ADDR 0xffffffff
 #define EHCI_BASE    (context->ehci_udc_base)
@@ -94,6 +95,12 @@
 #define MAX_REQS (MAX_EPS * 2)
 static usbd_req *usbd_reqs[MAX_REQS];
 
+/*
+ * Requests are DMA'd to and from (small_buffer), so
+ * they come from below 4GB.
+ */
+static slab_cache usbd_req_cache;
+
 static const char * const usbd_ep_type_names[] = {
 	"EP_TYPE_NONE",
 	"EP_TYPE_CTLR",
@@ -135,6 +142,31 @@ usbd_req_init(usbd_req *req,
 	BUG_ON (UN(req->buffer) > MAX_DMA_ADDR);
 }
 
+usbd_req *
+usbd_req_alloc(usbd_ep *ep)
+{
+	usbd_req *req;
+
+	if (usbd_req_cache.stride == 0) {
+		slab_cache_init(&usbd_req_cache, sizeof(usbd_req),
+				USBD_ALIGNMENT, MAX_DMA_ADDR,
+				LMB_TAG("UREQ"));
+	}
+
+	req = slab_alloc(&usbd_req_cache);
+	if (req != NULL) {
+		usbd_req_init(req, ep);
+	}
+
+	return req;
+}
+
+void
+usbd_req_free(usbd_req *req)
+{
+	slab_free(&usbd_req_cache, req);
+}
+
 static usbd_ep *
 usbd_get_ep(usbd *context,
 	    int ep,
@@ -711,3 +743,14 @@ usbd_poll(usbd *context)
 
 	return USBD_SUCCESS;
 }
+
+/*
+ * Whether usbd_poll would have nothing to do.
+ */
+bool_t
+usbd_idle(usbd *context)
+{
+	return IN32(USBSTS) == 0 &&
+		IN32(EPTCOMPLETE) == 0 &&
+		IN32(EPTSETUPST) == 0;
+}
@@ -241,9 +241,15 @@ typedef struct usbd {
 usbd_status usbd_init(usbd *context, usbd_td *qtds,size_t qtd_count);
 void usbd_fini(usbd *context);
 usbd_status usbd_poll(usbd *context);
+bool_t usbd_idle(usbd *context);
 void usbd_ep_enable(usbd *context, usbd_ep *ep_out, usbd_ep *ep_in);
 void usbd_ep_disable(usbd *context, usbd_ep *ep_out, usbd_ep *ep_in);
 void usbd_req_init(usbd_req *req, usbd_ep *ep);
+/*
+ * From a slab cache below 4GB, already initialized.
+ */
+usbd_req *usbd_req_alloc(usbd_ep *ep);
+void usbd_req_free(usbd_req *req);
 usbd_status usbd_req_submit(usbd *context, usbd_req *req);
 void usbd_req_cancel(usbd *context, usbd_req *req);
 
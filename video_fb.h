@@ -46,4 +46,11 @@
 int video_init(void *fb);
 void video_puts(const char *s);
 
+/*
+ * video_write only updates the console text, which
+ * video_flush then draws. video_puts does both.
+ */
+void video_write(const char *s, size_t len);
+void video_flush(void);
+
 #endif /*_VIDEO_FB_H_ */